@@ -54,13 +54,28 @@ LibmsiRecord *      libmsi_database_get_primary_keys    (LibmsiDatabase *db,
 gboolean            libmsi_database_apply_transform     (LibmsiDatabase *db,
                                                          const char *file,
                                                          GError **error);
+gboolean            libmsi_database_attach              (LibmsiDatabase *db,
+                                                         LibmsiDatabase *other,
+                                                         const char *alias,
+                                                         GError **error);
+gboolean            libmsi_database_execute_script      (LibmsiDatabase *db,
+                                                         const char *sql,
+                                                         LibmsiRecord *params,
+                                                         GError **error);
 gboolean            libmsi_database_export              (LibmsiDatabase *db,
                                                          const char *table,
                                                          int fd,
                                                          GError **error);
+gboolean            libmsi_database_export_all          (LibmsiDatabase *db,
+                                                         const char *dir,
+                                                         GError **error);
 gboolean            libmsi_database_import              (LibmsiDatabase *db,
                                                          const char *path,
                                                          GError **error);
+gboolean            libmsi_database_import_many         (LibmsiDatabase *db,
+                                                         const char **paths,
+                                                         unsigned count,
+                                                         GError **error);
 gboolean            libmsi_database_is_table_persistent (LibmsiDatabase *db,
                                                          const char *table,
                                                          GError **error);
@@ -47,6 +47,15 @@ LibmsiQuery *     libmsi_query_new               (LibmsiDatabase *database,
                                                   GError **error);
 LibmsiRecord *    libmsi_query_fetch             (LibmsiQuery *query,
                                                   GError **error);
+GPtrArray *       libmsi_query_fetch_batch       (LibmsiQuery *query,
+                                                  guint max_rows,
+                                                  GError **error);
+gboolean          libmsi_query_next              (LibmsiQuery *query,
+                                                  GError **error);
+gint              libmsi_query_get_int           (LibmsiQuery *query,
+                                                  guint col);
+const gchar *     libmsi_query_get_string_const  (LibmsiQuery *query,
+                                                  guint col);
 gboolean          libmsi_query_execute           (LibmsiQuery *query,
                                                   LibmsiRecord *rec,
                                                   GError **error);
@@ -58,6 +67,8 @@ void              libmsi_query_get_error         (LibmsiQuery *query,
 LibmsiRecord *    libmsi_query_get_column_info   (LibmsiQuery *query,
                                                   LibmsiColInfo info,
                                                   GError **error);
+gchar *           libmsi_query_get_stats         (LibmsiQuery *query,
+                                                  GError **error);
 
 G_END_DECLS
 
@@ -57,6 +57,8 @@ gboolean          libmsi_record_set_string         (LibmsiRecord *record,
                                                     const gchar *val);
 gchar *           libmsi_record_get_string         (const LibmsiRecord *record,
                                                     guint field);
+const gchar *     libmsi_record_get_string_const   (const LibmsiRecord *record,
+                                                    guint field);
 gboolean          libmsi_record_load_stream        (LibmsiRecord *record,
                                                     guint field,
                                                     const gchar *filename);
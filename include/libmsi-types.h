@@ -79,6 +79,8 @@ typedef enum LibmsiDbFlags
     LIBMSI_DB_FLAGS_CREATE     = 1 << 1,
     LIBMSI_DB_FLAGS_TRANSACT   = 1 << 2,
     LIBMSI_DB_FLAGS_PATCH      = 1 << 3,
+    LIBMSI_DB_FLAGS_PARALLEL   = 1 << 4,
+    LIBMSI_DB_FLAGS_EAGER      = 1 << 5,
 } LibmsiDbFlags;
 
 typedef enum LibmsiDBError
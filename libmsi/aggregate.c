@@ -0,0 +1,536 @@
+/*
+ * Implementation of the Microsoft Installer (msi.dll)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdarg.h>
+
+#include "debug.h"
+#include "libmsi.h"
+#include "msipriv.h"
+
+#include "query.h"
+
+
+/* COUNT, MIN and MAX over the rows of another view, optionally grouped */
+
+typedef struct _LibmsiAggregateColumn
+{
+    unsigned aggregate;  /* AGGREGATE_NONE for a GROUP BY key */
+    unsigned col;        /* column in the underlying view, 0 for COUNT(*) */
+    unsigned type;
+    unsigned key;        /* index into the group key values */
+} LibmsiAggregateColumn;
+
+typedef struct _LibmsiAggregateGroup
+{
+    unsigned key_count;
+    unsigned values[1];  /* key values followed by one slot per column */
+} LibmsiAggregateGroup;
+
+typedef struct _LibmsiAggregateView
+{
+    LibmsiView        view;
+    LibmsiDatabase   *db;
+    LibmsiView       *table;
+    unsigned           num_cols;
+    unsigned           num_keys;
+    unsigned          *keys;
+    LibmsiAggregateGroup **groups;
+    unsigned           row_count;
+    unsigned           max_groups;
+    GHashTable        *lookup;
+    LibmsiAggregateColumn cols[1];
+} LibmsiAggregateView;
+
+#define INITIAL_GROUP_SIZE 16
+
+static guint group_hash( gconstpointer key )
+{
+    const LibmsiAggregateGroup *group = key;
+    guint hash = 0;
+    unsigned i;
+
+    for (i = 0; i < group->key_count; i++)
+        hash = hash * 31 + group->values[i];
+
+    return hash;
+}
+
+static gboolean group_equal( gconstpointer a, gconstpointer b )
+{
+    const LibmsiAggregateGroup *left = a;
+    const LibmsiAggregateGroup *right = b;
+
+    return !memcmp( left->values, right->values, left->key_count * sizeof(unsigned) );
+}
+
+static void free_groups( LibmsiAggregateView *av )
+{
+    unsigned i;
+
+    if (av->lookup)
+        g_hash_table_destroy( av->lookup );
+    av->lookup = NULL;
+
+    for (i = 0; i < av->row_count; i++)
+        msi_free( av->groups[i] );
+    msi_free( av->groups );
+    av->groups = NULL;
+    av->row_count = 0;
+    av->max_groups = 0;
+}
+
+static LibmsiAggregateGroup *new_group( LibmsiAggregateView *av, const unsigned *keys )
+{
+    LibmsiAggregateGroup *group;
+    unsigned i;
+
+    if (av->row_count >= av->max_groups)
+    {
+        unsigned newsize = av->max_groups ? av->max_groups * 2 : INITIAL_GROUP_SIZE;
+        LibmsiAggregateGroup **groups;
+
+        groups = msi_realloc( av->groups, newsize * sizeof(*groups) );
+        if (!groups)
+            return NULL;
+        av->groups = groups;
+        av->max_groups = newsize;
+    }
+
+    group = msi_alloc( offsetof( LibmsiAggregateGroup, values[av->num_keys + av->num_cols] ) );
+    if (!group)
+        return NULL;
+
+    group->key_count = av->num_keys;
+    memcpy( group->values, keys, av->num_keys * sizeof(unsigned) );
+    for (i = 0; i < av->num_cols; i++)
+        group->values[av->num_keys + i] = 0;
+
+    av->groups[av->row_count++] = group;
+    if (av->lookup)
+        g_hash_table_insert( av->lookup, group, group );
+
+    return group;
+}
+
+static unsigned aggregate_view_fetch_int( LibmsiView *view, unsigned row, unsigned col, unsigned *val )
+{
+    LibmsiAggregateView *av = (LibmsiAggregateView*)view;
+    const LibmsiAggregateColumn *column;
+    const LibmsiAggregateGroup *group;
+
+    TRACE("%p %d %d %p\n", av, row, col, val );
+
+    if( !av->table )
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    if( !col || col > av->num_cols )
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    if( row >= av->row_count )
+        return LIBMSI_RESULT_INVALID_PARAMETER;
+
+    group = av->groups[row];
+    column = &av->cols[col - 1];
+
+    switch (column->aggregate)
+    {
+    case AGGREGATE_NONE:
+        *val = group->values[column->key];
+        break;
+    case AGGREGATE_COUNT_STAR:
+    case AGGREGATE_COUNT:
+        *val = group->values[av->num_keys + col - 1] + (1u << 31);
+        break;
+    default:
+        *val = group->values[av->num_keys + col - 1];
+        break;
+    }
+
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+static void aggregate_update( LibmsiAggregateView *av, LibmsiAggregateGroup *group,
+                              unsigned col, unsigned val )
+{
+    unsigned *slot = &group->values[av->num_keys + col];
+
+    switch (av->cols[col].aggregate)
+    {
+    case AGGREGATE_COUNT_STAR:
+        (*slot)++;
+        break;
+    case AGGREGATE_COUNT:
+        if (val)
+            (*slot)++;
+        break;
+    /* integers are stored biased, so the raw values compare in order */
+    case AGGREGATE_MIN:
+        if (val && (!*slot || val < *slot))
+            *slot = val;
+        break;
+    case AGGREGATE_MAX:
+        if (val && val > *slot)
+            *slot = val;
+        break;
+    }
+}
+
+static unsigned aggregate_view_execute( LibmsiView *view, LibmsiRecord *record )
+{
+    LibmsiAggregateView *av = (LibmsiAggregateView*)view;
+    LibmsiAggregateGroup *group = NULL, *lookup;
+    unsigned r, i, j, row_count, first, count, *keys, *vals = NULL;
+    bool count_only = true;
+
+    TRACE("%p %p\n", av, record);
+
+    if( !av->table )
+         return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    free_groups( av );
+
+    r = av->table->ops->execute( av->table, record );
+    if( r != LIBMSI_RESULT_SUCCESS )
+        return r;
+
+    r = av->table->ops->get_dimensions( av->table, &row_count, NULL );
+    if( r != LIBMSI_RESULT_SUCCESS )
+        return r;
+
+    for (i = 0; i < av->num_cols; i++)
+        if (av->cols[i].aggregate != AGGREGATE_COUNT_STAR)
+            count_only = false;
+
+    if (!av->num_keys)
+    {
+        /* without GROUP BY there is always exactly one result row */
+        group = new_group( av, NULL );
+        if (!group)
+            return LIBMSI_RESULT_OUTOFMEMORY;
+
+        /* plain COUNT(*) needs nothing but the row count */
+        if (count_only)
+        {
+            for (i = 0; i < av->num_cols; i++)
+                group->values[i] = row_count;
+            return LIBMSI_RESULT_SUCCESS;
+        }
+    }
+    else
+        av->lookup = g_hash_table_new( group_hash, group_equal );
+
+    lookup = msi_alloc( offsetof( LibmsiAggregateGroup, values[av->num_keys] ) );
+    vals = msi_alloc( (av->num_keys + av->num_cols) * MSI_FETCH_ROWS * sizeof(*vals) );
+    if (!lookup || !vals)
+    {
+        r = LIBMSI_RESULT_OUTOFMEMORY;
+        goto done;
+    }
+    lookup->key_count = av->num_keys;
+    keys = lookup->values;
+
+    /* the keys are read into vals first, then the aggregated columns,
+     * MSI_FETCH_ROWS values for each */
+    for (first = 0; first < row_count; first += count)
+    {
+        count = MIN( row_count - first, MSI_FETCH_ROWS );
+        for (j = 0; j < av->num_keys; j++)
+        {
+            r = msi_view_fetch_column_range( av->table, av->keys[j], first, count,
+                                             &vals[j * MSI_FETCH_ROWS] );
+            if (r != LIBMSI_RESULT_SUCCESS)
+                goto done;
+        }
+        for (j = 0; j < av->num_cols; j++)
+        {
+            if (av->cols[j].aggregate == AGGREGATE_NONE || !av->cols[j].col)
+                continue;
+
+            r = msi_view_fetch_column_range( av->table, av->cols[j].col, first, count,
+                                             &vals[(av->num_keys + j) * MSI_FETCH_ROWS] );
+            if (r != LIBMSI_RESULT_SUCCESS)
+                goto done;
+        }
+
+        for (i = 0; i < count; i++)
+        {
+            for (j = 0; j < av->num_keys; j++)
+                keys[j] = vals[j * MSI_FETCH_ROWS + i];
+
+            if (av->lookup)
+            {
+                group = g_hash_table_lookup( av->lookup, lookup );
+                if (!group)
+                    group = new_group( av, keys );
+                if (!group)
+                {
+                    r = LIBMSI_RESULT_OUTOFMEMORY;
+                    goto done;
+                }
+            }
+
+            for (j = 0; j < av->num_cols; j++)
+            {
+                if (av->cols[j].aggregate == AGGREGATE_NONE)
+                    continue;
+
+                aggregate_update( av, group, j, av->cols[j].col ?
+                                  vals[(av->num_keys + j) * MSI_FETCH_ROWS + i] : 0 );
+            }
+        }
+    }
+    r = LIBMSI_RESULT_SUCCESS;
+
+done:
+    msi_free( vals );
+    msi_free( lookup );
+    return r;
+}
+
+static unsigned aggregate_view_close( LibmsiView *view )
+{
+    LibmsiAggregateView *av = (LibmsiAggregateView*)view;
+
+    TRACE("%p\n", av );
+
+    if( !av->table )
+         return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    free_groups( av );
+
+    return av->table->ops->close( av->table );
+}
+
+static unsigned aggregate_view_get_dimensions( LibmsiView *view, unsigned *rows, unsigned *cols )
+{
+    LibmsiAggregateView *av = (LibmsiAggregateView*)view;
+
+    TRACE("%p %p %p\n", av, rows, cols );
+
+    if( !av->table )
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    if( rows )
+    {
+        if( !av->groups && !av->lookup )
+            return LIBMSI_RESULT_FUNCTION_FAILED;
+        *rows = av->row_count;
+    }
+
+    if( cols )
+        *cols = av->num_cols;
+
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+static unsigned aggregate_view_get_column_info( LibmsiView *view, unsigned n, const char **name,
+                                       unsigned *type, bool *temporary, const char **table_name )
+{
+    LibmsiAggregateView *av = (LibmsiAggregateView*)view;
+    const LibmsiAggregateColumn *column;
+
+    TRACE("%p %d %p %p %p %p\n", av, n, name, type, temporary, table_name );
+
+    if( !av->table )
+         return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    if( !n || n > av->num_cols )
+         return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    column = &av->cols[n - 1];
+    switch (column->aggregate)
+    {
+    case AGGREGATE_COUNT_STAR:
+    case AGGREGATE_COUNT:
+        if (name) *name = "COUNT";
+        if (type) *type = MSITYPE_VALID | 4;
+        if (temporary) *temporary = false;
+        if (table_name) *table_name = szEmpty;
+        return LIBMSI_RESULT_SUCCESS;
+    case AGGREGATE_MIN:
+    case AGGREGATE_MAX:
+        if (name) *name = column->aggregate == AGGREGATE_MIN ? "MIN" : "MAX";
+        if (type) *type = column->type | MSITYPE_NULLABLE;
+        if (temporary) *temporary = false;
+        if (table_name) *table_name = szEmpty;
+        return LIBMSI_RESULT_SUCCESS;
+    }
+
+    return av->table->ops->get_column_info( av->table, column->col, name,
+                                            type, temporary, table_name );
+}
+
+static unsigned aggregate_view_delete( LibmsiView *view )
+{
+    LibmsiAggregateView *av = (LibmsiAggregateView*)view;
+
+    TRACE("%p\n", av );
+
+    if( av->table )
+        av->table->ops->delete( av->table );
+
+    free_groups( av );
+    msi_free( av->keys );
+    g_object_unref(av->db);
+    msi_free( av );
+
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+static void aggregate_view_explain( LibmsiView *view, GString *str, unsigned depth )
+{
+    LibmsiAggregateView *av = (LibmsiAggregateView*)view;
+
+    g_string_append_printf( str, "%*sAGGREGATE keys=%u rows=%u\n", depth * 2, "",
+                            av->num_keys, av->row_count );
+    if( av->table )
+        msi_view_explain( av->table, str, depth + 1 );
+}
+
+static const LibmsiViewOps aggregate_ops =
+{
+    aggregate_view_fetch_int,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    aggregate_view_execute,
+    aggregate_view_close,
+    aggregate_view_get_dimensions,
+    aggregate_view_get_column_info,
+    aggregate_view_delete,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    aggregate_view_explain,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+};
+
+static unsigned aggregate_find_key( LibmsiAggregateView *av, unsigned col )
+{
+    unsigned i;
+
+    for (i = 0; i < av->num_keys; i++)
+        if (av->keys[i] == col)
+            return i;
+    return av->num_keys;
+}
+
+unsigned aggregate_view_create( LibmsiDatabase *db, LibmsiView **view, LibmsiView *table,
+                            const column_info *columns, const column_info *group )
+{
+    LibmsiAggregateView *av = NULL;
+    const column_info *column;
+    unsigned count = 0, keys = 0, i, r = LIBMSI_RESULT_SUCCESS;
+
+    TRACE("%p\n", table );
+
+    for (column = columns; column; column = column->next)
+        count++;
+    for (column = group; column; column = column->next)
+        keys++;
+
+    av = msi_alloc_zero( sizeof *av + count * sizeof(LibmsiAggregateColumn) );
+    if( !av )
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    av->keys = msi_alloc_zero( (keys + 1) * sizeof(unsigned) );
+    if( !av->keys )
+    {
+        msi_free( av );
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+    }
+
+    for (column = group; column; column = column->next)
+    {
+        unsigned type;
+
+        r = _libmsi_view_find_column( table, column->column, column->table,
+                                      &av->keys[av->num_keys] );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            goto fail;
+
+        r = table->ops->get_column_info( table, av->keys[av->num_keys], NULL, &type, NULL, NULL );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            goto fail;
+        if (MSITYPE_IS_BINARY(type))
+        {
+            r = LIBMSI_RESULT_BAD_QUERY_SYNTAX;
+            goto fail;
+        }
+
+        av->num_keys++;
+    }
+
+    for (column = columns, i = 0; column; column = column->next, i++)
+    {
+        LibmsiAggregateColumn *col = &av->cols[i];
+
+        col->aggregate = column->aggregate;
+        if (col->aggregate == AGGREGATE_COUNT_STAR)
+            continue;
+
+        r = _libmsi_view_find_column( table, column->column, column->table, &col->col );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            goto fail;
+
+        r = table->ops->get_column_info( table, col->col, NULL, &col->type, NULL, NULL );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            goto fail;
+
+        r = LIBMSI_RESULT_BAD_QUERY_SYNTAX;
+        switch (col->aggregate)
+        {
+        case AGGREGATE_NONE:
+            /* plain columns must be grouped on */
+            col->key = aggregate_find_key( av, col->col );
+            if (col->key == av->num_keys)
+                goto fail;
+            break;
+        case AGGREGATE_MIN:
+        case AGGREGATE_MAX:
+            if (col->type & MSITYPE_STRING)
+                goto fail;
+            break;
+        }
+        r = LIBMSI_RESULT_SUCCESS;
+    }
+
+    /* fill the structure */
+    av->view.ops = &aggregate_ops;
+    av->db = g_object_ref(db);
+    av->table = table;
+    av->num_cols = count;
+    *view = &av->view;
+
+    return LIBMSI_RESULT_SUCCESS;
+
+fail:
+    msi_free( av->keys );
+    msi_free( av );
+    return r;
+}
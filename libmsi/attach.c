@@ -0,0 +1,411 @@
+/*
+ * Implementation of the Microsoft Installer (msi.dll)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdarg.h>
+
+#include "debug.h"
+#include "libmsi.h"
+#include "msipriv.h"
+
+#include "query.h"
+
+
+/*
+ * An attached database is read through views named alias.Table.  The
+ * string ids of its tables are translated into ids of the attaching
+ * database, so the rest of the query engine only ever sees one string
+ * table.
+ */
+
+typedef struct _LibmsiAttachedDatabase
+{
+    struct list entry;
+    LibmsiDatabase *db;
+    char *alias;
+    unsigned *string_ids;   /* our id for each string id of db, 0 if not mapped yet */
+    unsigned string_count;
+} LibmsiAttachedDatabase;
+
+typedef struct _LibmsiAttachedView
+{
+    LibmsiView          view;
+    LibmsiDatabase     *db;
+    LibmsiAttachedDatabase *attached;
+    LibmsiView         *table;
+    unsigned            num_cols;
+    unsigned           *types;
+    char                name[1];
+} LibmsiAttachedView;
+
+static unsigned translate_string_id( LibmsiDatabase *db, LibmsiAttachedDatabase *ad, unsigned id )
+{
+    const char *str;
+    unsigned *ids;
+    int n;
+
+    if (!id)
+        return 0;
+
+    if (id >= ad->string_count)
+    {
+        unsigned count = msi_string_count( ad->db->strings );
+
+        if (id >= count)
+            return 0;
+
+        ids = msi_realloc_zero( ad->string_ids, ad->string_count * sizeof(*ids),
+                                count * sizeof(*ids) );
+        if (!ids)
+            return 0;
+        ad->string_ids = ids;
+        ad->string_count = count;
+    }
+
+    if (!ad->string_ids[id])
+    {
+        str = msi_string_lookup_id( ad->db->strings, id );
+        if (!str)
+            return 0;
+
+        n = _libmsi_add_string( db->strings, str, -1, 1, StringNonPersistent );
+        if (n <= 0)
+            return 0;
+        ad->string_ids[id] = n;
+    }
+    return ad->string_ids[id];
+}
+
+/* maps all of the strings, so that the ids used by a query don't depend
+ * on the order in which its rows are read */
+static void translate_strings( LibmsiDatabase *db, LibmsiAttachedDatabase *ad )
+{
+    unsigned i;
+
+    for (i = 1; i < ad->string_count; i++)
+        translate_string_id( db, ad, i );
+}
+
+static LibmsiAttachedDatabase *find_attached( LibmsiDatabase *db, const char *alias, unsigned len )
+{
+    LibmsiAttachedDatabase *ad;
+
+    LIST_FOR_EACH_ENTRY( ad, &db->attached, LibmsiAttachedDatabase, entry )
+    {
+        if (strlen( ad->alias ) == len && !strncmp( ad->alias, alias, len ))
+            return ad;
+    }
+    return NULL;
+}
+
+unsigned _libmsi_database_attach( LibmsiDatabase *db, LibmsiDatabase *other, const char *alias )
+{
+    LibmsiAttachedDatabase *ad;
+
+    TRACE("%p %p %s\n", db, other, debugstr_a(alias));
+
+    /* the alias must be unique and must not contain the separator */
+    if (db == other || !alias[0] || strchr( alias, '.' ) ||
+        find_attached( db, alias, strlen( alias ) ))
+        return LIBMSI_RESULT_INVALID_PARAMETER;
+
+    ad = msi_alloc_zero( sizeof *ad );
+    if (!ad)
+        return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+
+    ad->string_count = msi_string_count( other->strings );
+    ad->string_ids = msi_alloc_zero( ad->string_count * sizeof(*ad->string_ids) );
+    ad->alias = strdup( alias );
+    if (!ad->string_ids || !ad->alias)
+    {
+        msi_free( ad->string_ids );
+        msi_free( ad->alias );
+        msi_free( ad );
+        return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+    }
+    ad->db = g_object_ref( other );
+
+    translate_strings( db, ad );
+
+    list_add_tail( &db->attached, &ad->entry );
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+/* a commit reloads the string table of db, which drops the strings of the
+ * attached databases; add them again */
+void _libmsi_database_reload_attached( LibmsiDatabase *db )
+{
+    LibmsiAttachedDatabase *ad;
+
+    LIST_FOR_EACH_ENTRY( ad, &db->attached, LibmsiAttachedDatabase, entry )
+    {
+        memset( ad->string_ids, 0, ad->string_count * sizeof(*ad->string_ids) );
+        translate_strings( db, ad );
+    }
+}
+
+void _libmsi_database_free_attached( LibmsiDatabase *db )
+{
+    LibmsiAttachedDatabase *ad, *next;
+
+    LIST_FOR_EACH_ENTRY_SAFE( ad, next, &db->attached, LibmsiAttachedDatabase, entry )
+    {
+        list_remove( &ad->entry );
+        if (db->strings)
+            msi_string_release_many( db->strings, ad->string_ids, ad->string_count,
+                                     StringNonPersistent );
+        g_object_unref( ad->db );
+        msi_free( ad->string_ids );
+        msi_free( ad->alias );
+        msi_free( ad );
+    }
+}
+
+static bool is_string_column( unsigned type )
+{
+    return (type & MSITYPE_STRING) && !MSITYPE_IS_BINARY(type);
+}
+
+static unsigned attached_view_fetch_int( LibmsiView *view, unsigned row, unsigned col, unsigned *val )
+{
+    LibmsiAttachedView *av = (LibmsiAttachedView*)view;
+    unsigned r;
+
+    TRACE("%p %d %d %p\n", av, row, col, val );
+
+    if (col == 0 || col > av->num_cols)
+        return LIBMSI_RESULT_INVALID_PARAMETER;
+
+    r = av->table->ops->fetch_int( av->table, row, col, val );
+    if (r == LIBMSI_RESULT_SUCCESS && is_string_column( av->types[col - 1] ))
+        *val = translate_string_id( av->db, av->attached, *val );
+    return r;
+}
+
+static unsigned attached_view_fetch_column_range( LibmsiView *view, unsigned col, unsigned first,
+                                                  unsigned count, unsigned *out )
+{
+    LibmsiAttachedView *av = (LibmsiAttachedView*)view;
+    unsigned i, r;
+
+    TRACE("%p %d %d %d %p\n", av, col, first, count, out );
+
+    if (col == 0 || col > av->num_cols)
+        return LIBMSI_RESULT_INVALID_PARAMETER;
+
+    r = msi_view_fetch_column_range( av->table, col, first, count, out );
+    if (r == LIBMSI_RESULT_SUCCESS && is_string_column( av->types[col - 1] ))
+    {
+        for (i = 0; i < count; i++)
+            out[i] = translate_string_id( av->db, av->attached, out[i] );
+    }
+    return r;
+}
+
+static unsigned attached_view_fetch_stream( LibmsiView *view, unsigned row, unsigned col, GsfInput **stm )
+{
+    LibmsiAttachedView *av = (LibmsiAttachedView*)view;
+
+    TRACE("%p %d %d %p\n", av, row, col, stm );
+
+    return av->table->ops->fetch_stream( av->table, row, col, stm );
+}
+
+/* the streams are read from the attached database */
+static unsigned attached_view_fetch_stream_name( LibmsiView *view, unsigned row, unsigned col,
+                                                 LibmsiDatabase **db, const char **name,
+                                                 const char **encname )
+{
+    LibmsiAttachedView *av = (LibmsiAttachedView*)view;
+
+    TRACE("%p %d %d\n", av, row, col );
+
+    return msi_view_fetch_stream_name( av->table, row, col, db, name, encname );
+}
+
+static unsigned attached_view_get_row( LibmsiView *view, unsigned row, LibmsiRecord **rec )
+{
+    LibmsiAttachedView *av = (LibmsiAttachedView*)view;
+
+    TRACE("%p %d %p\n", av, row, rec );
+
+    return msi_view_get_row( av->db, view, row, rec );
+}
+
+static unsigned attached_view_execute( LibmsiView *view, LibmsiRecord *record )
+{
+    LibmsiAttachedView *av = (LibmsiAttachedView*)view;
+
+    TRACE("%p %p\n", av, record );
+
+    return av->table->ops->execute( av->table, record );
+}
+
+static unsigned attached_view_close( LibmsiView *view )
+{
+    LibmsiAttachedView *av = (LibmsiAttachedView*)view;
+
+    TRACE("%p\n", av );
+
+    return av->table->ops->close( av->table );
+}
+
+static unsigned attached_view_get_dimensions( LibmsiView *view, unsigned *rows, unsigned *cols )
+{
+    LibmsiAttachedView *av = (LibmsiAttachedView*)view;
+
+    TRACE("%p %p %p\n", av, rows, cols );
+
+    return av->table->ops->get_dimensions( av->table, rows, cols );
+}
+
+static unsigned attached_view_get_column_info( LibmsiView *view, unsigned n, const char **name,
+                                      unsigned *type, bool *temporary, const char **table_name )
+{
+    LibmsiAttachedView *av = (LibmsiAttachedView*)view;
+    unsigned r;
+
+    TRACE("%p %d %p %p %p %p\n", av, n, name, type, temporary, table_name );
+
+    r = av->table->ops->get_column_info( av->table, n, name, type, temporary, NULL );
+    if (r == LIBMSI_RESULT_SUCCESS && table_name)
+        *table_name = av->name;
+    return r;
+}
+
+static unsigned attached_view_delete( LibmsiView *view )
+{
+    LibmsiAttachedView *av = (LibmsiAttachedView*)view;
+
+    TRACE("%p\n", av );
+
+    av->table->ops->delete( av->table );
+    g_object_unref( av->db );
+    msi_free( av->types );
+    msi_free( av );
+
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+static unsigned attached_view_find_matching_rows( LibmsiView *view, unsigned col,
+    unsigned val, unsigned *row, MSIITERHANDLE *handle )
+{
+    LibmsiAttachedView *av = (LibmsiAttachedView*)view;
+    const char *str;
+
+    TRACE("%p, %d, %u, %p\n", view, col, val, *handle);
+
+    if (col == 0 || col > av->num_cols)
+        return LIBMSI_RESULT_INVALID_PARAMETER;
+
+    /* look the string up by its id in the attached database */
+    if (val && is_string_column( av->types[col - 1] ))
+    {
+        str = msi_string_lookup_id( av->db->strings, val );
+        if (!str || _libmsi_id_from_string_utf8( av->attached->db->strings, str, &val ) != LIBMSI_RESULT_SUCCESS)
+            return NO_MORE_ITEMS;
+    }
+
+    return av->table->ops->find_matching_rows( av->table, col, val, row, handle );
+}
+
+static void attached_view_explain( LibmsiView *view, GString *str, unsigned depth )
+{
+    LibmsiAttachedView *av = (LibmsiAttachedView*)view;
+
+    g_string_append_printf( str, "%*sATTACHED `%s`\n", depth * 2, "", av->attached->alias );
+    msi_view_explain( av->table, str, depth + 1 );
+}
+
+static const LibmsiViewOps attached_ops =
+{
+    attached_view_fetch_int,
+    attached_view_fetch_stream,
+    attached_view_get_row,
+    NULL,
+    NULL,
+    NULL,
+    attached_view_execute,
+    attached_view_close,
+    attached_view_get_dimensions,
+    attached_view_get_column_info,
+    attached_view_delete,
+    attached_view_find_matching_rows,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    attached_view_explain,
+    NULL,
+    NULL,
+    attached_view_fetch_column_range,
+    attached_view_fetch_stream_name,
+    NULL,
+};
+
+unsigned attached_view_create( LibmsiDatabase *db, const char *name, LibmsiView **view )
+{
+    LibmsiAttachedDatabase *ad;
+    LibmsiAttachedView *av;
+    LibmsiView *table;
+    const char *dot;
+    unsigned r, i;
+
+    TRACE("%p %s %p\n", db, debugstr_a(name), view );
+
+    dot = strchr( name, '.' );
+    ad = find_attached( db, name, dot - name );
+    if (!ad)
+        return LIBMSI_RESULT_INVALID_TABLE;
+
+    r = table_view_create( ad->db, dot + 1, &table );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
+
+    av = msi_alloc_zero( sizeof *av + strlen( name ) );
+    if (!av)
+    {
+        table->ops->delete( table );
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+    }
+
+    av->view.ops = &attached_ops;
+    av->db = g_object_ref( db );
+    av->attached = ad;
+    av->table = table;
+    strcpy( av->name, name );
+
+    r = table->ops->get_dimensions( table, NULL, &av->num_cols );
+    if (r == LIBMSI_RESULT_SUCCESS)
+    {
+        av->types = msi_alloc( av->num_cols * sizeof(*av->types) );
+        if (!av->types)
+            r = LIBMSI_RESULT_FUNCTION_FAILED;
+    }
+    for (i = 0; r == LIBMSI_RESULT_SUCCESS && i < av->num_cols; i++)
+        r = table->ops->get_column_info( table, i + 1, NULL, &av->types[i], NULL, NULL );
+    if (r != LIBMSI_RESULT_SUCCESS)
+    {
+        attached_view_delete( &av->view );
+        return r;
+    }
+
+    *view = &av->view;
+    return LIBMSI_RESULT_SUCCESS;
+}
@@ -123,6 +123,12 @@ static const LibmsiViewOps create_ops =
     NULL,
     NULL,
     NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
 };
 
 G_GNUC_PURE
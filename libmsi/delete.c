@@ -85,6 +85,9 @@ static unsigned delete_view_execute( LibmsiView *view, LibmsiRecord *record )
 
     TRACE("deleting %d rows\n", rows);
 
+    if( !dv->table->ops->delete_row )
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
     /* blank out all the rows that match */
     for ( i=0; i<rows; i++ )
         dv->table->ops->delete_row( dv->table, i );
@@ -175,14 +178,27 @@ static const LibmsiViewOps delete_ops =
     NULL,
     NULL,
     NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
 };
 
 unsigned delete_view_create( LibmsiDatabase *db, LibmsiView **view, LibmsiView *table )
 {
     LibmsiDeleteView *dv = NULL;
+    const char *table_name;
 
     TRACE("%p\n", dv );
 
+    /* the tables of attached databases are read-only */
+    if( !table->ops->delete_row ||
+        table->ops->get_column_info( table, 1, NULL, NULL, NULL, &table_name ) ||
+        (strchr( table_name, '.' ) && !list_empty( &db->attached )) )
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
     dv = msi_alloc_zero( sizeof *dv );
     if( !dv )
         return LIBMSI_RESULT_FUNCTION_FAILED;
@@ -99,11 +99,41 @@ static unsigned distinct_view_fetch_int( LibmsiView *view, unsigned row, unsigne
     return dv->table->ops->fetch_int( dv->table, row, col, val );
 }
 
+static unsigned distinct_view_fetch_column_range( LibmsiView *view, unsigned col, unsigned first,
+                                                  unsigned count, unsigned *out )
+{
+    LibmsiDistinctView *dv = (LibmsiDistinctView*)view;
+    unsigned i, n, r;
+
+    TRACE("%p %d %d %d %p\n", dv, col, first, count, out );
+
+    if( !dv->table )
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    if( first > dv->row_count || count > dv->row_count - first )
+        return LIBMSI_RESULT_INVALID_PARAMETER;
+
+    /* the translation is in ascending order, so read each run of
+     * consecutive rows of the table at once */
+    for( i = 0; i < count; i += n )
+    {
+        for( n = 1; i + n < count; n++ )
+            if( dv->translation[ first + i + n ] != dv->translation[ first + i ] + n )
+                break;
+
+        r = msi_view_fetch_column_range( dv->table, col, dv->translation[ first + i ], n, out + i );
+        if( r != LIBMSI_RESULT_SUCCESS )
+            return r;
+    }
+    return LIBMSI_RESULT_SUCCESS;
+}
+
 static unsigned distinct_view_execute( LibmsiView *view, LibmsiRecord *record )
 {
     LibmsiDistinctView *dv = (LibmsiDistinctView*)view;
-    unsigned r, i, j, r_count, c_count;
+    unsigned r, i, j, r_count, c_count, first, count;
     LibmsiDistinctSet *rowset = NULL;
+    unsigned *vals;
 
     TRACE("%p %p\n", dv, record);
 
@@ -122,43 +152,56 @@ static unsigned distinct_view_execute( LibmsiView *view, LibmsiRecord *record )
     if( !dv->translation )
         return LIBMSI_RESULT_FUNCTION_FAILED;
 
+    vals = msi_alloc( c_count * MSI_FETCH_ROWS * sizeof(unsigned) );
+    if( !vals )
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
     /* build it */
-    for( i=0; i<r_count; i++ )
+    for( first = 0; first < r_count; first += count )
     {
-        LibmsiDistinctSet **x = &rowset;
-
+        count = MIN( r_count - first, MSI_FETCH_ROWS );
         for( j=1; j<=c_count; j++ )
         {
-            unsigned val = 0;
-            r = dv->table->ops->fetch_int( dv->table, i, j, &val );
+            r = msi_view_fetch_column_range( dv->table, j, first, count,
+                                             &vals[(j - 1) * MSI_FETCH_ROWS] );
             if( r != LIBMSI_RESULT_SUCCESS )
             {
-                g_critical("Failed to fetch int at %d %d\n", i, j );
-                distinct_free( rowset );
-                return r;
+                g_critical("Failed to fetch column %d at %d\n", j, first );
+                goto done;
             }
-            x = distinct_insert( x, val, i );
-            if( !*x )
-            {
-                g_critical("Failed to insert at %d %d\n", i, j );
-                distinct_free( rowset );
-                return LIBMSI_RESULT_FUNCTION_FAILED;
-            }
-            if( j != c_count )
-                x = &(*x)->nextcol;
         }
 
-        /* check if it was distinct and if so, include it */
-        if( (*x)->row == i )
+        for( i = first; i < first + count; i++ )
         {
-            TRACE("Row %d -> %d\n", dv->row_count, i);
-            dv->translation[dv->row_count++] = i;
+            LibmsiDistinctSet **x = &rowset;
+
+            for( j=1; j<=c_count; j++ )
+            {
+                x = distinct_insert( x, vals[(j - 1) * MSI_FETCH_ROWS + i - first], i );
+                if( !*x )
+                {
+                    g_critical("Failed to insert at %d %d\n", i, j );
+                    r = LIBMSI_RESULT_FUNCTION_FAILED;
+                    goto done;
+                }
+                if( j != c_count )
+                    x = &(*x)->nextcol;
+            }
+
+            /* check if it was distinct and if so, include it */
+            if( (*x)->row == i )
+            {
+                TRACE("Row %d -> %d\n", dv->row_count, i);
+                dv->translation[dv->row_count++] = i;
+            }
         }
     }
+    r = LIBMSI_RESULT_SUCCESS;
 
+done:
+    msi_free( vals );
     distinct_free( rowset );
-
-    return LIBMSI_RESULT_SUCCESS;
+    return r;
 }
 
 static unsigned distinct_view_close( LibmsiView *view )
@@ -247,6 +290,20 @@ static unsigned distinct_view_find_matching_rows( LibmsiView *view, unsigned col
     return r;
 }
 
+static void distinct_view_explain( LibmsiView *view, GString *str, unsigned depth )
+{
+    LibmsiDistinctView *dv = (LibmsiDistinctView*)view;
+    unsigned rows = 0;
+
+    if( dv->table )
+        dv->table->ops->get_dimensions( dv->table, &rows, NULL );
+
+    g_string_append_printf( str, "%*sDISTINCT rows=%u of %u\n", depth * 2, "",
+                            dv->row_count, rows );
+    if( dv->table )
+        msi_view_explain( dv->table, str, depth + 1 );
+}
+
 static const LibmsiViewOps distinct_ops =
 {
     distinct_view_fetch_int,
@@ -267,6 +324,12 @@ static const LibmsiViewOps distinct_ops =
     NULL,
     NULL,
     NULL,
+    distinct_view_explain,
+    NULL,
+    NULL,
+    distinct_view_fetch_column_range,
+    NULL,
+    NULL,
 };
 
 unsigned distinct_view_create( LibmsiDatabase *db, LibmsiView **view, LibmsiView *table )
@@ -105,6 +105,12 @@ static const LibmsiViewOps drop_ops =
     NULL,
     NULL,
     NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
 };
 
 unsigned drop_view_create(LibmsiDatabase *db, LibmsiView **view, const char *name)
@@ -0,0 +1,206 @@
+/*
+ * Implementation of the Microsoft Installer (msi.dll)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdarg.h>
+
+#include "debug.h"
+#include "libmsi.h"
+#include "msipriv.h"
+
+#include "query.h"
+
+
+/* EXPLAIN runs a SELECT and returns its plan, one row per line */
+
+typedef struct _LibmsiExplainView
+{
+    LibmsiView        view;
+    LibmsiDatabase   *db;
+    LibmsiView       *table;
+    GPtrArray         *lines;  /* kept out of the string table */
+} LibmsiExplainView;
+
+static const char szPlan[] = "Plan";
+
+/* the plan lines have no string ids */
+static unsigned explain_view_fetch_int( LibmsiView *view, unsigned row, unsigned col, unsigned *val )
+{
+    TRACE("%p %d %d %p\n", view, row, col, val );
+
+    return LIBMSI_RESULT_FUNCTION_FAILED;
+}
+
+static unsigned explain_view_fetch_string( LibmsiView *view, unsigned row, unsigned col, const char **str )
+{
+    LibmsiExplainView *ev = (LibmsiExplainView*)view;
+
+    TRACE("%p %d %d %p\n", ev, row, col, str );
+
+    if( col != 1 || !ev->lines || row >= ev->lines->len )
+        return LIBMSI_RESULT_INVALID_PARAMETER;
+
+    *str = g_ptr_array_index( ev->lines, row );
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+static unsigned explain_view_execute( LibmsiView *view, LibmsiRecord *record )
+{
+    LibmsiExplainView *ev = (LibmsiExplainView*)view;
+    GString *str;
+    char *line, *end;
+    unsigned r;
+
+    TRACE("%p %p\n", ev, record);
+
+    if( !ev->table )
+         return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    r = ev->table->ops->execute( ev->table, record );
+    if( r != LIBMSI_RESULT_SUCCESS )
+        return r;
+
+    str = g_string_new( NULL );
+    msi_view_explain( ev->table, str, 0 );
+
+    if( ev->lines )
+        g_ptr_array_unref( ev->lines );
+    ev->lines = g_ptr_array_new_with_free_func( g_free );
+
+    for( line = str->str; (end = strchr( line, '\n' )); line = end + 1 )
+        g_ptr_array_add( ev->lines, g_strndup( line, end - line ) );
+
+    g_string_free( str, TRUE );
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+static unsigned explain_view_close( LibmsiView *view )
+{
+    LibmsiExplainView *ev = (LibmsiExplainView*)view;
+
+    TRACE("%p\n", ev );
+
+    if( !ev->table )
+         return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    return ev->table->ops->close( ev->table );
+}
+
+static unsigned explain_view_get_dimensions( LibmsiView *view, unsigned *rows, unsigned *cols )
+{
+    LibmsiExplainView *ev = (LibmsiExplainView*)view;
+
+    TRACE("%p %p %p\n", ev, rows, cols );
+
+    if( rows )
+        *rows = ev->lines ? ev->lines->len : 0;
+    if( cols )
+        *cols = 1;
+
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+static unsigned explain_view_get_column_info( LibmsiView *view, unsigned n, const char **name,
+                                     unsigned *type, bool *temporary, const char **table_name )
+{
+    LibmsiExplainView *ev = (LibmsiExplainView*)view;
+
+    TRACE("%p %d %p %p %p %p\n", ev, n, name, type, temporary, table_name );
+
+    if( n != 1 )
+        return LIBMSI_RESULT_INVALID_PARAMETER;
+
+    if( name ) *name = szPlan;
+    if( type ) *type = MSITYPE_STRING | MSITYPE_VALID;
+    if( temporary ) *temporary = false;
+    if( table_name ) *table_name = szEmpty;
+
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+static unsigned explain_view_delete( LibmsiView *view )
+{
+    LibmsiExplainView *ev = (LibmsiExplainView*)view;
+
+    TRACE("%p\n", ev );
+
+    if( ev->table )
+        ev->table->ops->delete( ev->table );
+
+    if( ev->lines )
+        g_ptr_array_unref( ev->lines );
+    g_object_unref(ev->db);
+    msi_free( ev );
+
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+static void explain_view_explain( LibmsiView *view, GString *str, unsigned depth )
+{
+    LibmsiExplainView *ev = (LibmsiExplainView*)view;
+
+    g_string_append_printf( str, "%*sEXPLAIN\n", depth * 2, "" );
+    if( ev->table )
+        msi_view_explain( ev->table, str, depth + 1 );
+}
+
+static const LibmsiViewOps explain_ops =
+{
+    explain_view_fetch_int,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    explain_view_execute,
+    explain_view_close,
+    explain_view_get_dimensions,
+    explain_view_get_column_info,
+    explain_view_delete,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    explain_view_explain,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    explain_view_fetch_string,
+};
+
+unsigned explain_view_create( LibmsiDatabase *db, LibmsiView **view, LibmsiView *table )
+{
+    LibmsiExplainView *ev = NULL;
+
+    TRACE("%p\n", ev );
+
+    ev = msi_alloc_zero( sizeof *ev );
+    if( !ev )
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    /* fill the structure */
+    ev->view.ops = &explain_ops;
+    ev->db = g_object_ref(db);
+    ev->table = table;
+    *view = (LibmsiView*) ev;
+
+    return LIBMSI_RESULT_SUCCESS;
+}
@@ -37,7 +37,8 @@ typedef struct _LibmsiInsertView
     LibmsiDatabase     *db;
     bool             bIsTemp;
     LibmsiView         *sv;
-    column_info     *vals;
+    value_list      *vals;
+    LibmsiView         *source;
 } LibmsiInsertView;
 
 static unsigned insert_view_fetch_int( LibmsiView *view, unsigned row, unsigned col, unsigned *val )
@@ -49,16 +50,11 @@ static unsigned insert_view_fetch_int( LibmsiView *view, unsigned row, unsigned
     return LIBMSI_RESULT_FUNCTION_FAILED;
 }
 
-/*
- * msi_query_merge_record
- *
- * Merge a value_list and a record to create a second record.
- * Replace wildcard entries in the valuelist with values from the record
- */
-LibmsiRecord *msi_query_merge_record( unsigned fields, const column_info *vl, LibmsiRecord *rec )
+static LibmsiRecord *merge_record( unsigned fields, const column_info *vl, LibmsiRecord *rec,
+                                   unsigned *wildcard_count )
 {
     LibmsiRecord *merged;
-    unsigned wildcard_count = 1, i;
+    unsigned i;
 
     merged = libmsi_record_new( fields );
     for( i=1; i <= fields; i++ )
@@ -80,8 +76,8 @@ LibmsiRecord *msi_query_merge_record( unsigned fields, const column_info *vl, Li
         case EXPR_WILDCARD:
             if( !rec )
                 goto err;
-            _libmsi_record_copy_field( rec, wildcard_count, merged, i );
-            wildcard_count++;
+            _libmsi_record_copy_field( rec, *wildcard_count, merged, i );
+            (*wildcard_count)++;
             break;
         default:
             g_critical("Unknown expression type %d\n", vl->val->type);
@@ -95,6 +91,19 @@ err:
     return NULL;
 }
 
+/*
+ * msi_query_merge_record
+ *
+ * Merge a value_list and a record to create a second record.
+ * Replace wildcard entries in the valuelist with values from the record
+ */
+LibmsiRecord *msi_query_merge_record( unsigned fields, const column_info *vl, LibmsiRecord *rec )
+{
+    unsigned wildcard_count = 1;
+
+    return merge_record( fields, vl, rec, &wildcard_count );
+}
+
 /* checks to see if the column order specified in the INSERT query
  * matches the column order of the table
  */
@@ -195,12 +204,198 @@ static bool row_has_null_primary_keys(LibmsiInsertView *iv, LibmsiRecord *row)
     return false;
 }
 
+/* re-encodes an integer for a column of a different size */
+static bool convert_encoded_int( unsigned from, unsigned to, unsigned *val )
+{
+    int ival;
+
+    if (!*val)
+        return true;
+
+    if ((from & MSI_DATASIZEMASK) == 2)
+        ival = *val - 0x8000;
+    else
+        ival = *val ^ 0x80000000;
+
+    if ((to & MSI_DATASIZEMASK) != 2)
+        *val = ival ^ 0x80000000;
+    else if (ival >= -0x8000 && ival < 0x8000)
+        *val = ival + 0x8000;
+    else
+        return false;
+    return true;
+}
+
+static unsigned insert_records( LibmsiInsertView *iv, LibmsiRecord **values,
+                                unsigned *rows, unsigned count )
+{
+    unsigned r = LIBMSI_RESULT_SUCCESS, i;
+
+    /* several rows go in as one batch, so their keys are checked together */
+    if( count > 1 && iv->table->ops->insert_rows )
+        return iv->table->ops->insert_rows( iv->table, values, rows, count, iv->bIsTemp );
+
+    for( i = 0; i < count; i++ )
+    {
+        r = iv->table->ops->insert_row( iv->table, values[i], rows[i], iv->bIsTemp );
+        if( r != LIBMSI_RESULT_SUCCESS )
+            break;
+    }
+    return r;
+}
+
+/*
+ * Copies the rows of the source query into the table. When the table
+ * takes encoded rows, the values and string ids are moved across as they
+ * are. Otherwise each row goes through a record.
+ */
+static unsigned insert_view_copy_rows( LibmsiInsertView *iv, LibmsiRecord *record, unsigned col_count )
+{
+    LibmsiView *src = iv->source;
+    LibmsiRecord **records = NULL;
+    unsigned r, i, j, row_count = 0, table_cols = 0, type, src_type;
+    unsigned *map = NULL, *types = NULL, *values = NULL, *rows = NULL;
+    const char *a, *b;
+    bool direct;
+
+    r = src->ops->execute( src, record );
+    if( r != LIBMSI_RESULT_SUCCESS )
+        return r;
+
+    r = src->ops->get_dimensions( src, &row_count, NULL );
+    if( r != LIBMSI_RESULT_SUCCESS || !row_count )
+        goto done;
+
+    r = iv->table->ops->get_dimensions( iv->table, NULL, &table_cols );
+    if( r != LIBMSI_RESULT_SUCCESS )
+        goto done;
+
+    map = msi_alloc( col_count * sizeof(*map) );
+    types = msi_alloc( col_count * sizeof(*types) );
+    if( !map || !types )
+    {
+        r = LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+        goto done;
+    }
+
+    /* find the table column for each column of the insert */
+    direct = iv->table->ops->insert_encoded != NULL;
+    for( i = 0; i < col_count; i++ )
+    {
+        r = iv->sv->ops->get_column_info( iv->sv, i + 1, &a, NULL, NULL, NULL );
+        if( r != LIBMSI_RESULT_SUCCESS )
+            goto done;
+
+        for( j = 0; j < table_cols; j++ )
+        {
+            r = iv->table->ops->get_column_info( iv->table, j + 1, &b, &type, NULL, NULL );
+            if( r != LIBMSI_RESULT_SUCCESS )
+                goto done;
+            if( !strcmp( a, b ) )
+                break;
+        }
+        if( j == table_cols )
+        {
+            r = LIBMSI_RESULT_FUNCTION_FAILED;
+            goto done;
+        }
+
+        r = src->ops->get_column_info( src, i + 1, NULL, &src_type, NULL, NULL );
+        if( r != LIBMSI_RESULT_SUCCESS )
+            goto done;
+
+        map[i] = j;
+        types[i] = src_type;
+        if( MSITYPE_IS_BINARY(type) || MSITYPE_IS_BINARY(src_type) ||
+            (type & MSITYPE_STRING) != (src_type & MSITYPE_STRING) )
+            direct = false;
+    }
+
+    if( direct )
+    {
+        values = msi_alloc_zero( row_count * table_cols * sizeof(*values) );
+        if( !values )
+        {
+            r = LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+            goto done;
+        }
+
+        for( j = 0; j < col_count; j++ )
+        {
+            unsigned column[MSI_FETCH_ROWS], first, count;
+
+            iv->table->ops->get_column_info( iv->table, map[j] + 1, NULL, &type, NULL, NULL );
+            for( first = 0; first < row_count; first += count )
+            {
+                count = MIN( row_count - first, MSI_FETCH_ROWS );
+                r = msi_view_fetch_column_range( src, j + 1, first, count, column );
+                if( r != LIBMSI_RESULT_SUCCESS )
+                    goto done;
+
+                for( i = 0; i < count; i++ )
+                {
+                    unsigned *val = &values[(first + i) * table_cols + map[j]];
+
+                    *val = column[i];
+                    if( !(types[j] & MSITYPE_STRING) && !convert_encoded_int( types[j], type, val ) )
+                    {
+                        r = LIBMSI_RESULT_FUNCTION_FAILED;
+                        goto done;
+                    }
+                }
+            }
+        }
+
+        r = iv->table->ops->insert_encoded( iv->table, values, row_count, iv->bIsTemp );
+        goto done;
+    }
+
+    /* read every row before inserting any, the source may be the table itself */
+    records = msi_alloc_zero( row_count * sizeof(*records) );
+    rows = msi_alloc( row_count * sizeof(*rows) );
+    if( !records || !rows )
+    {
+        r = LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+        goto done;
+    }
+
+    for( i = 0; i < row_count; i++ )
+    {
+        r = msi_view_get_row( iv->db, src, i, &records[i] );
+        if( r != LIBMSI_RESULT_SUCCESS )
+            goto done;
+
+        r = msi_arrange_record( iv, &records[i] );
+        if( r != LIBMSI_RESULT_SUCCESS )
+            goto done;
+
+        /* rows with NULL primary keys are inserted at the beginning of the table */
+        rows[i] = row_has_null_primary_keys( iv, records[i] ) ? 0 : -1;
+    }
+
+    r = insert_records( iv, records, rows, row_count );
+
+done:
+    for( i = 0; records && i < row_count; i++ )
+        if( records[i] )
+            g_object_unref(records[i]);
+    msi_free( records );
+    msi_free( rows );
+    msi_free( values );
+    msi_free( types );
+    msi_free( map );
+    src->ops->close( src );
+    return r;
+}
+
 static unsigned insert_view_execute( LibmsiView *view, LibmsiRecord *record )
 {
     LibmsiInsertView *iv = (LibmsiInsertView*)view;
-    unsigned r, row = -1, col_count = 0;
+    unsigned r, i, count = 0, wildcard_count = 1, col_count = 0;
+    unsigned *rows = NULL;
+    const value_list *vl;
     LibmsiView *sv;
-    LibmsiRecord *values = NULL;
+    LibmsiRecord **values = NULL;
 
     TRACE("%p %p\n", iv, record );
 
@@ -215,29 +410,49 @@ static unsigned insert_view_execute( LibmsiView *view, LibmsiRecord *record )
 
     r = sv->ops->get_dimensions( sv, NULL, &col_count );
     if( r )
-        goto err;
+        return r;
 
-    /*
-     * Merge the wildcard values into the list of values provided
-     * in the query, and create a record containing both.
-     */
-    values = msi_query_merge_record( col_count, iv->vals, record );
-    if( !values )
-        goto err;
+    if( iv->source )
+        return insert_view_copy_rows( iv, record, col_count );
 
-    r = msi_arrange_record( iv, &values );
-    if( r != LIBMSI_RESULT_SUCCESS )
+    for( vl = iv->vals; vl; vl = vl->next )
+        count++;
+
+    values = msi_alloc_zero( count * sizeof(*values) );
+    rows = msi_alloc( count * sizeof(*rows) );
+    if( !values || !rows )
+    {
+        r = LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
         goto err;
+    }
+
+    for( i = 0, vl = iv->vals; vl; i++, vl = vl->next )
+    {
+        /*
+         * Merge the wildcard values into the list of values provided
+         * in the query, and create a record containing both.
+         */
+        r = LIBMSI_RESULT_FUNCTION_FAILED;
+        values[i] = merge_record( col_count, vl->vals, record, &wildcard_count );
+        if( !values[i] )
+            goto err;
 
-    /* rows with NULL primary keys are inserted at the beginning of the table */
-    if( row_has_null_primary_keys( iv, values ) )
-        row = 0;
+        r = msi_arrange_record( iv, &values[i] );
+        if( r != LIBMSI_RESULT_SUCCESS )
+            goto err;
+
+        /* rows with NULL primary keys are inserted at the beginning of the table */
+        rows[i] = row_has_null_primary_keys( iv, values[i] ) ? 0 : -1;
+    }
 
-    r = iv->table->ops->insert_row( iv->table, values, row, iv->bIsTemp );
+    r = insert_records( iv, values, rows, count );
 
 err:
-    if( values )
-        g_object_unref(values);
+    for( i = 0; values && i < count; i++ )
+        if( values[i] )
+            g_object_unref(values[i]);
+    msi_free( values );
+    msi_free( rows );
 
     return r;
 }
@@ -296,6 +511,8 @@ static unsigned insert_view_delete( LibmsiView *view )
     sv = iv->sv;
     if( sv )
         sv->ops->delete( sv );
+    if( iv->source )
+        iv->source->ops->delete( iv->source );
     g_object_unref(iv->db);
     msi_free( iv );
 
@@ -331,6 +548,12 @@ static const LibmsiViewOps insert_ops =
     NULL,
     NULL,
     NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
 };
 
 G_GNUC_PURE
@@ -342,8 +565,8 @@ static unsigned count_column_info( const column_info *ci )
     return n;
 }
 
-unsigned insert_view_create( LibmsiDatabase *db, LibmsiView **view, const char *table,
-                        column_info *columns, column_info *values, bool temp )
+static unsigned insert_view_init( LibmsiDatabase *db, LibmsiView **view, const char *table,
+                        column_info *columns, value_list *values, LibmsiView *source, bool temp )
 {
     LibmsiInsertView *iv = NULL;
     unsigned r;
@@ -351,10 +574,6 @@ unsigned insert_view_create( LibmsiDatabase *db, LibmsiView **view, const char *
 
     TRACE("%p\n", iv );
 
-    /* there should be one value for each column */
-    if ( count_column_info( columns ) != count_column_info(values) )
-        return LIBMSI_RESULT_BAD_QUERY_SYNTAX;
-
     r = table_view_create( db, table, &tv );
     if( r != LIBMSI_RESULT_SUCCESS )
         return r;
@@ -377,9 +596,38 @@ unsigned insert_view_create( LibmsiDatabase *db, LibmsiView **view, const char *
     iv->table = tv;
     iv->db = g_object_ref(db);
     iv->vals = values;
+    iv->source = source;
     iv->bIsTemp = temp;
     iv->sv = sv;
     *view = (LibmsiView*) iv;
 
     return LIBMSI_RESULT_SUCCESS;
 }
+
+unsigned insert_view_create( LibmsiDatabase *db, LibmsiView **view, const char *table,
+                        column_info *columns, value_list *values, bool temp )
+{
+    const value_list *vl;
+
+    /* there should be one value for each column, in every row */
+    for ( vl = values; vl; vl = vl->next )
+        if ( count_column_info( columns ) != count_column_info( vl->vals ) )
+            return LIBMSI_RESULT_BAD_QUERY_SYNTAX;
+
+    return insert_view_init( db, view, table, columns, values, NULL, temp );
+}
+
+unsigned insert_select_view_create( LibmsiDatabase *db, LibmsiView **view, const char *table,
+                        column_info *columns, LibmsiView *source, bool temp )
+{
+    unsigned r, cols;
+
+    /* the query should select one value for each column */
+    r = source->ops->get_dimensions( source, NULL, &cols );
+    if ( r != LIBMSI_RESULT_SUCCESS )
+        return r;
+    if ( count_column_info( columns ) != cols )
+        return LIBMSI_RESULT_BAD_QUERY_SYNTAX;
+
+    return insert_view_init( db, view, table, columns, NULL, source, temp );
+}
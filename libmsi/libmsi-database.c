@@ -18,6 +18,7 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
  */
 
+#include <errno.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -32,6 +33,10 @@
 #include "msipriv.h"
 #include "query.h"
 
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
 enum
 {
     PROP_0,
@@ -66,14 +71,12 @@ typedef struct _LibmsiTransform {
 } LibmsiTransform;
 
 typedef struct _LibmsiStorage {
-    struct list entry;
-    char *name;
+    LibmsiDirEntry dir;
     GsfInfile *stg;
 } LibmsiStorage;
 
 typedef struct _LibmsiStream {
-    struct list entry;
-    char *name;
+    LibmsiDirEntry dir;     /* the key is the decoded name */
     GsfInput *stm;
 } LibmsiStream;
 
@@ -94,8 +97,14 @@ libmsi_database_init (LibmsiDatabase *self)
 {
     list_init (&self->tables);
     list_init (&self->transforms);
-    list_init (&self->streams);
-    list_init (&self->storages);
+    self->streams.entries = g_ptr_array_new ();
+    self->streams.names = g_hash_table_new (g_str_hash, g_str_equal);
+    self->storages.entries = g_ptr_array_new ();
+    self->storages.names = g_hash_table_new (g_str_hash, g_str_equal);
+    self->names.decoded = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    self->names.streams = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, free);
+    self->names.tables = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, free);
+    list_init (&self->attached);
 }
 
 static void
@@ -122,9 +131,18 @@ libmsi_database_finalize (GObject *object)
 {
     LibmsiDatabase *self = LIBMSI_DATABASE (object);
 
+    /* while the strings they hold are still there */
+    _libmsi_database_free_attached (self);
     _libmsi_database_close (self, false);
     free_cached_tables (self);
     free_transforms (self);
+    g_ptr_array_free (self->streams.entries, TRUE);
+    g_hash_table_destroy (self->streams.names);
+    g_ptr_array_free (self->storages.entries, TRUE);
+    g_hash_table_destroy (self->storages.names);
+    g_hash_table_destroy (self->names.decoded);
+    g_hash_table_destroy (self->names.streams);
+    g_hash_table_destroy (self->names.tables);
 
     g_free (self->path);
 
@@ -203,24 +221,88 @@ libmsi_database_class_init (LibmsiDatabaseClass *klass)
                              G_PARAM_STATIC_STRINGS));
 }
 
+/* the directory keeps its entries in the order of the rows of the
+ * _Streams and _Storages views, and hashes them by the name they show */
+static void dir_add( LibmsiDatabase *db, LibmsiDirectory *dir, LibmsiDirEntry *entry )
+{
+    entry->index = dir->entries->len;
+    if (dir->interned)
+        entry->id = _libmsi_add_string( db->strings, entry->key, -1, 1, StringNonPersistent );
+    g_ptr_array_add( dir->entries, entry );
+    g_hash_table_insert( dir->names, (char *)entry->key, entry );
+}
+
+/* the views compare the names by string id, like the strings of a table,
+ * so they are added to the string table before a query reads them */
+static void dir_intern( LibmsiDatabase *db, LibmsiDirectory *dir )
+{
+    LibmsiDirEntry *entry;
+    unsigned i;
+
+    if (dir->interned || !db->strings)
+        return;
+
+    for (i = 0; i < dir->entries->len; i++)
+    {
+        entry = g_ptr_array_index( dir->entries, i );
+        entry->id = _libmsi_add_string( db->strings, entry->key, -1, 1, StringNonPersistent );
+    }
+    dir->interned = true;
+}
+
+static void dir_clear( LibmsiDirectory *dir )
+{
+    g_ptr_array_set_size( dir->entries, 0 );
+    g_hash_table_remove_all( dir->names );
+    dir->interned = false;
+}
+
+static void dir_remove( LibmsiDirectory *dir, LibmsiDirEntry *entry )
+{
+    unsigned i;
+
+    g_hash_table_remove( dir->names, entry->key );
+    g_ptr_array_remove_index( dir->entries, entry->index );
+    for (i = entry->index; i < dir->entries->len; i++)
+        ((LibmsiDirEntry *)g_ptr_array_index( dir->entries, i ))->index = i;
+}
+
+static void free_storage( LibmsiStorage *storage )
+{
+    if (storage->stg)
+        g_object_unref(G_OBJECT(storage->stg));
+    msi_free( storage->dir.name );
+    msi_free( storage );
+}
+
+static void free_stream( LibmsiStream *stream )
+{
+    g_object_unref(G_OBJECT(stream->stm));
+    msi_free( stream->dir.name );
+    msi_free( stream );
+}
+
+static LibmsiStorage *find_storage( LibmsiDatabase *db, const char *stname )
+{
+    return g_hash_table_lookup( db->storages.names, stname );
+}
+
 unsigned msi_open_storage( LibmsiDatabase *db, const char *stname )
 {
     unsigned r = LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
     LibmsiStorage *storage;
     GsfInput *in;
 
-    LIST_FOR_EACH_ENTRY( storage, &db->storages, LibmsiStorage, entry )
+    if (find_storage( db, stname ))
     {
-        if( !strcmp( stname, storage->name ) )
-        {
-            TRACE("found %s\n", debugstr_a(stname));
-            return r;
-        }
+        TRACE("found %s\n", debugstr_a(stname));
+        return r;
     }
 
     if (!(storage = msi_alloc_zero( sizeof(LibmsiStorage) ))) return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
-    storage->name = strdup( stname );
-    if (!storage->name)
+    storage->dir.name = strdup( stname );
+    storage->dir.key = storage->dir.name;
+    if (!storage->dir.name)
         goto done;
 
     in = gsf_infile_child_by_name(db->infile, stname);
@@ -231,12 +313,12 @@ unsigned msi_open_storage( LibmsiDatabase *db, const char *stname )
     if (!storage->stg)
         goto done;
 
-    list_add_tail( &db->storages, &storage->entry );
+    dir_add( db, &db->storages, &storage->dir );
     r = LIBMSI_RESULT_SUCCESS;
 
 done:
     if (r != LIBMSI_RESULT_SUCCESS) {
-        msi_free(storage->name);
+        msi_free(storage->dir.name);
         msi_free(storage);
     }
 
@@ -253,20 +335,18 @@ unsigned msi_create_storage( LibmsiDatabase *db, const char *stname, GsfInput *s
     if (db->flags & LIBMSI_DB_FLAGS_READONLY)
         return LIBMSI_RESULT_ACCESS_DENIED;
 
-    LIST_FOR_EACH_ENTRY( storage, &db->storages, LibmsiStorage, entry )
+    storage = find_storage( db, stname );
+    if (storage)
     {
-        if( !strcmp( stname, storage->name ) )
-        {
-            TRACE("found %s\n", debugstr_a(stname));
-            found = true;
-            break;
-        }
+        TRACE("found %s\n", debugstr_a(stname));
+        found = true;
     }
 
     if (!found) {
         if (!(storage = msi_alloc_zero( sizeof(LibmsiStorage) ))) return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
-        storage->name = strdup( stname );
-        if (!storage->name)
+        storage->dir.name = strdup( stname );
+        storage->dir.key = storage->dir.name;
+        if (!storage->dir.name)
         {
             msi_free(storage);
             return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
@@ -281,7 +361,7 @@ unsigned msi_create_storage( LibmsiDatabase *db, const char *stname, GsfInput *s
         if (storage->stg)
             g_object_unref(G_OBJECT(storage->stg));
     } else {
-        list_add_tail( &db->storages, &storage->entry );
+        dir_add( db, &db->storages, &storage->dir );
     }
 
     storage->stg = origstg;
@@ -292,7 +372,7 @@ unsigned msi_create_storage( LibmsiDatabase *db, const char *stname, GsfInput *s
 done:
     if (r != LIBMSI_RESULT_SUCCESS) {
         if (!found) {
-            msi_free(storage->name);
+            msi_free(storage->dir.name);
             msi_free(storage);
         }
     }
@@ -305,34 +385,74 @@ done:
 
 void msi_destroy_storage( LibmsiDatabase *db, const char *stname )
 {
-    LibmsiStorage *storage, *storage2;
+    LibmsiStorage *storage;
 
-    LIST_FOR_EACH_ENTRY_SAFE( storage, storage2, &db->storages, LibmsiStorage, entry )
+    storage = find_storage( db, stname );
+    if (storage)
     {
-        if (!strcmp( stname, storage->name ))
-        {
-            TRACE("destroying %s\n", debugstr_a(stname));
+        TRACE("destroying %s\n", debugstr_a(stname));
 
-            list_remove( &storage->entry );
-            g_object_unref(G_OBJECT(storage->stg));
-            msi_free( storage );
-            break;
-        }
+        dir_remove( &db->storages, &storage->dir );
+        free_storage( storage );
     }
 }
 
+void msi_db_intern_storages( LibmsiDatabase *db )
+{
+    dir_intern( db, &db->storages );
+}
+
+unsigned msi_db_storage_count( LibmsiDatabase *db )
+{
+    return db->storages.entries->len;
+}
+
+const char *msi_db_storage_name( LibmsiDatabase *db, unsigned row, unsigned *id )
+{
+    LibmsiStorage *storage;
+
+    if (row >= db->storages.entries->len)
+        return NULL;
+
+    storage = g_ptr_array_index( db->storages.entries, row );
+    if (id)
+        *id = storage->dir.id;
+    return storage->dir.key;
+}
+
+bool msi_db_find_storage( LibmsiDatabase *db, const char *stname, unsigned *row )
+{
+    LibmsiStorage *storage = find_storage( db, stname );
+
+    if (!storage)
+        return false;
+
+    *row = storage->dir.index;
+    return true;
+}
+
+/* streams are hashed by their decoded name */
+static LibmsiStream *find_stream( LibmsiDatabase *db, const char *stname )
+{
+    const char *decoded;
+
+    decoded = msi_db_decode_streamname( db, stname );
+    if (!decoded)
+        return NULL;
+
+    return g_hash_table_lookup( db->streams.names, decoded );
+}
+
 static unsigned find_infile_stream( LibmsiDatabase *db, const char *name, GsfInput **stm )
 {
     LibmsiStream *stream;
 
-    LIST_FOR_EACH_ENTRY( stream, &db->streams, LibmsiStream, entry )
+    stream = find_stream( db, name );
+    if (stream)
     {
-        if( !strcmp( name, stream->name ) )
-        {
-            TRACE("found %s\n", debugstr_a(name));
-            *stm = stream->stm;
-            return LIBMSI_RESULT_SUCCESS;
-        }
+        TRACE("found %s\n", debugstr_a(name));
+        *stm = stream->stm;
+        return LIBMSI_RESULT_SUCCESS;
     }
 
     return LIBMSI_RESULT_FUNCTION_FAILED;
@@ -343,11 +463,18 @@ static unsigned msi_alloc_stream( LibmsiDatabase *db, const char *stname, GsfInp
     LibmsiStream *stream;
 
     TRACE("%p %s %p", db, debugstr_a(stname), stm);
-    if (!(stream = msi_alloc( sizeof(LibmsiStream) ))) return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
-    stream->name = strdup( stname );
+    if (!(stream = msi_alloc_zero( sizeof(LibmsiStream) ))) return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+    stream->dir.name = strdup( stname );
+    stream->dir.key = msi_db_decode_streamname( db, stname );
+    if (!stream->dir.name || !stream->dir.key)
+    {
+        msi_free( stream->dir.name );
+        msi_free( stream );
+        return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+    }
     stream->stm = stm;
     g_object_ref(G_OBJECT(stm));
-    list_add_tail( &db->streams, &stream->entry );
+    dir_add( db, &db->streams, &stream->dir );
     return LIBMSI_RESULT_SUCCESS;
 }
 
@@ -357,19 +484,11 @@ unsigned write_raw_stream_data( LibmsiDatabase *db, const char *stname,
     unsigned ret = LIBMSI_RESULT_FUNCTION_FAILED;
     GsfInput *stm = NULL;
     guint8 *mem;
-    LibmsiStream *stream;
 
     if (db->flags & LIBMSI_DB_FLAGS_READONLY)
         return LIBMSI_RESULT_FUNCTION_FAILED;
 
-    LIST_FOR_EACH_ENTRY( stream, &db->streams, LibmsiStream, entry )
-    {
-        if( !strcmp( stname, stream->name ) )
-        {
-            msi_destroy_stream( db, stname );
-            break;
-        }
-    }
+    msi_destroy_stream( db, stname );
 
     mem = g_try_malloc(sz == 0 ? 1 : sz);
     if (!mem)
@@ -387,34 +506,26 @@ unsigned write_raw_stream_data( LibmsiDatabase *db, const char *stname,
 unsigned msi_create_stream( LibmsiDatabase *db, const char *stname, GsfInput *stm )
 {
     LibmsiStream *stream;
-    char *encname = NULL;
+    const char *encname;
     unsigned r = LIBMSI_RESULT_FUNCTION_FAILED;
-    bool found = false;
 
     if (db->flags & LIBMSI_DB_FLAGS_READONLY)
         return LIBMSI_RESULT_ACCESS_DENIED;
 
-    encname = encode_streamname(false, stname);
-
-    LIST_FOR_EACH_ENTRY( stream, &db->streams, LibmsiStream, entry )
-    {
-        if( !strcmp( encname, stream->name ) )
-        {
-            found = true;
-            break;
-        }
-    }
-
-    if (found) {
+    stream = g_hash_table_lookup( db->streams.names, stname );
+    if (stream) {
         if (stream->stm)
             g_object_unref(G_OBJECT(stream->stm));
         stream->stm = stm;
         g_object_ref(G_OBJECT(stream->stm));
         r = LIBMSI_RESULT_SUCCESS;
-    } else
+    } else {
+        encname = msi_db_encode_streamname( db, false, stname );
+        if (!encname)
+            return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
         r = msi_alloc_stream( db, encname, stm );
+    }
 
-    msi_free(encname);
     return r;
 }
 
@@ -422,16 +533,17 @@ unsigned msi_enum_db_streams(LibmsiDatabase *db,
                              unsigned (*fn)(const char *, GsfInput *, void *),
                              void *opaque)
 {
-    unsigned r;
-    LibmsiStream *stream, *stream2;
+    unsigned r, i;
+    LibmsiStream *stream;
 
-    LIST_FOR_EACH_ENTRY_SAFE( stream, stream2, &db->streams, LibmsiStream, entry )
+    for (i = 0; i < db->streams.entries->len; i++)
     {
         GsfInput *stm;
 
+        stream = g_ptr_array_index( db->streams.entries, i );
         stm = stream->stm;
         g_object_ref(G_OBJECT(stm));
-        r = fn( stream->name, stm, opaque);
+        r = fn( stream->dir.name, stm, opaque);
         g_object_unref(G_OBJECT(stm));
 
         if (r) {
@@ -446,16 +558,17 @@ unsigned msi_enum_db_storages(LibmsiDatabase *db,
                               unsigned (*fn)(const char *, GsfInfile *, void *),
                               void *opaque)
 {
-    unsigned r;
-    LibmsiStorage *storage, *storage2;
+    unsigned r, i;
+    LibmsiStorage *storage;
 
-    LIST_FOR_EACH_ENTRY_SAFE( storage, storage2, &db->storages, LibmsiStorage, entry )
+    for (i = 0; i < db->storages.entries->len; i++)
     {
         GsfInfile *stg;
 
+        storage = g_ptr_array_index( db->storages.entries, i );
         stg = storage->stg;
         g_object_ref(G_OBJECT(stg));
-        r = fn( storage->name, stg, opaque);
+        r = fn( storage->dir.name, stg, opaque);
         g_object_unref(G_OBJECT(stg));
 
         if (r) {
@@ -466,6 +579,42 @@ unsigned msi_enum_db_storages(LibmsiDatabase *db,
     return LIBMSI_RESULT_SUCCESS;
 }
 
+void msi_db_intern_streams( LibmsiDatabase *db )
+{
+    dir_intern( db, &db->streams );
+}
+
+unsigned msi_db_stream_count( LibmsiDatabase *db )
+{
+    return db->streams.entries->len;
+}
+
+const char *msi_db_stream_name( LibmsiDatabase *db, unsigned row, unsigned *id, GsfInput **stm )
+{
+    LibmsiStream *stream;
+
+    if (row >= db->streams.entries->len)
+        return NULL;
+
+    stream = g_ptr_array_index( db->streams.entries, row );
+    if (id)
+        *id = stream->dir.id;
+    if (stm)
+        *stm = stream->stm;
+    return stream->dir.key;
+}
+
+bool msi_db_find_stream( LibmsiDatabase *db, const char *stname, unsigned *row )
+{
+    LibmsiStream *stream = g_hash_table_lookup( db->streams.names, stname );
+
+    if (!stream)
+        return false;
+
+    *row = stream->dir.index;
+    return true;
+}
+
 static
 unsigned clone_infile_stream( LibmsiDatabase *db, const char *name, GsfInput **stm )
 {
@@ -491,11 +640,9 @@ unsigned clone_infile_stream( LibmsiDatabase *db, const char *name, GsfInput **s
 unsigned msi_get_raw_stream( LibmsiDatabase *db, const char *stname, GsfInput **stm )
 {
     unsigned ret = LIBMSI_RESULT_FUNCTION_FAILED;
-    g_autofree char *decoded = NULL;
     LibmsiTransform *transform;
 
-    decoded = decode_streamname(stname);
-    TRACE("%s -> %s\n", debugstr_a(stname), debugstr_a(decoded));
+    TRACE("%s\n", debugstr_a(stname));
 
     if (clone_infile_stream( db, stname, stm ) == LIBMSI_RESULT_SUCCESS)
         return LIBMSI_RESULT_SUCCESS;
@@ -513,46 +660,49 @@ unsigned msi_get_raw_stream( LibmsiDatabase *db, const char *stname, GsfInput **
     return ret;
 }
 
+/* takes a reference to the stream as it is now, without opening a copy */
+unsigned msi_peek_raw_stream( LibmsiDatabase *db, const char *stname, GsfInput **stm )
+{
+    GsfInput *stream;
+
+    if (find_infile_stream( db, stname, &stream ) != LIBMSI_RESULT_SUCCESS)
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    g_object_ref(G_OBJECT(stream));
+    *stm = stream;
+    return LIBMSI_RESULT_SUCCESS;
+}
+
 void msi_destroy_stream( LibmsiDatabase *db, const char *stname )
 {
-    LibmsiStream *stream, *stream2;
+    LibmsiStream *stream;
 
-    LIST_FOR_EACH_ENTRY_SAFE( stream, stream2, &db->streams, LibmsiStream, entry )
+    stream = find_stream( db, stname );
+    if (stream)
     {
-        if (!strcmp( stname, stream->name ))
-        {
-            TRACE("destroying %s\n", debugstr_a(stname));
+        TRACE("destroying %s\n", debugstr_a(stname));
 
-            list_remove( &stream->entry );
-            g_object_unref(G_OBJECT(stream->stm));
-            msi_free( stream );
-            break;
-        }
+        dir_remove( &db->streams, &stream->dir );
+        free_stream( stream );
     }
 }
 
 static void free_storages( LibmsiDatabase *db )
 {
-    while( !list_empty( &db->storages ) )
-    {
-        LibmsiStorage *s = LIST_ENTRY(list_head( &db->storages ), LibmsiStorage, entry);
-        list_remove( &s->entry );
-        g_object_unref(G_OBJECT(s->stg));
-        msi_free( s->name );
-        msi_free( s );
-    }
+    unsigned i;
+
+    for (i = 0; i < db->storages.entries->len; i++)
+        free_storage( g_ptr_array_index( db->storages.entries, i ) );
+    dir_clear( &db->storages );
 }
 
 static void free_streams( LibmsiDatabase *db )
 {
-    while( !list_empty( &db->streams ) )
-    {
-        LibmsiStream *s = LIST_ENTRY(list_head( &db->streams ), LibmsiStream, entry);
-        list_remove( &s->entry );
-        g_object_unref(G_OBJECT(s->stm));
-        msi_free( s->name );
-        msi_free( s );
-    }
+    unsigned i;
+
+    for (i = 0; i < db->streams.entries->len; i++)
+        free_stream( g_ptr_array_index( db->streams.entries, i ) );
+    dir_clear( &db->streams );
 }
 
 void append_storage_to_db( LibmsiDatabase *db, GsfInfile *stg )
@@ -761,6 +911,88 @@ static void msi_parse_line(char **line, char ***entries, unsigned *num_entries,
         *num_entries = count;
 }
 
+/*
+ * Splits the records following the header lines into fields, in place.
+ * The fields of all records go into one array, num_columns per record;
+ * missing fields are empty and extra ones are dropped.
+ */
+static unsigned msi_parse_records(char *ptr, unsigned len, unsigned num_columns,
+                                  char ***fields, unsigned *num_records)
+{
+    char *end = ptr + len;
+    char **array = NULL, **temp;
+    unsigned count = 0, size = 0;
+
+    *fields = NULL;
+    *num_records = 0;
+
+    if (!num_columns)
+        return LIBMSI_RESULT_SUCCESS;
+
+    while (ptr < end)
+    {
+        char *eol, *next, *p;
+        unsigned i;
+
+        eol = memchr(ptr, '\n', end - ptr);
+        if (!eol) eol = end;
+        next = eol + 1;
+        while (eol > ptr && eol[-1] == '\r') eol--;
+
+        if (eol == ptr)
+        {
+            ptr = next;
+            continue;
+        }
+
+        if (count == size)
+        {
+            size = size ? size * 2 : 64;
+            temp = msi_realloc(array, size * num_columns * sizeof(char *));
+            if (!temp)
+            {
+                msi_free(array);
+                return LIBMSI_RESULT_OUTOFMEMORY;
+            }
+            array = temp;
+        }
+
+        for (i = 0; i < num_columns; i++)
+        {
+            char **field = &array[count * num_columns + i];
+
+            while (ptr < eol && *ptr == '\r') ptr++;
+            if (ptr == eol)
+            {
+                *field = (char *)szEmpty;
+                continue;
+            }
+
+            *field = ptr;
+            p = memchr(ptr, '\t', eol - ptr);
+            if (!p) p = eol;
+            for (; ptr < p; ptr++)
+            {
+                if (!*ptr) *ptr = '\n'; /* convert embedded nulls to \n */
+                if (ptr > *field && *ptr == '\x19' && ptr[-1] == '\x11')
+                {
+                    *ptr = '\n';
+                    ptr[-1] = '\r';
+                }
+            }
+            if (ptr < eol) ptr++;
+            *p = 0;
+        }
+
+        count++;
+        ptr = next;
+    }
+
+    *fields = array;
+    *num_records = count;
+    return LIBMSI_RESULT_SUCCESS;
+}
+
 static char *msi_build_createsql_prelude(char *table)
 {
     char *prelude;
@@ -1002,6 +1234,40 @@ static unsigned construct_record(unsigned num_columns, char **types,
     return LIBMSI_RESULT_SUCCESS;
 }
 
+/* checks that the file's columns can be loaded into the table as plain text */
+static bool msi_can_load_text_rows(LibmsiView *view, char **types,
+                                   unsigned num_columns, unsigned num_cols)
+{
+    unsigned i, type;
+
+    if (num_columns != num_cols)
+        return false;
+
+    for (i = 0; i < num_columns; i++)
+    {
+        bool string;
+
+        switch (types[i][0])
+        {
+            case 'L': case 'l': case 'S': case 's':
+                string = true;
+                break;
+            case 'I': case 'i':
+                string = false;
+                break;
+            default:
+                return false;
+        }
+
+        if (view->ops->get_column_info( view, i + 1, NULL, &type, NULL, NULL ))
+            return false;
+        if (MSITYPE_IS_BINARY(type) || string != !!(type & MSITYPE_STRING))
+            return false;
+    }
+
+    return true;
+}
+
 static unsigned msi_add_records_to_table(LibmsiDatabase *db, char **columns, char **types,
                                      char **labels, char ***records,
                                      int num_columns, int num_records)
@@ -1017,7 +1283,7 @@ static unsigned msi_add_records_to_table(LibmsiDatabase *db, char **columns, cha
 
     r = view->ops->get_dimensions( view, &num_rows, &num_cols );
     if (r != LIBMSI_RESULT_SUCCESS)
-        return r;
+        goto done;
 
     while (num_rows > 0)
     {
@@ -1026,6 +1292,13 @@ static unsigned msi_add_records_to_table(LibmsiDatabase *db, char **columns, cha
             goto done;
     }
 
+    /* the records are laid out contiguously, see msi_parse_records */
+    if (num_records && msi_can_load_text_rows(view, types, num_columns, num_cols))
+    {
+        r = msi_table_load_text_rows(view, records[0], num_records);
+        goto done;
+    }
+
     for (i = 0; i < num_records; i++)
     {
         r = construct_record(num_columns, types, records[i], labels[0], &rec);
@@ -1047,106 +1320,198 @@ done:
     return r;
 }
 
-static unsigned _libmsi_database_import(LibmsiDatabase *db, const char *path)
+typedef struct
 {
-    unsigned r = LIBMSI_RESULT_OUTOFMEMORY;
-    unsigned len, i;
-    unsigned num_labels = 0;
-    unsigned num_types = 0;
-    unsigned num_columns = 0;
-    unsigned num_records = 0;
-    char **columns = NULL;
-    char **types = NULL;
-    char **labels = NULL;
+    const char *path;
+    char *data;
+    char **columns;
+    char **types;
+    char **labels;
+    char **fields;
+    char ***records;
+    unsigned num_columns;
+    unsigned num_types;
+    unsigned num_labels;
+    unsigned num_records;
+    unsigned r;
+} LibmsiImport;
+
+static const char suminfo[] = "_SummaryInformation";
+static const char forcecodepage[] = "_ForceCodepage";
+
+static bool msi_import_is_codepage(const LibmsiImport *imp)
+{
+    return imp->num_columns == 1 && !imp->columns[0][0] &&
+           imp->num_labels == 1 && !imp->labels[0][0] &&
+           imp->num_types == 2 && !strcmp( imp->types[1], forcecodepage );
+}
+
+/* reads and splits a table file; this does not touch the database */
+static unsigned msi_read_import(LibmsiImport *imp)
+{
+    unsigned len, i, r;
     char *ptr;
-    char *data = NULL;
-    char ***records = NULL;
-    char ***temp_records;
 
-    static const char suminfo[] = "_SummaryInformation";
-    static const char forcecodepage[] = "_ForceCodepage";
+    TRACE("%s\n", debugstr_a(imp->path));
 
-    TRACE("%p %s\n", db, debugstr_a(path));
+    imp->data = msi_read_text_archive( imp->path, &len );
+    if (!imp->data)
+        return LIBMSI_RESULT_OUTOFMEMORY;
 
-    data = msi_read_text_archive( path, &len );
-    if (!data)
-        goto done;
+    ptr = imp->data;
+    msi_parse_line( &ptr, &imp->columns, &imp->num_columns, &len );
+    msi_parse_line( &ptr, &imp->types, &imp->num_types, &len );
+    msi_parse_line( &ptr, &imp->labels, &imp->num_labels, &len );
+
+    if (msi_import_is_codepage( imp ))
+        return LIBMSI_RESULT_SUCCESS;
 
-    ptr = data;
-    msi_parse_line( &ptr, &columns, &num_columns, &len );
-    msi_parse_line( &ptr, &types, &num_types, &len );
-    msi_parse_line( &ptr, &labels, &num_labels, &len );
+    if (imp->num_columns != imp->num_types)
+        return LIBMSI_RESULT_FUNCTION_FAILED;
 
-    if (num_columns == 1 && !columns[0][0] && num_labels == 1 && !labels[0][0] &&
-        num_types == 2 && !strcmp( types[1], forcecodepage ))
+    /* read in the table records */
+    r = msi_parse_records( ptr, len, imp->num_columns, &imp->fields, &imp->num_records );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
+
+    imp->records = msi_alloc((imp->num_records + 1) * sizeof(char **));
+    if (!imp->records)
+        return LIBMSI_RESULT_OUTOFMEMORY;
+    for (i = 0; i < imp->num_records; i++)
+        imp->records[i] = imp->fields + i * imp->num_columns;
+
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+static unsigned msi_apply_import(LibmsiDatabase *db, LibmsiImport *imp)
+{
+    unsigned r;
+
+    if (msi_import_is_codepage( imp ))
+        return msi_set_string_table_codepage( db->strings, atoi( imp->types[0] ) );
+
+    if (!strcmp(imp->labels[0], suminfo))
     {
-        r = msi_set_string_table_codepage( db->strings, atoi( types[0] ) );
-        goto done;
+        r = msi_add_suminfo( db, imp->records, imp->num_records, imp->num_columns );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            return LIBMSI_RESULT_FUNCTION_FAILED;
+        return r;
     }
 
-    if (num_columns != num_types)
+    if (!table_view_exists(db, imp->labels[0]))
     {
-        r = LIBMSI_RESULT_FUNCTION_FAILED;
-        goto done;
+        r = msi_add_table_to_db( db, imp->columns, imp->types, imp->labels,
+                                 imp->num_labels, imp->num_columns );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            return LIBMSI_RESULT_FUNCTION_FAILED;
     }
 
-    records = msi_alloc(sizeof(char **));
-    if (!records)
-    {
-        r = LIBMSI_RESULT_OUTOFMEMORY;
+    return msi_add_records_to_table( db, imp->columns, imp->types, imp->labels,
+                                     imp->records, imp->num_columns, imp->num_records );
+}
+
+static void msi_free_import(LibmsiImport *imp)
+{
+    msi_free(imp->data);
+    msi_free(imp->columns);
+    msi_free(imp->types);
+    msi_free(imp->labels);
+    msi_free(imp->fields);
+    msi_free(imp->records);
+}
+
+static unsigned _libmsi_database_import(LibmsiDatabase *db, const char *path)
+{
+    LibmsiImport imp = { path };
+    unsigned r;
+
+    TRACE("%p %s\n", db, debugstr_a(path));
+
+    r = msi_read_import( &imp );
+    if (r == LIBMSI_RESULT_SUCCESS)
+        r = msi_apply_import( db, &imp );
+
+    msi_free_import( &imp );
+    return r;
+}
+
+static void read_import_job( gpointer data, gpointer user_data )
+{
+    LibmsiImport *imp = data;
+
+    imp->r = msi_read_import( imp );
+}
+
+/* the codepage applies to every string, so it is set first; the summary
+ * information does not depend on the tables and goes last */
+static int msi_import_rank(const LibmsiImport *imp)
+{
+    if (msi_import_is_codepage( imp ))
+        return 0;
+    if (!strcmp( imp->labels[0], suminfo ))
+        return 2;
+    return 1;
+}
+
+static unsigned _libmsi_database_import_many(LibmsiDatabase *db, const char **paths,
+                                             unsigned count)
+{
+    LibmsiImport *imps;
+    gpointer *jobs;
+    unsigned i, r = LIBMSI_RESULT_OUTOFMEMORY;
+    int rank;
+
+    TRACE("%p %u\n", db, count);
+
+    imps = msi_alloc_zero( count * sizeof(*imps) );
+    jobs = msi_alloc( count * sizeof(*jobs) );
+    if (!imps || !jobs)
         goto done;
-    }
 
-    /* read in the table records */
-    while (len)
+    for (i = 0; i < count; i++)
     {
-        msi_parse_line( &ptr, &records[num_records], NULL, &len );
-
-        num_records++;
-        temp_records = msi_realloc(records, (num_records + 1) * sizeof(char **));
-        if (!temp_records)
-        {
-            r = LIBMSI_RESULT_OUTOFMEMORY;
-            goto done;
-        }
-        records = temp_records;
+        imps[i].path = paths[i];
+        jobs[i] = &imps[i];
     }
 
-    if (!strcmp(labels[0], suminfo))
+    /* the files are parsed in parallel, and nothing is imported unless
+     * they all could be */
+    msi_run_jobs( read_import_job, jobs, count );
+    for (i = 0; i < count; i++)
     {
-        r = msi_add_suminfo( db, records, num_records, num_columns );
+        r = imps[i].r;
         if (r != LIBMSI_RESULT_SUCCESS)
         {
-            r = LIBMSI_RESULT_FUNCTION_FAILED;
+            TRACE("failed to read %s\n", debugstr_a(paths[i]));
             goto done;
         }
     }
-    else
+
+    r = LIBMSI_RESULT_SUCCESS;
+    for (rank = 0; rank < 3 && r == LIBMSI_RESULT_SUCCESS; rank++)
     {
-        if (!table_view_exists(db, labels[0]))
+        for (i = 0; i < count; i++)
         {
-            r = msi_add_table_to_db( db, columns, types, labels, num_labels, num_columns );
+            if (msi_import_rank( &imps[i] ) != rank)
+                continue;
+
+            r = msi_apply_import( db, &imps[i] );
             if (r != LIBMSI_RESULT_SUCCESS)
             {
-                r = LIBMSI_RESULT_FUNCTION_FAILED;
-                goto done;
+                TRACE("failed to import %s\n", debugstr_a(paths[i]));
+                break;
             }
         }
-
-        r = msi_add_records_to_table( db, columns, types, labels, records, num_columns, num_records);
     }
 
 done:
-    msi_free(data);
-    msi_free(columns);
-    msi_free(types);
-    msi_free(labels);
-
-    for (i = 0; i < num_records; i++)
-        msi_free(records[i]);
-
-    msi_free(records);
-
+    if (imps)
+    {
+        for (i = 0; i < count; i++)
+            msi_free_import( &imps[i] );
+    }
+    msi_free( jobs );
+    msi_free( imps );
     return r;
 }
 
@@ -1183,9 +1548,102 @@ libmsi_database_import (LibmsiDatabase *db,
     return r == LIBMSI_RESULT_SUCCESS;
 }
 
+/**
+ * libmsi_database_import_many:
+ * @db: a %LibmsiDatabase
+ * @paths: (array length=count): paths to table files
+ * @count: the number of files in @paths
+ * @error: (allow-none): #GError to set on error, or %NULL
+ *
+ * Import several tables to the database, as libmsi_database_import() does
+ * for each file.  The files are read in parallel, and nothing is imported
+ * if any of them cannot be read.  A _ForceCodepage file is applied first
+ * and the summary information last, whatever their place in @paths.
+ *
+ * Returns: %TRUE on success
+ **/
+gboolean
+libmsi_database_import_many (LibmsiDatabase *db,
+                             const char **paths,
+                             unsigned count,
+                             GError **error)
+{
+    unsigned r;
+
+    TRACE("%p %u\n", db, count);
+
+    g_return_val_if_fail (LIBMSI_IS_DATABASE (db), FALSE);
+    g_return_val_if_fail (paths || !count, FALSE);
+    g_return_val_if_fail (!error || *error == NULL, FALSE);
+
+    g_object_ref(db);
+    r = _libmsi_database_import_many(db, paths, count);
+    g_object_unref(db);
+
+    if (r != LIBMSI_RESULT_SUCCESS)
+        g_set_error (error, LIBMSI_RESULT_ERROR, r, G_STRFUNC);
+
+    return r == LIBMSI_RESULT_SUCCESS;
+}
+
+#define EXPORT_BUFFER_SIZE (64*1024)
+
+/* output of a table export; the text is written out in large blocks */
+typedef struct _LibmsiExport {
+    int fd;
+    GString *buf;
+    GFile *table_dir;
+    bool table_dir_made;
+    GMutex *lock;           /* serializes stream reads of parallel exports */
+    GError **error;
+} LibmsiExport;
+
+static void msi_export_init (LibmsiExport *export, int fd, GFile *table_dir,
+                             GError **error)
+{
+    export->fd = fd;
+    export->buf = g_string_sized_new (EXPORT_BUFFER_SIZE);
+    export->table_dir = table_dir;
+    export->table_dir_made = false;
+    export->lock = NULL;
+    export->error = error;
+}
+
+static bool msi_export_flush (LibmsiExport *export)
+{
+    const char *data = export->buf->str;
+    gsize len = export->buf->len;
+
+    while (len) {
+        gssize n = write (export->fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+
+    g_string_truncate (export->buf, 0);
+    return true;
+}
+
+static void msi_export_free (LibmsiExport *export)
+{
+    g_string_free (export->buf, TRUE);
+}
+
+static bool msi_export_write (LibmsiExport *export, const char *data, gsize len)
+{
+    g_string_append_len (export->buf, data, len);
+    if (export->buf->len >= EXPORT_BUFFER_SIZE)
+        return msi_export_flush (export);
+    return true;
+}
+
 static gboolean
-msi_export_stream (GsfInput *gsfin, GFile *table_dir, gchar **str,
-                   GError **error)
+msi_export_stream (LibmsiExport *export, GsfInput *gsfin, gchar **str)
 {
     GError *err = NULL;
     GFile *file = NULL;
@@ -1193,18 +1651,22 @@ msi_export_stream (GsfInput *gsfin, GFile *table_dir, gchar **str,
     GOutputStream *out = NULL;
     gssize spliced = -1;
 
-    if (!table_dir)
+    if (!export->table_dir)
         goto end;
 
-    if (!g_file_make_directory_with_parents (table_dir, NULL, &err) &&
-        !g_error_matches (err, G_IO_ERROR, G_IO_ERROR_EXISTS)) {
-        g_propagate_error (error, err);
-        goto end;
+    if (!export->table_dir_made) {
+        if (!g_file_make_directory_with_parents (export->table_dir, NULL, &err) &&
+            !g_error_matches (err, G_IO_ERROR, G_IO_ERROR_EXISTS)) {
+            g_propagate_error (export->error, err);
+            err = NULL;
+            goto end;
+        }
+        export->table_dir_made = true;
     }
 
     *str = g_strdup (g_object_get_data (G_OBJECT (gsfin), "stname"));
-    file = g_file_get_child (table_dir, *str);
-    out = G_OUTPUT_STREAM (g_file_replace (file, NULL, FALSE, 0, NULL, error));
+    file = g_file_get_child (export->table_dir, *str);
+    out = G_OUTPUT_STREAM (g_file_replace (file, NULL, FALSE, 0, NULL, export->error));
     in = G_INPUT_STREAM (libmsi_istream_new (gsfin));
     spliced = g_output_stream_splice (out, in, 0, NULL, NULL);
 
@@ -1220,32 +1682,35 @@ end:
     return spliced != -1;
 
 }
-static unsigned msi_export_record(int fd, LibmsiRecord *row,
-                                  unsigned start, GFile *table_dir,
-                                  GError **error)
+static unsigned msi_export_record(LibmsiExport *export, LibmsiRecord *row,
+                                  unsigned start)
 {
     GsfInput *in = NULL;
     unsigned i, count;
     unsigned success = LIBMSI_RESULT_FUNCTION_FAILED;
+    bool ok;
 
     count = libmsi_record_get_field_count (row);
     for (i = start; i <= count; i++) {
-        char *str;
-
-        _libmsi_record_get_gsf_input (row, i, &in);
-        if (in) {
-            if (!msi_export_stream (in, table_dir, &str, error))
-                goto end;
-            g_object_unref (in);
+        char *str = NULL;
+
+        if (_libmsi_record_is_stream (row, i)) {
+            /* the stream is read from the database storage */
+            if (export->lock)
+                g_mutex_lock (export->lock);
+            ok = _libmsi_record_get_gsf_input (row, i, &in) == LIBMSI_RESULT_SUCCESS &&
+                 msi_export_stream (export, in, &str);
+            if (in)
+                g_object_unref (in);
             in = NULL;
+            if (export->lock)
+                g_mutex_unlock (export->lock);
         } else {
             str = libmsi_record_get_string (row, i);
-            if (!str)
-                goto end;
+            ok = str != NULL;
         }
 
-        /* TODO full_write */
-        if (write (fd, str, strlen (str)) != strlen (str)) {
+        if (!ok || !msi_export_write (export, str, strlen (str))) {
             g_free (str);
             goto end;
         }
@@ -1253,184 +1718,492 @@ static unsigned msi_export_record(int fd, LibmsiRecord *row,
         g_free (str);
 
         const char *sep = (i < count) ? "\t" : "\r\n";
-        if (write (fd, sep, strlen (sep)) != strlen (sep))
+        if (!msi_export_write (export, sep, strlen (sep)))
             goto end;
     }
 
     success = LIBMSI_RESULT_SUCCESS;
 
 end:
-    if (in)
-        g_object_unref (in);
-
     return success;
 }
 
-typedef struct _ExportRow {
-    int fd;
-    GFile *table_dir;
-    GError **error;
-} ExportRow;
+static unsigned msi_export_row( LibmsiRecord *row, void *arg )
+{
+    return msi_export_record (arg, row, 1);
+}
+
+static LibmsiResult msi_export_forcecodepage( LibmsiExport *export, unsigned codepage )
+{
+    static const char fmt[] = "\r\n\r\n%u\t_ForceCodepage\r\n";
+    char data[sizeof(fmt) + 10];
+    unsigned sz;
+
+    sprintf( data, fmt, codepage );
+
+    sz = strlen(data) + 1;
+    if (!msi_export_write( export, data, sz ))
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+static LibmsiResult msi_export_summaryinfo (LibmsiDatabase *db, LibmsiExport *export)
+{
+    static const char header[] =
+        "PropertyId\tValue\r\ni2\tl255\r\n_SummaryInformation\tPropertyId\r\n";
+    LibmsiResult result = LIBMSI_RESULT_FUNCTION_FAILED;
+    LibmsiSummaryInfo *si = libmsi_summary_info_new (db, 0, export->error);
+    gchar *str = NULL;
+    gssize sz;
+    int i;
+
+    if (!si)
+        goto end;
+
+    sz = strlen (header);
+    if (!msi_export_write (export, header, sz))
+        goto end;
+
+    for (i = 0; i < MSI_MAX_PROPS; i++)
+        if (si->property[i].vt != OLEVT_EMPTY) {
+            gchar *val = summary_info_as_string (si, i);
+            if (!val)
+                goto end;
+            str = g_strdup_printf ("%d\t%s\r\n", i, val);
+            sz = strlen (str);
+            if (!msi_export_write (export, str, sz))
+                goto end;
+            g_free (str);
+            str = NULL;
+        }
+
+    result = LIBMSI_RESULT_SUCCESS;
+
+end:
+    g_free (str);
+    if (si)
+        g_object_unref (si);
+    return result;
+}
+
+/* the column names, the column types, and the table name with its keys */
+static void msi_export_get_header(LibmsiDatabase *db, LibmsiQuery *view,
+                                  const char *table, LibmsiRecord *header[3])
+{
+    if (_libmsi_query_get_column_info(view, LIBMSI_COL_INFO_NAMES, &header[0]))
+        header[0] = NULL;
+    if (_libmsi_query_get_column_info(view, LIBMSI_COL_INFO_TYPES, &header[1]))
+        header[1] = NULL;
+    if (_libmsi_database_get_primary_keys( db, table, &header[2] ))
+        header[2] = NULL;
+    else
+        libmsi_record_set_string( header[2], 0, table );
+}
+
+static void msi_export_header(LibmsiExport *export, LibmsiRecord *header[3])
+{
+    unsigned i;
+
+    for (i = 0; i < 3; i++)
+    {
+        if (header[i])
+            msi_export_record( export, header[i], i == 2 ? 0 : 1 );
+    }
+}
+
+static void msi_free_header(LibmsiRecord *header[3])
+{
+    unsigned i;
+
+    for (i = 0; i < 3; i++)
+    {
+        if (header[i])
+            g_object_unref(header[i]);
+    }
+}
+
+static LibmsiResult _libmsi_database_export(LibmsiDatabase *db, const char *table,
+                                        LibmsiExport *export)
+{
+    static const char query[] = "select * from %s";
+    LibmsiRecord *header[3];
+    LibmsiQuery *view = NULL;
+    LibmsiResult r;
+
+    TRACE("%p %s\n", db, debugstr_a(table) );
+
+    if (!strcmp(table, "_ForceCodepage")) {
+        unsigned codepage = msi_get_string_table_codepage (db->strings);
+        return msi_export_forcecodepage (export, codepage);
+    } else if (!strcmp (table, "_SummaryInformation")) {
+        return msi_export_summaryinfo (db, export);
+    }
+
+    r = _libmsi_query_open( db, &view, query, table );
+    if (r == LIBMSI_RESULT_SUCCESS)
+    {
+        /* write out rows 1 to 3 */
+        msi_export_get_header( db, view, table, header );
+        msi_export_header( export, header );
+        msi_free_header( header );
+
+        /* write out row 4 onwards, the data */
+        r = _libmsi_query_iterate_records( view, 0, msi_export_row, export );
+
+        g_object_unref (view);
+    }
+
+    return r;
+}
+
+/**
+ * libmsi_database_export:
+ * @db: a %LibmsiDatabase
+ * @table: a table name
+ * @fd: a file descriptor
+ * @error: (allow-none): #GError to set on error, or %NULL
+ *
+ * Writes a file containing the table data as tab separated ASCII.
+ * The format is as follows:
+ *
+ * row1 : colname1 <tab> colname2 <tab> .... colnameN <cr> <lf>
+ * row2 : coltype1 <tab> coltype2 <tab> .... coltypeN <cr> <lf>
+ * row3 : tablename <tab> key1 <tab> key2 <tab> ... keyM <cr> <lf>
+ *
+ * Followed by the data, starting at row 1 with one row per line
+ *
+ * row4 : data <tab> data <tab> data <tab> ... data <cr> <lf>
+ *
+ * Returns: %TRUE on success
+ **/
+gboolean
+libmsi_database_export (LibmsiDatabase *db,
+                        const char *table,
+                        int fd,
+                        GError **error)
+{
+    unsigned r = LIBMSI_RESULT_OUTOFMEMORY;
+    LibmsiExport export;
+
+    TRACE("%p %s %d\n", db, table, fd);
+
+    g_return_val_if_fail (LIBMSI_IS_DATABASE (db), FALSE);
+    g_return_val_if_fail (table, FALSE);
+    g_return_val_if_fail (fd >= 0, FALSE);
+    g_return_val_if_fail (!error || *error == NULL, FALSE);
+
+    msi_export_init (&export, fd, g_file_new_for_path (table), error);
+
+    g_object_ref(db);
+    r = _libmsi_database_export (db, table, &export);
+    g_object_unref(db);
+
+    if (!msi_export_flush (&export) && r == LIBMSI_RESULT_SUCCESS)
+        r = LIBMSI_RESULT_FUNCTION_FAILED;
+
+    msi_export_free (&export);
+    g_object_unref (export.table_dir);
+
+    if (r != LIBMSI_RESULT_SUCCESS && error && !*error)
+        g_set_error (error, LIBMSI_RESULT_ERROR, r, G_STRFUNC);
+
+    return r == LIBMSI_RESULT_SUCCESS;
+}
+
+/* tables fetched but not written yet, per thread writing them */
+#define EXPORT_WINDOW 2
+
+typedef struct
+{
+    GMutex lock;        /* held to read the database, rows or streams */
+    GMutex pending_lock;
+    GCond written;
+    unsigned pending;   /* tables fetched and not written yet */
+    bool failed;
+} LibmsiExportQueue;
+
+typedef struct
+{
+    LibmsiDatabase *db;
+    const char *dir;
+    char *table;
+    LibmsiRecord *header[3];
+    GPtrArray *rows;
+    GMutex *lock;
+    LibmsiExportQueue *queue;
+    GError *error;
+    unsigned r;
+} LibmsiExportTable;
+
+static void free_export_table( LibmsiExportTable *t )
+{
+    msi_free_header( t->header );
+    if (t->rows)
+        g_ptr_array_unref( t->rows );
+    g_clear_error( &t->error );
+    g_free( t->table );
+}
+
+static unsigned msi_write_export_file( LibmsiExportTable *t )
+{
+    LibmsiExport export;
+    char *name, *path;
+    unsigned i, r;
+    int fd;
+
+    name = g_strconcat( t->table, ".idt", NULL );
+    path = g_build_filename( t->dir, name, NULL );
+    fd = open( path, O_WRONLY | O_BINARY | O_CREAT | O_TRUNC, 0644 );
+    g_free( path );
+    g_free( name );
+    if (fd < 0)
+        return LIBMSI_RESULT_OPEN_FAILED;
+
+    path = g_build_filename( t->dir, t->table, NULL );
+    msi_export_init( &export, fd, g_file_new_for_path( path ), &t->error );
+    export.lock = t->lock;
+    g_free( path );
 
-static unsigned msi_export_row( LibmsiRecord *row, void *arg )
-{
-    ExportRow *export = arg;
+    if (!t->rows)
+        r = _libmsi_database_export( t->db, t->table, &export );
+    else
+    {
+        msi_export_header( &export, t->header );
+        r = LIBMSI_RESULT_SUCCESS;
+        for (i = 0; i < t->rows->len && r == LIBMSI_RESULT_SUCCESS; i++)
+            r = msi_export_record( &export, g_ptr_array_index( t->rows, i ), 1 );
+    }
+
+    if (!msi_export_flush( &export ) && r == LIBMSI_RESULT_SUCCESS)
+        r = LIBMSI_RESULT_FUNCTION_FAILED;
+    if (close( fd ) && r == LIBMSI_RESULT_SUCCESS)
+        r = LIBMSI_RESULT_FUNCTION_FAILED;
 
-    return msi_export_record (export->fd, row, 1,
-                              export->table_dir, export->error);
+    msi_export_free( &export );
+    g_object_unref( export.table_dir );
+    return r;
 }
 
-static LibmsiResult msi_export_forcecodepage( int fd, unsigned codepage )
+/* writes a fetched table and frees its rows */
+static void export_table_job( gpointer data, gpointer user_data )
 {
-    static const char fmt[] = "\r\n\r\n%u\t_ForceCodepage\r\n";
-    char data[sizeof(fmt) + 10];
-    unsigned sz;
+    LibmsiExportTable *t = data;
+    LibmsiExportQueue *queue = t->queue;
 
-    sprintf( data, fmt, codepage );
+    t->r = msi_write_export_file( t );
 
-    sz = strlen(data) + 1;
-    if (write( fd, data, sz ) != sz)
-        return LIBMSI_RESULT_FUNCTION_FAILED;
+    g_mutex_lock( t->lock );
+    g_ptr_array_unref( t->rows );
+    t->rows = NULL;
+    msi_free_header( t->header );
+    memset( t->header, 0, sizeof(t->header) );
+    g_mutex_unlock( t->lock );
 
-    return LIBMSI_RESULT_SUCCESS;
+    g_mutex_lock( &queue->pending_lock );
+    queue->pending--;
+    if (t->r != LIBMSI_RESULT_SUCCESS)
+        queue->failed = true;
+    g_cond_signal( &queue->written );
+    g_mutex_unlock( &queue->pending_lock );
 }
 
-static LibmsiResult msi_export_summaryinfo (LibmsiDatabase *db, int fd, GError **error)
+/* fetches the rows of a table; the records borrow their strings from the
+ * string table and open their streams when they are written */
+static unsigned msi_fetch_export_table( LibmsiDatabase *db, LibmsiExportTable *t )
 {
-    static const char header[] =
-        "PropertyId\tValue\r\ni2\tl255\r\n_SummaryInformation\tPropertyId\r\n";
-    LibmsiResult result = LIBMSI_RESULT_FUNCTION_FAILED;
-    LibmsiSummaryInfo *si = libmsi_summary_info_new (db, 0, error);
-    gchar *str = NULL;
-    gssize sz;
-    int i;
-
-    if (!si)
-        goto end;
+    LibmsiQuery *view;
+    LibmsiRecord *rec;
+    unsigned r;
 
-    sz = strlen (header);
-    if (write (fd, header, sz) != sz)
-        goto end;
+    r = _libmsi_query_open( db, &view, "select * from `%s`", t->table );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
 
-    for (i = 0; i < MSI_MAX_PROPS; i++)
-        if (si->property[i].vt != OLEVT_EMPTY) {
-            gchar *val = summary_info_as_string (si, i);
-            if (!val)
-                goto end;
-            str = g_strdup_printf ("%d\t%s\r\n", i, val);
-            sz = strlen (str);
-            if (write (fd, str, sz) != sz)
-                goto end;
-            g_free (str);
-            str = NULL;
-        }
+    msi_export_get_header( db, view, t->table, t->header );
 
-    result = LIBMSI_RESULT_SUCCESS;
+    t->rows = g_ptr_array_new_with_free_func( g_object_unref );
+    r = _libmsi_query_execute( view, NULL );
+    while (r == LIBMSI_RESULT_SUCCESS)
+    {
+        rec = NULL;
+        r = _libmsi_query_fetch( view, &rec );
+        if (r == LIBMSI_RESULT_SUCCESS)
+            g_ptr_array_add( t->rows, rec );
+    }
+    if (r == NO_MORE_ITEMS)
+        r = LIBMSI_RESULT_SUCCESS;
 
-end:
-    g_free (str);
-    if (si)
-        g_object_unref (si);
-    return result;
+    g_object_unref( view );
+    return r;
 }
 
-static LibmsiResult _libmsi_database_export(LibmsiDatabase *db, const char *table,
-                                        int fd, GError **error)
+static unsigned _libmsi_database_export_all( LibmsiDatabase *db, const char *dir,
+                                             GError **error )
 {
-    static const char query[] = "select * from %s";
+    static const char *special[] = { "_SummaryInformation", "_ForceCodepage" };
+    LibmsiExportTable *tables = NULL, *temp;
+    LibmsiExportQueue queue = { 0 };
+    LibmsiQuery *query = NULL;
     LibmsiRecord *rec = NULL;
-    LibmsiQuery *view = NULL;
-    LibmsiResult r;
+    GThreadPool *pool = NULL;
+    unsigned i, count = 0, threads, r;
+    bool failed;
 
-    TRACE("%p %s %d\n", db, debugstr_a(table), fd );
+    TRACE("%p %s\n", db, debugstr_a(dir));
 
-    if (!strcmp(table, "_ForceCodepage")) {
-        unsigned codepage = msi_get_string_table_codepage (db->strings);
-        return msi_export_forcecodepage (fd, codepage);
-    } else if (!strcmp (table, "_SummaryInformation")) {
-        return msi_export_summaryinfo (db, fd, error);
+    g_mutex_init( &queue.lock );
+    g_mutex_init( &queue.pending_lock );
+    g_cond_init( &queue.written );
+
+    if (g_mkdir_with_parents( dir, 0755 ))
+    {
+        r = LIBMSI_RESULT_OPEN_FAILED;
+        goto done;
     }
 
-    r = _libmsi_query_open( db, &view, query, table );
-    if (r == LIBMSI_RESULT_SUCCESS)
+    /* the special tables are not listed in _Tables */
+    for (i = 0; i < G_N_ELEMENTS(special); i++)
     {
-        /* write out row 1, the column names */
-        r = _libmsi_query_get_column_info(view, LIBMSI_COL_INFO_NAMES, &rec);
-        if (r == LIBMSI_RESULT_SUCCESS)
+        LibmsiExportTable t = { .db = db, .dir = dir, .table = (char *)special[i] };
+
+        r = msi_write_export_file( &t );
+        if (r != LIBMSI_RESULT_SUCCESS)
         {
-            msi_export_record( fd, rec, 1, NULL, error);
-            g_object_unref(rec);
+            g_propagate_error( error, t.error );
+            goto done;
         }
+    }
 
-        /* write out row 2, the column types */
-        r = _libmsi_query_get_column_info(view, LIBMSI_COL_INFO_TYPES, &rec);
-        if (r == LIBMSI_RESULT_SUCCESS)
+    r = _libmsi_query_open( db, &query, "SELECT `Name` FROM `_Tables`" );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        goto done;
+    r = _libmsi_query_execute( query, NULL );
+    while (r == LIBMSI_RESULT_SUCCESS)
+    {
+        r = _libmsi_query_fetch( query, &rec );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            break;
+
+        temp = msi_realloc( tables, (count + 1) * sizeof(*tables) );
+        if (!temp)
         {
-            msi_export_record( fd, rec, 1, NULL, error);
-            g_object_unref(rec);
+            r = LIBMSI_RESULT_OUTOFMEMORY;
+            break;
         }
+        tables = temp;
+        memset( &tables[count], 0, sizeof(*tables) );
+        tables[count].db = db;
+        tables[count].dir = dir;
+        tables[count].lock = &queue.lock;
+        tables[count].queue = &queue;
+        tables[count].table = libmsi_record_get_string( rec, 1 );
+        count++;
+
+        g_object_unref( rec );
+        rec = NULL;
+    }
+    if (r != NO_MORE_ITEMS)
+        goto done;
+    r = LIBMSI_RESULT_SUCCESS;
 
-        /* write out row 3, the table name + keys */
-        r = _libmsi_database_get_primary_keys( db, table, &rec );
-        if (r == LIBMSI_RESULT_SUCCESS)
+    threads = MIN( count, g_get_num_processors() );
+    if (threads > 1)
+        pool = g_thread_pool_new( export_table_job, NULL, threads, FALSE, NULL );
+
+    /* rows are fetched here, one table at a time, as queries are not thread
+     * safe; the workers write the files and free the rows, and only a few
+     * tables are waiting for a worker at any time */
+    for (i = 0; i < count; i++)
+    {
+        g_mutex_lock( &queue.pending_lock );
+        while (queue.pending >= threads * EXPORT_WINDOW && !queue.failed)
+            g_cond_wait( &queue.written, &queue.pending_lock );
+        failed = queue.failed;
+        if (!failed)
+            queue.pending++;
+        g_mutex_unlock( &queue.pending_lock );
+        if (failed)
+            break;
+
+        g_mutex_lock( &queue.lock );
+        r = msi_fetch_export_table( db, &tables[i] );
+        g_mutex_unlock( &queue.lock );
+        if (r != LIBMSI_RESULT_SUCCESS)
         {
-            libmsi_record_set_string( rec, 0, table );
-            msi_export_record( fd, rec, 0, NULL, error);
-            g_object_unref(rec);
+            g_mutex_lock( &queue.pending_lock );
+            queue.pending--;
+            g_mutex_unlock( &queue.pending_lock );
+            break;
         }
 
-        /* write out row 4 onwards, the data */
-        ExportRow export = {
-            .fd = fd,
-            .table_dir = g_file_new_for_path (table),
-            .error = error
-        };
-        r = _libmsi_query_iterate_records( view, 0, msi_export_row, &export);
-
-        g_object_unref (export.table_dir);
-        g_object_unref (view);
+        if (pool)
+            g_thread_pool_push( pool, &tables[i], NULL );
+        else
+            export_table_job( &tables[i], NULL );
+    }
+
+    if (pool)
+        g_thread_pool_free( pool, FALSE, TRUE );
+
+    if (r == LIBMSI_RESULT_SUCCESS)
+    {
+        for (i = 0; i < count; i++)
+        {
+            r = tables[i].r;
+            if (r != LIBMSI_RESULT_SUCCESS)
+            {
+                g_propagate_error( error, tables[i].error );
+                tables[i].error = NULL;
+                break;
+            }
+        }
     }
 
+done:
+    if (query)
+        g_object_unref( query );
+    for (i = 0; i < count; i++)
+        free_export_table( &tables[i] );
+    msi_free( tables );
+    g_cond_clear( &queue.written );
+    g_mutex_clear( &queue.pending_lock );
+    g_mutex_clear( &queue.lock );
     return r;
 }
 
 /**
- * libmsi_database_export:
+ * libmsi_database_export_all:
  * @db: a %LibmsiDatabase
- * @table: a table name
- * @fd: a file descriptor
+ * @dir: the directory to write to
  * @error: (allow-none): #GError to set on error, or %NULL
  *
- * Writes a file containing the table data as tab separated ASCII.
- * The format is as follows:
- *
- * row1 : colname1 <tab> colname2 <tab> .... colnameN <cr> <lf>
- * row2 : coltype1 <tab> coltype2 <tab> .... coltypeN <cr> <lf>
- * row3 : tablename <tab> key1 <tab> key2 <tab> ... keyM <cr> <lf>
- *
- * Followed by the data, starting at row 1 with one row per line
+ * Exports every table of @db, as well as _SummaryInformation and
+ * _ForceCodepage, to a file named after the table with an .idt extension
+ * in @dir.  The format is that of libmsi_database_export(), and the binary
+ * fields of a table are written to a directory named after the table.
  *
- * row4 : data <tab> data <tab> data <tab> ... data <cr> <lf>
+ * The rows are read on the calling thread one table at a time, and the
+ * files are written on up to one thread per processor; only a few tables
+ * are held in memory at once.
  *
  * Returns: %TRUE on success
  **/
 gboolean
-libmsi_database_export (LibmsiDatabase *db,
-                        const char *table,
-                        int fd,
-                        GError **error)
+libmsi_database_export_all (LibmsiDatabase *db,
+                            const char *dir,
+                            GError **error)
 {
-    unsigned r = LIBMSI_RESULT_OUTOFMEMORY;
+    unsigned r;
 
-    TRACE("%p %s %d\n", db, table, fd);
+    TRACE("%p %s\n", db, debugstr_a(dir));
 
     g_return_val_if_fail (LIBMSI_IS_DATABASE (db), FALSE);
-    g_return_val_if_fail (table, FALSE);
-    g_return_val_if_fail (fd >= 0, FALSE);
+    g_return_val_if_fail (dir, FALSE);
     g_return_val_if_fail (!error || *error == NULL, FALSE);
 
     g_object_ref(db);
-    r = _libmsi_database_export (db, table, fd, error);
+    r = _libmsi_database_export_all (db, dir, error);
     g_object_unref(db);
 
     if (r != LIBMSI_RESULT_SUCCESS && error && !*error)
@@ -2128,17 +2901,17 @@ static void cache_infile_structure( LibmsiDatabase *db )
         }
         /* table streams are not in the _Streams table */
         if (!GSF_IS_INFILE(in) || gsf_infile_num_children(GSF_INFILE(in)) == -1) {
+            /* fills the name cache in both directions */
+            const char *decname = msi_db_decode_streamname( db, name );
+
             /* UTF-8 encoding of 0x4840.  */
             if (name8[0] == 0xe4 && name8[1] == 0xa1 && name8[2] == 0x80)
             {
-                g_autofree char *decname = NULL;
-
-                decname = decode_streamname(name + 3);
-                if ( !strcmp( decname, szStringPool ) ||
-                     !strcmp( decname, szStringData ) )
+                if ( !strcmp( decname + 3, szStringPool ) ||
+                     !strcmp( decname + 3, szStringData ) )
                     continue;
 
-                r = _libmsi_open_table( db, decname, false );
+                r = _libmsi_open_table( db, decname + 3, false );
                 g_warn_if_fail (r == LIBMSI_RESULT_SUCCESS);
             }
             else
@@ -2153,6 +2926,41 @@ static void cache_infile_structure( LibmsiDatabase *db )
     }
 }
 
+/* runs func on each job, on up to one thread per processor */
+void msi_run_jobs( GFunc func, gpointer *jobs, unsigned count )
+{
+    GThreadPool *pool = NULL;
+    unsigned i, threads;
+
+    threads = MIN( count, g_get_num_processors() );
+    if (threads > 1)
+        pool = g_thread_pool_new( func, NULL, threads, FALSE, NULL );
+
+    for (i = 0; i < count; i++)
+    {
+        if (pool)
+            g_thread_pool_push( pool, jobs[i], NULL );
+        else
+            func( jobs[i], NULL );
+    }
+
+    if (pool)
+        g_thread_pool_free( pool, FALSE, TRUE );
+}
+
+/* a mapped file turns sector reads into page cache hits; it is only
+ * used when nothing writes to the file while it is open */
+GsfInput *msi_open_file_input( const char *path, bool map )
+{
+    GsfInput *in = NULL;
+
+    if (map)
+        in = gsf_input_mmap_new( path, NULL );
+    if (!in)
+        in = gsf_input_stdio_new( path, NULL );
+    return in;
+}
+
 LibmsiResult _libmsi_database_open(LibmsiDatabase *db)
 {
     GsfInput *in;
@@ -2162,7 +2970,7 @@ LibmsiResult _libmsi_database_open(LibmsiDatabase *db)
 
     TRACE("%p %s\n", db, db->path);
 
-    in = gsf_input_stdio_new(db->path, NULL);
+    in = msi_open_file_input(db->path, db->flags & LIBMSI_DB_FLAGS_READONLY);
     if (!in)
     {
         g_warning("open file failed for %s\n", debugstr_a(db->path));
@@ -2203,10 +3011,13 @@ LibmsiResult _libmsi_database_open(LibmsiDatabase *db)
 
     cache_infile_structure( db );
 
-    db->strings = msi_load_string_table( db->infile, &db->bytes_per_strref );
+    db->strings = msi_load_string_table( db, db->infile, &db->bytes_per_strref );
     if( !db->strings )
         goto end;
 
+    if (db->flags & LIBMSI_DB_FLAGS_EAGER)
+        msi_load_all_tables( db );
+
     ret = LIBMSI_RESULT_SUCCESS;
 end:
     if (ret) {
@@ -2227,7 +3038,7 @@ unsigned _libmsi_database_apply_transform( LibmsiDatabase *db,
     uint8_t uuid[16];
 
     TRACE("%p %s\n", db, debugstr_a(szTransformFile));
-    in = gsf_input_stdio_new(szTransformFile, NULL);
+    in = msi_open_file_input(szTransformFile, true);
     if (!in)
     {
         g_warning("open file failed for transform %s\n", debugstr_a(szTransformFile));
@@ -2246,7 +3057,7 @@ unsigned _libmsi_database_apply_transform( LibmsiDatabase *db,
         goto end;
 
     if (TRACE_ON && stg)
-        enum_stream_names( stg );
+        enum_stream_names( db, stg );
 
     ret = msi_table_apply_transform( db, stg );
 
@@ -2287,6 +3098,199 @@ libmsi_database_apply_transform (LibmsiDatabase *db,
     return r == LIBMSI_RESULT_SUCCESS;
 }
 
+/* a parsed statement, kept for the statements repeated in a script */
+typedef struct _LibmsiScriptPlan
+{
+    LibmsiView *view;
+    struct list mem;
+} LibmsiScriptPlan;
+
+static void free_script_plan( gpointer data )
+{
+    LibmsiScriptPlan *plan = data;
+    struct list *ptr, *t;
+
+    if (plan->view)
+        plan->view->ops->delete( plan->view );
+
+    LIST_FOR_EACH_SAFE (ptr, t, &plan->mem)
+        msi_free( ptr );
+
+    msi_free( plan );
+}
+
+static unsigned execute_script_statement( LibmsiDatabase *db, const char *script,
+                                          const struct sql_token *tokens, unsigned count,
+                                          LibmsiRecord *params, GHashTable *plans )
+{
+    LibmsiScriptPlan *plan;
+    unsigned r, start, end;
+    bool schema;
+    char *sql = NULL;
+
+    /* cached views point to the tables and columns a schema change
+     * frees or reshapes, so they are dropped, and the change itself is
+     * not cached */
+    schema = sql_changes_schema( tokens );
+    if (schema)
+    {
+        g_hash_table_remove_all( plans );
+        plan = NULL;
+    }
+    else
+    {
+        start = tokens[0].offset;
+        end = tokens[count - 1].offset + tokens[count - 1].len;
+        sql = g_strndup( script + start, end - start );
+        plan = g_hash_table_lookup( plans, sql );
+    }
+
+    if (plan)
+        g_free( sql );
+    else
+    {
+        plan = msi_alloc_zero( sizeof *plan );
+        if (!plan)
+        {
+            g_free( sql );
+            return LIBMSI_RESULT_OUTOFMEMORY;
+        }
+        list_init( &plan->mem );
+        if (!schema)
+            g_hash_table_insert( plans, sql, plan );
+
+        r = _libmsi_parse_sql_tokens( db, script, tokens, count, &plan->view, &plan->mem );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            goto done;
+    }
+
+    if (!plan->view || !plan->view->ops->execute)
+    {
+        r = LIBMSI_RESULT_FUNCTION_FAILED;
+        goto done;
+    }
+
+    r = plan->view->ops->execute( plan->view, params );
+    if (plan->view->ops->close)
+        plan->view->ops->close( plan->view );
+
+done:
+    if (schema)
+        free_script_plan( plan );
+    return r;
+}
+
+static unsigned _libmsi_database_execute_script( LibmsiDatabase *db, const char *script,
+                                                 LibmsiRecord *params )
+{
+    struct sql_token *tokens;
+    GHashTable *plans;
+    unsigned r = LIBMSI_RESULT_SUCCESS, i, start, count;
+
+    count = sql_tokenize( script, &tokens );
+    if (!tokens)
+        return LIBMSI_RESULT_OUTOFMEMORY;
+
+    plans = g_hash_table_new_full( g_str_hash, g_str_equal, g_free, free_script_plan );
+
+    for (start = 0; start < count && r == LIBMSI_RESULT_SUCCESS; start = i)
+    {
+        for (i = start + 1; i < count; i++)
+            if (sql_starts_statement( tokens, i ))
+                break;
+
+        r = execute_script_statement( db, script, &tokens[start], i - start, params, plans );
+    }
+
+    g_hash_table_destroy( plans );
+    msi_free( tokens );
+    return r;
+}
+
+/**
+ * libmsi_database_execute_script:
+ * @db: a %LibmsiDatabase
+ * @sql: one or more SQL statements
+ * @params: (allow-none): a #LibmsiRecord with the arguments of the
+ *     statements, or %NULL if they have none
+ * @error: (allow-none): #GError to set on error, or %NULL
+ *
+ * Execute all the statements of @sql in order, stopping at the first
+ * one that fails.  A statement ends where the next one begins with
+ * ALTER, CREATE, DELETE, DROP, EXPLAIN, INSERT, SELECT or UPDATE.
+ *
+ * The script is tokenized only once, and a statement that occurs
+ * several times is only parsed the first time.  Each statement receives
+ * @params as its arguments.  Like the other changes to @db, the changes
+ * are only written by libmsi_database_commit().  The statements that
+ * ran before a failing one are not undone.
+ *
+ * Returns: %TRUE on success
+ **/
+gboolean
+libmsi_database_execute_script (LibmsiDatabase *db,
+                                const char *sql,
+                                LibmsiRecord *params,
+                                GError **error)
+{
+    unsigned r;
+
+    TRACE("%p %s\n", db, debugstr_a(sql));
+
+    g_return_val_if_fail (LIBMSI_IS_DATABASE (db), FALSE);
+    g_return_val_if_fail (sql, FALSE);
+    g_return_val_if_fail (!params || LIBMSI_IS_RECORD (params), FALSE);
+    g_return_val_if_fail (!error || *error == NULL, FALSE);
+
+    g_object_ref(db);
+    r = _libmsi_database_execute_script (db, sql, params);
+    g_object_unref(db);
+
+    if (r != LIBMSI_RESULT_SUCCESS)
+        g_set_error_literal (error, LIBMSI_RESULT_ERROR, r, G_STRFUNC);
+
+    return r == LIBMSI_RESULT_SUCCESS;
+}
+
+/**
+ * libmsi_database_attach:
+ * @db: a %LibmsiDatabase
+ * @other: the %LibmsiDatabase to attach
+ * @alias: the name of @other in the queries of @db
+ * @error: (allow-none): #GError to set on error, or %NULL
+ *
+ * Make the tables of @other available to the queries of @db.  The FROM
+ * list of a query names them as `alias`.`Table`, and its columns as
+ * `alias`.`Table`.`Column`.  The attached tables are read-only.
+ *
+ * The strings of @other are given ids in the string table of @db, so
+ * joins between the two databases compare string ids rather than text.
+ * These strings are not saved by libmsi_database_commit().
+ *
+ * Returns: %TRUE on success
+ **/
+gboolean
+libmsi_database_attach (LibmsiDatabase *db,
+                        LibmsiDatabase *other,
+                        const char *alias,
+                        GError **error)
+{
+    unsigned r;
+
+    TRACE("%p %p %s\n", db, other, debugstr_a(alias));
+
+    g_return_val_if_fail (LIBMSI_IS_DATABASE (db), FALSE);
+    g_return_val_if_fail (LIBMSI_IS_DATABASE (other), FALSE);
+    g_return_val_if_fail (alias, FALSE);
+    g_return_val_if_fail (!error || *error == NULL, FALSE);
+
+    r = _libmsi_database_attach (db, other, alias);
+    if (r != LIBMSI_RESULT_SUCCESS)
+        g_set_error_literal (error, LIBMSI_RESULT_ERROR, r, G_STRFUNC);
+
+    return r == LIBMSI_RESULT_SUCCESS;
+}
+
 static int gsf_infile_copy(GsfInfile *inf, GsfOutfile *outf)
 {
     int n = gsf_infile_num_children(inf);
@@ -2336,15 +3340,35 @@ end:
     return ret;
 }
 
+/* gsf_input_copy goes through 4k reads and writes; copy in 1 MiB blocks
+ * instead.  Without a caller buffer a memory input hands out its own data,
+ * and other inputs read each block into a buffer of their own */
+#define COPY_BLOCK_SIZE (1024 * 1024)
+
+static bool copy_stream( GsfInput *in, GsfOutput *out )
+{
+    const guint8 *data;
+    gsf_off_t remaining;
+    size_t n;
+
+    while ((remaining = gsf_input_remaining( in )) > 0)
+    {
+        n = MIN( remaining, COPY_BLOCK_SIZE );
+        data = gsf_input_read( in, n, NULL );
+        if (!data || !gsf_output_write( out, n, data ))
+            return false;
+    }
+    return true;
+}
+
 static unsigned commit_stream( const char *name, GsfInput *stm, void *opaque)
 {
     LibmsiDatabase *db = opaque;
     GsfOutput *outstm;
     unsigned ret = LIBMSI_RESULT_FUNCTION_FAILED;
-    g_autofree char *decname = NULL;
 
-    decname = decode_streamname(name);
-    TRACE("%s(%s) %p %p\n", debugstr_a(name), debugstr_a(decname), stm, opaque);
+    TRACE("%s(%s) %p %p\n", debugstr_a(name),
+          debugstr_a(msi_db_decode_streamname(db, name)), stm, opaque);
 
     outstm = gsf_outfile_new_child( db->outfile, name, false );
     if ( !outstm )
@@ -2352,7 +3376,7 @@ static unsigned commit_stream( const char *name, GsfInput *stm, void *opaque)
 
     gsf_input_seek (stm, 0, G_SEEK_SET);
     gsf_output_seek (outstm, 0, G_SEEK_SET);
-    if ( !gsf_input_copy( stm, outstm ))
+    if ( !copy_stream( stm, outstm ))
         goto end;
 
     ret = LIBMSI_RESULT_SUCCESS;
@@ -2424,6 +3448,7 @@ libmsi_database_commit (LibmsiDatabase *db, GError **error)
     db->flags |= LIBMSI_DB_FLAGS_TRANSACT;
     _libmsi_database_open(db);
     _libmsi_database_start_transaction(db);
+    _libmsi_database_reload_attached(db);
 
 end:
     g_object_unref(db);
@@ -2585,7 +3610,7 @@ init (LibmsiDatabase *self, GError **error)
     self->media_transform_disk_id = MSI_INITIAL_MEDIA_TRANSFORM_DISKID;
 
     if (TRACE_ON && self->infile)
-        enum_stream_names (self->infile);
+        enum_stream_names (self, self->infile);
 
     ret = _libmsi_database_start_transaction (self);
 
@@ -60,6 +60,7 @@ libmsi_query_finalize (GObject *object)
     }
 
     g_free (self->query);
+    msi_free (self->col_types);
 
     G_OBJECT_CLASS (libmsi_query_parent_class)->finalize (object);
 }
@@ -136,9 +137,11 @@ libmsi_query_class_init (LibmsiQueryClass *klass)
 static gboolean
 init (LibmsiQuery *self, GError **error)
 {
+    gint64 start = g_get_monotonic_time ();
     unsigned r;
 
     r = _libmsi_parse_sql (self->database, self->query, &self->view, &self->mem);
+    self->prepare_time = g_get_monotonic_time () - start;
 
     if (r != LIBMSI_RESULT_SUCCESS)
         g_set_error_literal (error, LIBMSI_RESULT_ERROR, r, G_STRFUNC);
@@ -206,6 +209,39 @@ unsigned _libmsi_query_open( LibmsiDatabase *db, LibmsiQuery **view, const char
     return r;
 }
 
+/* fetches the next row into *prec, reusing the record left there by
+ * the previous call */
+static LibmsiResult query_fetch_reuse( LibmsiQuery *query, LibmsiRecord **prec )
+{
+    LibmsiView *view = query->view;
+    unsigned r, col_count = 0;
+    gint64 start;
+
+    if( !view )
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    start = g_get_monotonic_time();
+    if( !*prec )
+    {
+        r = view->ops->get_dimensions( view, NULL, &col_count );
+        if( r != LIBMSI_RESULT_SUCCESS )
+            return r;
+        if( !col_count )
+            return LIBMSI_RESULT_INVALID_PARAMETER;
+
+        *prec = libmsi_record_new( col_count );
+        if( !*prec )
+            return LIBMSI_RESULT_FUNCTION_FAILED;
+    }
+
+    r = msi_view_fill_row( query->database, view, query->row, *prec );
+    if( r == LIBMSI_RESULT_SUCCESS )
+        query->row++;
+    query->fetch_time += g_get_monotonic_time() - start;
+
+    return r;
+}
+
 unsigned _libmsi_query_iterate_records( LibmsiQuery *view, unsigned *count,
                          record_func func, void *param )
 {
@@ -223,15 +259,16 @@ unsigned _libmsi_query_iterate_records( LibmsiQuery *view, unsigned *count,
     /* iterate a query */
     for( n = 0; (max == 0) || (n < max); n++ )
     {
-        r = _libmsi_query_fetch( view, &rec );
+        r = query_fetch_reuse( view, &rec );
         if( r != LIBMSI_RESULT_SUCCESS )
             break;
         if (func)
             r = func( rec, param );
-        g_object_unref(rec);
         if( r != LIBMSI_RESULT_SUCCESS )
             break;
     }
+    if( rec )
+        g_object_unref( rec );
 
     libmsi_query_close( view, &error );
     if (error) {
@@ -282,25 +319,47 @@ LibmsiRecord *_libmsi_query_get_record( LibmsiDatabase *db, const char *fmt, ...
     return rec;
 }
 
-unsigned msi_view_get_row(LibmsiDatabase *db, LibmsiView *view, unsigned row, LibmsiRecord **rec)
+unsigned msi_view_fetch_stream_name(LibmsiView *view, unsigned row, unsigned col, LibmsiDatabase **db,
+                                    const char **name, const char **encname)
 {
-    unsigned row_count = 0, col_count = 0, i, ival, ret, type;
+    if (!view->ops->fetch_stream_name)
+        return LIBMSI_RESULT_CALL_NOT_IMPLEMENTED;
 
-    TRACE("%p %p %d %p\n", db, view, row, rec);
+    return view->ops->fetch_stream_name(view, row, col, db, name, encname);
+}
 
-    ret = view->ops->get_dimensions(view, &row_count, &col_count);
-    if (ret)
-        return ret;
+/* the stream is only opened once the field is read, if the view can name it */
+static void view_set_stream(LibmsiView *view, unsigned row, unsigned col, LibmsiRecord *rec)
+{
+    LibmsiDatabase *db;
+    const char *name, *encname;
+    GsfInput *stm = NULL;
+    unsigned ret;
 
-    if (!col_count)
-        return LIBMSI_RESULT_INVALID_PARAMETER;
+    ret = msi_view_fetch_stream_name(view, row, col, &db, &name, &encname);
+    if (ret == LIBMSI_RESULT_SUCCESS &&
+        msi_peek_raw_stream(db, encname, &stm) == LIBMSI_RESULT_SUCCESS)
+    {
+        _libmsi_record_set_stream_ref(rec, col, stm, name);
+        g_object_unref(G_OBJECT(stm));
+        return;
+    }
 
-    if (row >= row_count)
-        return NO_MORE_ITEMS;
+    ret = view->ops->fetch_stream(view, row, col, &stm);
+    if ((ret == LIBMSI_RESULT_SUCCESS) && stm)
+    {
+        _libmsi_record_set_gsf_input(rec, col, stm);
+        g_object_unref(G_OBJECT(stm));
+    }
+    else
+        g_warning("failed to get stream\n");
+}
 
-    *rec = libmsi_record_new (col_count);
-    if (!*rec)
-        return LIBMSI_RESULT_FUNCTION_FAILED;
+/* strings are borrowed from the string table rather than copied */
+static void view_fill_row(LibmsiDatabase *db, LibmsiView *view, unsigned row,
+                          unsigned col_count, LibmsiRecord *rec)
+{
+    unsigned i, ival, ret, type;
 
     for (i = 1; i <= col_count; i++)
     {
@@ -313,17 +372,19 @@ unsigned msi_view_get_row(LibmsiDatabase *db, LibmsiView *view, unsigned row, Li
 
         if (MSITYPE_IS_BINARY(type))
         {
-            GsfInput *stm = NULL;
+            view_set_stream(view, row, i, rec);
+            continue;
+        }
 
-            ret = view->ops->fetch_stream(view, row, i, &stm);
-            if ((ret == LIBMSI_RESULT_SUCCESS) && stm)
-            {
-                _libmsi_record_set_gsf_input(*rec, i, stm);
-                g_object_unref(G_OBJECT(stm));
-            }
-            else
-                g_warning("failed to get stream\n");
+        if ((type & MSITYPE_STRING) && view->ops->fetch_string)
+        {
+            const char *sval;
 
+            ret = view->ops->fetch_string(view, row, i, &sval);
+            if (ret)
+                g_critical("Error fetching data for %d\n", i);
+            else if (sval && *sval)
+                libmsi_record_set_string(rec, i, sval);
             continue;
         }
 
@@ -346,17 +407,87 @@ unsigned msi_view_get_row(LibmsiDatabase *db, LibmsiView *view, unsigned row, Li
             const char *sval;
 
             sval = msi_string_lookup_id(db->strings, ival);
-            libmsi_record_set_string(*rec, i, sval);
+            if (sval)
+                _libmsi_record_set_borrowed_string(rec, i, sval, db->strings);
+            else
+                libmsi_record_set_string(rec, i, sval);
         }
         else
         {
             if ((type & MSI_DATASIZEMASK) == 2)
-                libmsi_record_set_int(*rec, i, ival - (1<<15));
+                libmsi_record_set_int(rec, i, ival - (1<<15));
             else
-                libmsi_record_set_int(*rec, i, ival - (1<<31));
+                libmsi_record_set_int(rec, i, ival - (1<<31));
         }
     }
+}
+
+unsigned msi_view_get_row(LibmsiDatabase *db, LibmsiView *view, unsigned row, LibmsiRecord **rec)
+{
+    unsigned row_count = 0, col_count = 0, ret;
+
+    TRACE("%p %p %d %p\n", db, view, row, rec);
+
+    ret = view->ops->get_dimensions(view, &row_count, &col_count);
+    if (ret)
+        return ret;
+
+    if (!col_count)
+        return LIBMSI_RESULT_INVALID_PARAMETER;
+
+    if (row >= row_count)
+        return NO_MORE_ITEMS;
+
+    *rec = libmsi_record_new (col_count);
+    if (!*rec)
+        return LIBMSI_RESULT_FUNCTION_FAILED;
 
+    view_fill_row(db, view, row, col_count, *rec);
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+/* like msi_view_get_row, but refills an existing record */
+unsigned msi_view_fill_row(LibmsiDatabase *db, LibmsiView *view, unsigned row, LibmsiRecord *rec)
+{
+    unsigned row_count = 0, col_count = 0, ret;
+
+    TRACE("%p %p %d %p\n", db, view, row, rec);
+
+    ret = view->ops->get_dimensions(view, &row_count, &col_count);
+    if (ret)
+        return ret;
+
+    if (!col_count || col_count != rec->count)
+        return LIBMSI_RESULT_INVALID_PARAMETER;
+
+    if (row >= row_count)
+        return NO_MORE_ITEMS;
+
+    _libmsi_record_reset(rec);
+    view_fill_row(db, view, row, col_count, rec);
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+void msi_view_explain(LibmsiView *view, GString *str, unsigned depth)
+{
+    if (view->ops->explain)
+        view->ops->explain(view, str, depth);
+}
+
+unsigned msi_view_fetch_column_range(LibmsiView *view, unsigned col, unsigned first,
+                                     unsigned count, unsigned *out)
+{
+    unsigned i, ret;
+
+    if (view->ops->fetch_column_range)
+        return view->ops->fetch_column_range(view, col, first, count, out);
+
+    for (i = 0; i < count; i++)
+    {
+        ret = view->ops->fetch_int(view, first + i, col, &out[i]);
+        if (ret != LIBMSI_RESULT_SUCCESS)
+            return ret;
+    }
     return LIBMSI_RESULT_SUCCESS;
 }
 
@@ -364,6 +495,7 @@ LibmsiResult _libmsi_query_fetch(LibmsiQuery *query, LibmsiRecord **prec)
 {
     LibmsiView *view;
     LibmsiResult r;
+    gint64 start;
 
     TRACE("%p %p\n", query, prec );
 
@@ -371,9 +503,11 @@ LibmsiResult _libmsi_query_fetch(LibmsiQuery *query, LibmsiRecord **prec)
     if( !view )
         return LIBMSI_RESULT_FUNCTION_FAILED;
 
+    start = g_get_monotonic_time();
     r = msi_view_get_row(query->database, view, query->row, prec);
     if (r == LIBMSI_RESULT_SUCCESS)
         query->row ++;
+    query->fetch_time += g_get_monotonic_time() - start;
 
     return r;
 }
@@ -412,6 +546,319 @@ libmsi_query_fetch (LibmsiQuery *query, GError **error)
     return record;
 }
 
+static unsigned query_get_column_types( LibmsiQuery *query )
+{
+    LibmsiView *view = query->view;
+    unsigned r, i, count = 0;
+
+    if (query->col_types)
+        return LIBMSI_RESULT_SUCCESS;
+
+    r = view->ops->get_dimensions(view, NULL, &count);
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
+    if (!count)
+        return LIBMSI_RESULT_INVALID_PARAMETER;
+
+    query->col_types = msi_alloc(count * sizeof(*query->col_types));
+    if (!query->col_types)
+        return LIBMSI_RESULT_OUTOFMEMORY;
+
+    for (i = 0; i < count; i++)
+    {
+        r = view->ops->get_column_info(view, i + 1, NULL, &query->col_types[i], NULL, NULL);
+        if (r != LIBMSI_RESULT_SUCCESS)
+        {
+            msi_free(query->col_types);
+            query->col_types = NULL;
+            return r;
+        }
+    }
+    query->col_count = count;
+
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+/* fetches up to max_rows rows, with the strings of the whole batch
+ * copied into a single buffer shared by the records */
+static LibmsiResult _libmsi_query_fetch_batch(LibmsiQuery *query, unsigned max_rows,
+                                              GPtrArray *records)
+{
+    LibmsiView *view = query->view;
+    LibmsiRecord *rec;
+    GBytes *shared = NULL;
+    unsigned *vals = NULL;
+    unsigned r, i, j, n, row_count = 0;
+    const unsigned *types;
+    gsize size = 0;
+    char *buf = NULL;
+    gint64 start;
+
+    if( !view )
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    r = query_get_column_types(query);
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
+    types = query->col_types;
+
+    r = view->ops->get_dimensions(view, &row_count, NULL);
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
+    if (query->row >= row_count)
+        return NO_MORE_ITEMS;
+
+    start = g_get_monotonic_time();
+
+    n = MIN(max_rows, row_count - query->row);
+    vals = msi_alloc(n * query->col_count * sizeof(*vals));
+    if (!vals)
+        return LIBMSI_RESULT_OUTOFMEMORY;
+
+    /* first pass: fetch the values a column at a time and size the
+     * string buffer */
+    for (j = 0; j < query->col_count; j++)
+    {
+        unsigned *col = &vals[j * n];
+
+        if (MSITYPE_IS_BINARY(types[j]))
+        {
+            memset(col, 0, n * sizeof(*col));
+            continue;
+        }
+
+        r = msi_view_fetch_column_range(view, j + 1, query->row, n, col);
+        if (r != LIBMSI_RESULT_SUCCESS)
+        {
+            g_critical("Error fetching data for %d\n", j + 1);
+            memset(col, 0, n * sizeof(*col));
+            continue;
+        }
+
+        if (!(types[j] & MSITYPE_STRING))
+            continue;
+
+        for (i = 0; i < n; i++)
+            if (col[i])
+                size += strlen(msi_string_lookup_id(query->database->strings, col[i])) + 1;
+    }
+
+    if (size)
+    {
+        buf = g_malloc(size);
+        shared = g_bytes_new_take(buf, size);
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        rec = libmsi_record_new(query->col_count);
+        if (!rec)
+        {
+            r = LIBMSI_RESULT_FUNCTION_FAILED;
+            break;
+        }
+
+        for (j = 0; j < query->col_count; j++)
+        {
+            unsigned val = vals[j * n + i];
+
+            if (MSITYPE_IS_BINARY(types[j]))
+            {
+                view_set_stream(view, query->row + i, j + 1, rec);
+                continue;
+            }
+
+            if (!val)
+                continue;
+
+            if (types[j] & MSITYPE_STRING)
+            {
+                const char *sval = msi_string_lookup_id(query->database->strings, val);
+                size_t len = strlen(sval) + 1;
+
+                memcpy(buf, sval, len);
+                _libmsi_record_set_shared_string(rec, j + 1, buf, shared);
+                buf += len;
+            }
+            else if ((types[j] & MSI_DATASIZEMASK) == 2)
+                libmsi_record_set_int(rec, j + 1, val - (1<<15));
+            else
+                libmsi_record_set_int(rec, j + 1, val - (1<<31));
+        }
+
+        g_ptr_array_add(records, rec);
+    }
+
+    query->row += records->len;
+    query->fetch_time += g_get_monotonic_time() - start;
+
+    if (shared)
+        g_bytes_unref(shared);
+    msi_free(vals);
+
+    return records->len ? LIBMSI_RESULT_SUCCESS : r;
+}
+
+/**
+ * libmsi_query_fetch_batch:
+ * @query: a #LibmsiQuery
+ * @max_rows: the maximum number of records to return
+ * @error: (allow-none): return location for the error
+ *
+ * Return up to @max_rows of the next query results at once.  This
+ * is cheaper than calling libmsi_query_fetch() for each of them: the
+ * column types are only looked up once and the strings of all the
+ * records share a single allocation.
+ *
+ * Returns: (transfer full) (element-type LibmsiRecord): a newly
+ *     allocated array of #LibmsiRecord, empty when there are no more
+ *     results, or %NULL on failure.
+ **/
+GPtrArray *
+libmsi_query_fetch_batch (LibmsiQuery *query, guint max_rows, GError **error)
+{
+    GPtrArray *records;
+    unsigned ret;
+
+    TRACE("%p %u\n", query, max_rows);
+
+    g_return_val_if_fail (LIBMSI_IS_QUERY (query), NULL);
+    g_return_val_if_fail (!error || *error == NULL, NULL);
+
+    records = g_ptr_array_new_with_free_func (g_object_unref);
+
+    if (!max_rows)
+        return records;
+
+    g_object_ref(query);
+    ret = _libmsi_query_fetch_batch( query, max_rows, records );
+    g_object_unref(query);
+
+    if (ret != LIBMSI_RESULT_SUCCESS &&
+        ret != NO_MORE_ITEMS)
+    {
+        g_set_error_literal (error, LIBMSI_RESULT_ERROR, ret, G_STRFUNC);
+        g_ptr_array_unref (records);
+        return NULL;
+    }
+
+    return records;
+}
+
+/**
+ * libmsi_query_next:
+ * @query: a #LibmsiQuery
+ * @error: (allow-none): return location for the error
+ *
+ * Move to the next query result, to be read with libmsi_query_get_int()
+ * and libmsi_query_get_string_const().  Unlike libmsi_query_fetch(),
+ * this doesn't allocate anything per row.
+ *
+ * Returns: %TRUE if there is a current row, %FALSE when there are no
+ *     more results or on failure.
+ **/
+gboolean
+libmsi_query_next (LibmsiQuery *query, GError **error)
+{
+    unsigned r, row_count = 0;
+
+    TRACE("%p\n", query);
+
+    g_return_val_if_fail (LIBMSI_IS_QUERY (query), FALSE);
+    g_return_val_if_fail (!error || *error == NULL, FALSE);
+
+    if (!query->view)
+        r = LIBMSI_RESULT_FUNCTION_FAILED;
+    else
+        r = query_get_column_types (query);
+    if (r == LIBMSI_RESULT_SUCCESS)
+        r = query->view->ops->get_dimensions (query->view, &row_count, NULL);
+
+    if (r != LIBMSI_RESULT_SUCCESS) {
+        g_set_error_literal (error, LIBMSI_RESULT_ERROR, r, G_STRFUNC);
+        return FALSE;
+    }
+
+    if (query->row >= row_count)
+        return FALSE;
+
+    query->row++;
+    return TRUE;
+}
+
+/* reads column col of the row libmsi_query_next() moved to */
+static unsigned query_fetch_current( LibmsiQuery *query, unsigned col,
+                                     unsigned *type, unsigned *val )
+{
+    if (!query->row || !query->col_types)
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+    if (!col || col > query->col_count)
+        return LIBMSI_RESULT_INVALID_PARAMETER;
+
+    *type = query->col_types[col - 1];
+    if (MSITYPE_IS_BINARY(*type))
+        return LIBMSI_RESULT_INVALID_DATATYPE;
+
+    return query->view->ops->fetch_int (query->view, query->row - 1, col, val);
+}
+
+/**
+ * libmsi_query_get_int:
+ * @query: a #LibmsiQuery
+ * @col: a column number, starting at 1
+ *
+ * Read an integer column of the current row of @query.
+ *
+ * Returns: the value, or %LIBMSI_NULL_INT if it is null, if @col is
+ *     not an integer column or if there is no current row.
+ **/
+gint
+libmsi_query_get_int (LibmsiQuery *query, guint col)
+{
+    unsigned type, val;
+
+    g_return_val_if_fail (LIBMSI_IS_QUERY (query), LIBMSI_NULL_INT);
+
+    if (query_fetch_current (query, col, &type, &val) != LIBMSI_RESULT_SUCCESS)
+        return LIBMSI_NULL_INT;
+
+    if (!val || (type & MSITYPE_STRING))
+        return LIBMSI_NULL_INT;
+
+    if ((type & MSI_DATASIZEMASK) == 2)
+        return val - (1<<15);
+    return val - (1<<31);
+}
+
+/**
+ * libmsi_query_get_string_const:
+ * @query: a #LibmsiQuery
+ * @col: a column number, starting at 1
+ *
+ * Read a string column of the current row of @query, without copying
+ * it out of the database string table.
+ *
+ * Returns: (transfer none): the value, valid until the next call to
+ *     libmsi_query_next() or until the database is modified, or %NULL
+ *     if it is null, if @col is not a string column or if there is no
+ *     current row.
+ **/
+const gchar *
+libmsi_query_get_string_const (LibmsiQuery *query, guint col)
+{
+    unsigned type, val;
+
+    g_return_val_if_fail (LIBMSI_IS_QUERY (query), NULL);
+
+    if (query_fetch_current (query, col, &type, &val) != LIBMSI_RESULT_SUCCESS)
+        return NULL;
+
+    if (!val || !(type & MSITYPE_STRING))
+        return NULL;
+
+    return msi_string_lookup_id (query->database->strings, val);
+}
+
 /**
  * libmsi_query_close:
  * @query: a #LibmsiQuery
@@ -452,6 +899,8 @@ libmsi_query_close (LibmsiQuery *query, GError **error)
 LibmsiResult _libmsi_query_execute(LibmsiQuery *query, LibmsiRecord *rec )
 {
     LibmsiView *view;
+    LibmsiResult r;
+    gint64 start;
 
     TRACE("%p %p\n", query, rec);
 
@@ -461,8 +910,13 @@ LibmsiResult _libmsi_query_execute(LibmsiQuery *query, LibmsiRecord *rec )
     if( !view->ops->execute )
         return LIBMSI_RESULT_FUNCTION_FAILED;
     query->row = 0;
+    query->fetch_time = 0;
 
-    return view->ops->execute( view, rec );
+    start = g_get_monotonic_time();
+    r = view->ops->execute( view, rec );
+    query->execute_time = g_get_monotonic_time() - start;
+
+    return r;
 }
 
 /**
@@ -617,6 +1071,47 @@ libmsi_query_get_column_info (LibmsiQuery *query, LibmsiColInfo info, GError **e
     return rec;
 }
 
+/**
+ * libmsi_query_get_stats:
+ * @query: a #LibmsiQuery
+ * @error: (allow-none): return location for the error
+ *
+ * Describe the last execution of @query: one line per view, indented
+ * by depth, with the rows each one scanned and returned, the join order
+ * and strategy chosen for the WHERE clause and the rows found through
+ * an index, followed by the wall time spent preparing, executing and
+ * fetching, in microseconds.
+ *
+ * Returns: (transfer full): a newly allocated string or %NULL on error.
+ **/
+gchar *
+libmsi_query_get_stats (LibmsiQuery *query, GError **error)
+{
+    GString *str;
+
+    TRACE("%p\n", query);
+
+    g_return_val_if_fail (LIBMSI_IS_QUERY (query), NULL);
+    g_return_val_if_fail (!error || *error == NULL, NULL);
+
+    if (!query->view) {
+        g_set_error_literal (error, LIBMSI_RESULT_ERROR,
+                             LIBMSI_RESULT_FUNCTION_FAILED, G_STRFUNC);
+        return NULL;
+    }
+
+    str = g_string_new (NULL);
+    msi_view_explain (query->view, str, 0);
+    g_string_append_printf (str, "prepare time=%" G_GINT64_FORMAT "us\n",
+                            query->prepare_time);
+    g_string_append_printf (str, "execute time=%" G_GINT64_FORMAT "us\n",
+                            query->execute_time);
+    g_string_append_printf (str, "fetch rows=%u time=%" G_GINT64_FORMAT "us\n",
+                            query->row, query->fetch_time);
+
+    return g_string_free (str, FALSE);
+}
+
 /**
  * libmsi_query_get_error:
  * @query: a #LibmsiQuery
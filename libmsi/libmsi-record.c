@@ -21,6 +21,8 @@
 #include <stdarg.h>
 #include <inttypes.h>
 
+#include <gsf/gsf-input-impl.h>
+
 #include "libmsi-record.h"
 
 #include "debug.h"
@@ -41,6 +43,42 @@ G_DEFINE_TYPE (LibmsiRecord, libmsi_record, G_TYPE_OBJECT);
 #define LIBMSI_FIELD_TYPE_INT    1
 #define LIBMSI_FIELD_TYPE_STR   3
 #define LIBMSI_FIELD_TYPE_STREAM 4
+#define LIBMSI_FIELD_TYPE_STR_SHARED 5 /* points into rec->shared */
+#define LIBMSI_FIELD_TYPE_STR_BORROWED 6 /* points into rec->strings */
+#define LIBMSI_FIELD_TYPE_STREAM_REF 7 /* opened as a STREAM on first use */
+
+#define FIELD_IS_STRING(type) \
+    ((type) == LIBMSI_FIELD_TYPE_STR || (type) == LIBMSI_FIELD_TYPE_STR_SHARED || \
+     (type) == LIBMSI_FIELD_TYPE_STR_BORROWED)
+
+/* a database stream that hasn't been opened yet; holding the stream keeps
+ * its data as it was when the row was fetched, even if it is replaced */
+struct _LibmsiStreamRef
+{
+    GsfInput *stm;
+    char name[1];
+};
+
+static LibmsiStreamRef *
+stream_ref_new (GsfInput *stm, const char *name)
+{
+    LibmsiStreamRef *ref;
+
+    ref = msi_alloc (sizeof *ref + strlen (name));
+    if (!ref)
+        return NULL;
+
+    ref->stm = g_object_ref (stm);
+    strcpy (ref->name, name);
+    return ref;
+}
+
+static void
+stream_ref_free (LibmsiStreamRef *ref)
+{
+    g_object_unref (ref->stm);
+    msi_free (ref);
+}
 
 static void
 libmsi_record_init (LibmsiRecord *self)
@@ -58,12 +96,20 @@ _libmsi_free_field (LibmsiField *field )
         g_free (field->u.szVal);
         field->u.szVal = NULL;
         break;
+    case LIBMSI_FIELD_TYPE_STR_SHARED:
+    case LIBMSI_FIELD_TYPE_STR_BORROWED:
+        field->u.szVal = NULL;
+        break;
     case LIBMSI_FIELD_TYPE_STREAM:
         if (field->u.stream) {
             g_object_unref (G_OBJECT (field->u.stream));
             field->u.stream = NULL;
         }
         break;
+    case LIBMSI_FIELD_TYPE_STREAM_REF:
+        stream_ref_free (field->u.ref);
+        field->u.ref = NULL;
+        break;
     default:
         g_critical ("Invalid field type %d\n", field->type);
     }
@@ -80,6 +126,11 @@ libmsi_record_finalize (GObject *object)
 
     g_free (self->fields);
 
+    if (self->shared)
+        g_bytes_unref (self->shared);
+    if (self->strings)
+        msi_destroy_stringtable (self->strings);
+
     G_OBJECT_CLASS (libmsi_record_parent_class)->finalize (object);
 }
 
@@ -202,7 +253,12 @@ unsigned _libmsi_record_copy_field( LibmsiRecord *in_rec, unsigned in_n,
         case LIBMSI_FIELD_TYPE_INT:
             out->u.iVal = in->u.iVal;
             break;
+        case LIBMSI_FIELD_TYPE_STR_BORROWED:
+            /* both records can share the string of the string table */
+            _libmsi_record_set_borrowed_string( out_rec, out_n, in->u.szVal, in_rec->strings );
+            return r;
         case LIBMSI_FIELD_TYPE_STR:
+        case LIBMSI_FIELD_TYPE_STR_SHARED:
             str = strdup( in->u.szVal );
             if ( !str )
                 r = LIBMSI_RESULT_OUTOFMEMORY;
@@ -213,11 +269,16 @@ unsigned _libmsi_record_copy_field( LibmsiRecord *in_rec, unsigned in_n,
             g_object_ref(G_OBJECT(in->u.stream));
             out->u.stream = in->u.stream;
             break;
+        case LIBMSI_FIELD_TYPE_STREAM_REF:
+            out->u.ref = stream_ref_new( in->u.ref->stm, in->u.ref->name );
+            if ( !out->u.ref )
+                r = LIBMSI_RESULT_OUTOFMEMORY;
+            break;
         default:
             g_critical("invalid field type %d\n", in->type);
         }
         if (r == LIBMSI_RESULT_SUCCESS)
-            out->type = in->type;
+            out->type = FIELD_IS_STRING(in->type) ? LIBMSI_FIELD_TYPE_STR : in->type;
     }
 
     return r;
@@ -253,6 +314,8 @@ libmsi_record_get_int (const LibmsiRecord *rec, guint field)
     case LIBMSI_FIELD_TYPE_INT:
         return rec->fields[field].u.iVal;
     case LIBMSI_FIELD_TYPE_STR:
+    case LIBMSI_FIELD_TYPE_STR_SHARED:
+    case LIBMSI_FIELD_TYPE_STR_BORROWED:
         if( expr_int_from_string( rec->fields[field].u.szVal, &ret ) )
             return ret;
         return LIBMSI_NULL_INT;
@@ -364,6 +427,8 @@ libmsi_record_get_string (const LibmsiRecord *self, guint field)
     case LIBMSI_FIELD_TYPE_INT:
         return g_strdup_printf ("%d", self->fields[field].u.iVal);
     case LIBMSI_FIELD_TYPE_STR:
+    case LIBMSI_FIELD_TYPE_STR_SHARED:
+    case LIBMSI_FIELD_TYPE_STR_BORROWED:
         return g_strdup (self->fields[field].u.szVal);
     case LIBMSI_FIELD_TYPE_NULL:
         return g_strdup ("");
@@ -374,18 +439,104 @@ libmsi_record_get_string (const LibmsiRecord *self, guint field)
     return NULL;
 }
 
+/**
+ * libmsi_record_get_string_const:
+ * @record: a %LibmsiRecord
+ * @field: a field identifier
+ *
+ * Get the string value of %field without copying it.  Strings of
+ * records returned by a query are not copied out of the database
+ * either, so this doesn't allocate at all.
+ *
+ * Returns: (transfer none): the string, valid until %field is changed
+ * or @record is freed, or %NULL if %field is not a string.
+ **/
+const gchar *
+libmsi_record_get_string_const (const LibmsiRecord *self, guint field)
+{
+    g_return_val_if_fail (LIBMSI_IS_RECORD (self), NULL);
+
+    TRACE ("%p %d\n", self, field);
+
+    return _libmsi_record_get_string_raw (self, field);
+}
+
 G_GNUC_PURE
 const char *_libmsi_record_get_string_raw( const LibmsiRecord *rec, unsigned field )
 {
     if( field > rec->count )
         return NULL;
 
-    if( rec->fields[field].type != LIBMSI_FIELD_TYPE_STR )
+    if( !FIELD_IS_STRING(rec->fields[field].type) )
         return NULL;
 
     return rec->fields[field].u.szVal;
 }
 
+/* sets a string field pointing into a buffer shared by several records,
+ * which the record keeps alive instead of copying the string */
+void _libmsi_record_set_shared_string( LibmsiRecord *rec, unsigned field,
+                                       const char *str, GBytes *shared )
+{
+    if( field > rec->count )
+        return;
+
+    _libmsi_free_field( &rec->fields[field] );
+
+    if( rec->shared != shared )
+    {
+        if( rec->shared )
+            g_bytes_unref( rec->shared );
+        rec->shared = g_bytes_ref( shared );
+    }
+
+    rec->fields[field].type = LIBMSI_FIELD_TYPE_STR_SHARED;
+    rec->fields[field].u.szVal = (char *)str;
+}
+
+/* sets a string field pointing at a string of the string table st,
+ * which the record keeps alive instead of copying the string */
+void _libmsi_record_set_borrowed_string( LibmsiRecord *rec, unsigned field,
+                                         const char *str, string_table *st )
+{
+    if( field > rec->count )
+        return;
+
+    /* strings of a second table are copied */
+    if( rec->strings && rec->strings != st )
+    {
+        libmsi_record_set_string( rec, field, str );
+        return;
+    }
+
+    _libmsi_free_field( &rec->fields[field] );
+
+    if( !rec->strings )
+        rec->strings = msi_string_table_ref( st );
+
+    rec->fields[field].type = LIBMSI_FIELD_TYPE_STR_BORROWED;
+    rec->fields[field].u.szVal = (char *)str;
+}
+
+/* empties every field so that the record can be filled again */
+void _libmsi_record_reset( LibmsiRecord *rec )
+{
+    unsigned i;
+
+    for( i = 0; i <= rec->count; i++ )
+    {
+        _libmsi_free_field( &rec->fields[i] );
+        rec->fields[i].type = LIBMSI_FIELD_TYPE_NULL;
+        rec->fields[i].u.iVal = 0;
+    }
+
+    if( rec->shared )
+    {
+        g_bytes_unref( rec->shared );
+        rec->shared = NULL;
+    }
+}
+
 unsigned _libmsi_record_get_string(const LibmsiRecord *rec, unsigned field,
                char *szValue, unsigned *pcchValue)
 {
@@ -414,6 +565,8 @@ unsigned _libmsi_record_get_string(const LibmsiRecord *rec, unsigned field,
             strcpyn(szValue, buffer, *pcchValue);
         break;
     case LIBMSI_FIELD_TYPE_STR:
+    case LIBMSI_FIELD_TYPE_STR_SHARED:
+    case LIBMSI_FIELD_TYPE_STR_BORROWED:
         len = strlen( rec->fields[field].u.szVal );
         if (szValue)
             strcpyn(szValue, rec->fields[field].u.szVal, *pcchValue);
@@ -472,12 +625,149 @@ libmsi_record_set_string (LibmsiRecord *rec, unsigned field, const char *szValue
     return TRUE;
 }
 
-/* read the data in a file into a memory-backed GsfInput */
+/* files from this size on are read when they are needed rather than
+ * copied into memory */
+#define STREAM_READ_SIZE (1024 * 1024)
+
+/* a large file added to a record; only its path and size are kept, and
+ * the file is opened when it is read and closed once it is read through,
+ * so that adding many files doesn't hold a descriptor for each of them */
+typedef struct
+{
+    GsfInput parent;
+
+    char *path;
+    GsfInput *file;
+    guint8 *buf;
+    size_t buf_size;
+} LibmsiFileInput;
+
+typedef struct
+{
+    GsfInputClass parent_class;
+} LibmsiFileInputClass;
+
+G_DEFINE_TYPE (LibmsiFileInput, libmsi_file_input, GSF_INPUT_TYPE);
+
+static GsfInput *
+libmsi_file_input_new (const char *path, gsf_off_t size)
+{
+    LibmsiFileInput *in = g_object_new (libmsi_file_input_get_type (), NULL);
+
+    /* the file may be read after the working directory changed */
+    if (g_path_is_absolute (path))
+        in->path = g_strdup (path);
+    else {
+        char *cwd = g_get_current_dir ();
+        in->path = g_build_filename (cwd, path, NULL);
+        g_free (cwd);
+    }
+    gsf_input_set_name (GSF_INPUT (in), path);
+    gsf_input_set_size (GSF_INPUT (in), size);
+    return GSF_INPUT (in);
+}
+
+static void
+libmsi_file_input_close (LibmsiFileInput *in)
+{
+    if (in->file) {
+        g_object_unref (in->file);
+        in->file = NULL;
+    }
+}
+
+static GsfInput *
+libmsi_file_input_dup (GsfInput *input, GError **err)
+{
+    LibmsiFileInput *in = (LibmsiFileInput *)input;
+
+    return libmsi_file_input_new (in->path, gsf_input_size (input));
+}
+
+static const guint8 *
+libmsi_file_input_read (GsfInput *input, size_t num_bytes, guint8 *buffer)
+{
+    LibmsiFileInput *in = (LibmsiFileInput *)input;
+    gsf_off_t pos = gsf_input_tell (input);
+
+    if (!in->file) {
+        in->file = gsf_input_stdio_new (in->path, NULL);
+        if (!in->file)
+            return NULL;
+
+        /* the file changed since it was added */
+        if (gsf_input_size (in->file) != gsf_input_size (input) ||
+            gsf_input_seek (in->file, pos, G_SEEK_SET)) {
+            libmsi_file_input_close (in);
+            return NULL;
+        }
+    }
+
+    /* the data must outlive the file, which is closed at its end */
+    if (!buffer) {
+        if (in->buf_size < num_bytes) {
+            g_free (in->buf);
+            in->buf = g_try_malloc (num_bytes);
+            in->buf_size = in->buf ? num_bytes : 0;
+            if (!in->buf)
+                return NULL;
+        }
+        buffer = in->buf;
+    }
+
+    if (!gsf_input_read (in->file, num_bytes, buffer))
+        return NULL;
+
+    if (pos + num_bytes == gsf_input_size (input))
+        libmsi_file_input_close (in);
+    return buffer;
+}
+
+/* the file is opened again at the new position when it is next read */
+static gboolean
+libmsi_file_input_seek (GsfInput *input, gsf_off_t offset, GSeekType whence)
+{
+    libmsi_file_input_close ((LibmsiFileInput *)input);
+    return FALSE;
+}
+
+static void
+libmsi_file_input_finalize (GObject *object)
+{
+    LibmsiFileInput *in = (LibmsiFileInput *)object;
+
+    libmsi_file_input_close (in);
+    g_free (in->path);
+    g_free (in->buf);
+
+    G_OBJECT_CLASS (libmsi_file_input_parent_class)->finalize (object);
+}
+
+static void
+libmsi_file_input_init (LibmsiFileInput *in)
+{
+}
+
+static void
+libmsi_file_input_class_init (LibmsiFileInputClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+    GsfInputClass *input_class = GSF_INPUT_CLASS (klass);
+
+    object_class->finalize = libmsi_file_input_finalize;
+    input_class->Dup = libmsi_file_input_dup;
+    input_class->Read = libmsi_file_input_read;
+    input_class->Seek = libmsi_file_input_seek;
+}
+
+/* read the data in a small file into a memory-backed GsfInput; large
+ * files are only opened when they are read, usually when the database
+ * is committed */
 static unsigned _libmsi_addstream_from_file(const char *szFile, GsfInput **pstm)
 {
     GsfInput *stm;
     guint8 *data;
-    off_t sz;
+    gsf_off_t sz;
 
     stm = gsf_input_stdio_new(szFile, NULL);
     if (!stm)
@@ -487,6 +777,15 @@ static unsigned _libmsi_addstream_from_file(const char *szFile, GsfInput **pstm)
     }
 
     sz = gsf_input_size(stm);
+    if (sz >= STREAM_READ_SIZE)
+    {
+        g_object_unref(G_OBJECT(stm));
+        *pstm = libmsi_file_input_new(szFile, sz);
+        TRACE("%s, %" G_GINT64_FORMAT " bytes, is read through GsfInput %p\n",
+              debugstr_a(szFile), (gint64)sz, *pstm);
+        return LIBMSI_RESULT_SUCCESS;
+    }
+
     if (sz == 0)
     {
         data = g_malloc(1);
@@ -495,7 +794,10 @@ static unsigned _libmsi_addstream_from_file(const char *szFile, GsfInput **pstm)
     {
         data = g_try_malloc(sz);
         if (!data)
+        {
+            g_object_unref(G_OBJECT(stm));
             return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+        }
 
         if (!gsf_input_read(stm, sz, data))
         {
@@ -507,7 +809,54 @@ static unsigned _libmsi_addstream_from_file(const char *szFile, GsfInput **pstm)
     g_object_unref(G_OBJECT(stm));
     *pstm = gsf_input_memory_new(data, sz, true);
 
-    TRACE("read %s, %" PRIdMAX " bytes into GsfInput %p\n", debugstr_a(szFile), sz, *pstm);
+    TRACE("read %s, %" G_GINT64_FORMAT " bytes into GsfInput %p\n", debugstr_a(szFile), (gint64)sz, *pstm);
+
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+/* sets a stream field that opens a copy of stm on first use */
+void _libmsi_record_set_stream_ref( LibmsiRecord *rec, unsigned field, GsfInput *stm,
+                                    const char *name )
+{
+    LibmsiStreamRef *ref;
+
+    if( field > rec->count )
+        return;
+
+    _libmsi_free_field( &rec->fields[field] );
+
+    ref = stream_ref_new( stm, name );
+    if( !ref )
+        return;
+
+    rec->fields[field].type = LIBMSI_FIELD_TYPE_STREAM_REF;
+    rec->fields[field].u.ref = ref;
+}
+
+static unsigned resolve_stream_ref( LibmsiField *field )
+{
+    LibmsiStreamRef *ref;
+    GsfInput *stm;
+
+    if( field->type != LIBMSI_FIELD_TYPE_STREAM_REF )
+        return LIBMSI_RESULT_SUCCESS;
+
+    ref = field->u.ref;
+    stm = gsf_input_dup( ref->stm, NULL );
+    if( !stm )
+    {
+        TRACE("failed to open stream %s\n", debugstr_a(ref->name));
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+    }
+
+    gsf_input_seek( stm, 0, G_SEEK_SET );
+
+    TRACE("opened stream %s\n", debugstr_a(ref->name));
+
+    g_object_set_data_full( G_OBJECT(stm), "stname", g_strdup( ref->name ), g_free );
+    stream_ref_free( ref );
+    field->type = LIBMSI_FIELD_TYPE_STREAM;
+    field->u.stream = stm;
 
     return LIBMSI_RESULT_SUCCESS;
 }
@@ -535,6 +884,10 @@ unsigned _libmsi_record_load_stream_from_file(LibmsiRecord *rec, unsigned field,
     /* no filename means we should seek back to the start of the stream */
     if( !szFilename )
     {
+        r = resolve_stream_ref( &rec->fields[field] );
+        if( r != LIBMSI_RESULT_SUCCESS )
+            return r;
+
         if( rec->fields[field].type != LIBMSI_FIELD_TYPE_STREAM )
             return LIBMSI_RESULT_INVALID_FIELD;
 
@@ -564,7 +917,9 @@ unsigned _libmsi_record_load_stream_from_file(LibmsiRecord *rec, unsigned field,
  * @field: a field identifier
  * @filename: a filename or %NULL
  *
- * Load the file content as a stream in @field.
+ * Load the file content as a stream in @field.  Large files are only read
+ * when the database the record is inserted into is committed, so they
+ * should not be modified until then.
  *
  * Returns: %TRUE on success.
  **/
@@ -644,6 +999,11 @@ _libmsi_record_get_stream (LibmsiRecord *rec, unsigned field, GError **error)
         return NULL;
     }
 
+    if (resolve_stream_ref (&rec->fields[field]) != LIBMSI_RESULT_SUCCESS) {
+        g_set_error (error, LIBMSI_RESULT_ERROR, LIBMSI_RESULT_FUNCTION_FAILED, G_STRFUNC);
+        return NULL;
+    }
+
     if (rec->fields[field].type != LIBMSI_FIELD_TYPE_STREAM) {
         g_set_error (error, LIBMSI_RESULT_ERROR, LIBMSI_RESULT_INVALID_DATATYPE, G_STRFUNC);
         return NULL;
@@ -697,13 +1057,30 @@ unsigned _libmsi_record_set_gsf_input( LibmsiRecord *rec, unsigned field, GsfInp
     return LIBMSI_RESULT_SUCCESS;
 }
 
+/* tells streams apart without opening them */
+bool _libmsi_record_is_stream( const LibmsiRecord *rec, unsigned field )
+{
+    if( field > rec->count )
+        return false;
+
+    return rec->fields[field].type == LIBMSI_FIELD_TYPE_STREAM ||
+           rec->fields[field].type == LIBMSI_FIELD_TYPE_STREAM_REF;
+}
+
 unsigned _libmsi_record_get_gsf_input( const LibmsiRecord *rec, unsigned field, GsfInput **pstm)
 {
+    unsigned r;
+
     TRACE("%p %d %p\n", rec, field, pstm);
 
     if( field > rec->count )
         return LIBMSI_RESULT_INVALID_FIELD;
 
+    /* opening the stream doesn't change the value of the field */
+    r = resolve_stream_ref( (LibmsiField *)&rec->fields[field] );
+    if( r != LIBMSI_RESULT_SUCCESS )
+        return r;
+
     if( rec->fields[field].type != LIBMSI_FIELD_TYPE_STREAM )
         return LIBMSI_RESULT_INVALID_FIELD;
 
@@ -753,6 +1130,9 @@ LibmsiRecord *_libmsi_record_clone(LibmsiRecord *rec)
 G_GNUC_PURE
 bool _libmsi_record_compare_fields(const LibmsiRecord *a, const LibmsiRecord *b, unsigned field)
 {
+    if (FIELD_IS_STRING(a->fields[field].type) && FIELD_IS_STRING(b->fields[field].type))
+        return !strcmp(a->fields[field].u.szVal, b->fields[field].u.szVal);
+
     if (a->fields[field].type != b->fields[field].type)
         return false;
 
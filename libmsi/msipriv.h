@@ -85,6 +85,30 @@ typedef struct string_table string_table;
 #define MSI_INITIAL_MEDIA_TRANSFORM_OFFSET 10000
 #define MSI_INITIAL_MEDIA_TRANSFORM_DISKID 30000
 
+/* an entry of the streams or storages of a database */
+typedef struct _LibmsiDirEntry
+{
+    char *name;             /* the name in the file */
+    const char *key;        /* the name shown by _Streams and _Storages */
+    unsigned index;         /* the row in those views */
+    unsigned id;            /* the string id of key, once interned */
+} LibmsiDirEntry;
+
+typedef struct _LibmsiDirectory
+{
+    GPtrArray *entries;     /* in the order they were added */
+    GHashTable *names;      /* key -> entry */
+    bool interned;          /* the keys are in the string table */
+} LibmsiDirectory;
+
+/* both directions of the stream name encoding, kept for the database lifetime */
+typedef struct _LibmsiNameCache
+{
+    GHashTable *decoded;    /* encoded name -> decoded name */
+    GHashTable *streams;    /* decoded stream name -> encoded name */
+    GHashTable *tables;     /* table name -> encoded name */
+} LibmsiNameCache;
+
 struct _LibmsiDatabase
 {
     GObject parent;
@@ -101,8 +125,10 @@ struct _LibmsiDatabase
     unsigned media_transform_disk_id;
     struct list tables;
     struct list transforms;
-    struct list streams;
-    struct list storages;
+    LibmsiDirectory streams;
+    LibmsiDirectory storages;
+    LibmsiNameCache names;
+    struct list attached;
 };
 
 typedef struct _LibmsiView LibmsiView;
@@ -116,8 +142,17 @@ struct _LibmsiQuery
     LibmsiDatabase *database;
     gchar *query;
     struct list mem;
+    unsigned *col_types;  /* resolved on first use by the batch and cursor fetches */
+    unsigned col_count;
+
+    /* wall time spent in each phase, in microseconds */
+    gint64 prepare_time;
+    gint64 execute_time;
+    gint64 fetch_time;
 };
 
+typedef struct _LibmsiStreamRef LibmsiStreamRef;
+
 /* maybe we can use a Variant instead of doing it ourselves? */
 typedef struct _LibmsiField
 {
@@ -127,6 +162,7 @@ typedef struct _LibmsiField
         int iVal;
         char *szVal;
         GsfInput *stream;
+        LibmsiStreamRef *ref;
     } u;
 } LibmsiField;
 
@@ -136,6 +172,8 @@ struct _LibmsiRecord
 
     unsigned count;       /* as passed to libmsi_record_new */
     LibmsiField *fields;  /* nb. array size is count+1 */
+    GBytes *shared;       /* backs the fields set by _libmsi_record_set_shared_string */
+    string_table *strings; /* backs the fields set by _libmsi_record_set_borrowed_string */
 };
 
 typedef struct _column_info
@@ -144,6 +182,7 @@ typedef struct _column_info
     const char *column;
     int   type;
     bool   temporary;
+    unsigned aggregate;
     struct expr *val;
     struct _column_info *next;
 } column_info;
@@ -267,6 +306,61 @@ typedef struct _LibmsiViewOps
      * drop - drops the table from the database
      */
     unsigned (*drop)( LibmsiView *view );
+
+    /*
+     * explain - describes the view for EXPLAIN and libmsi_query_get_stats
+     *
+     *  Appends one line, indented by depth, with what the view did
+     *   during the last execution, followed by the views it reads from.
+     */
+    void (*explain)( LibmsiView *view, GString *str, unsigned depth );
+
+    /*
+     * insert_rows - inserts a batch of new rows from the records contents
+     *
+     *  rows[i] is the position requested for records[i], as for insert_row.
+     *  The keys of the whole batch are validated before any row is added.
+     */
+    unsigned (*insert_rows)( LibmsiView *view, LibmsiRecord **records, const unsigned *rows,
+                             unsigned count, bool temporary );
+
+    /*
+     * insert_encoded - inserts a batch of new rows given as encoded values
+     *
+     *  values holds count rows of one value per column, as returned by
+     *   fetch_int, so strings are ids already in the string table.
+     */
+    unsigned (*insert_encoded)( LibmsiView *view, unsigned *values, unsigned count, bool temporary );
+
+    /*
+     * fetch_column_range - reads the encoded values of a column for a range of rows
+     *
+     *  Stores into out what fetch_int would return for each of the count
+     *   rows from first.  Use msi_view_fetch_column_range, which falls back
+     *   to fetch_int for views that don't implement this.
+     */
+    unsigned (*fetch_column_range)( LibmsiView *view, unsigned col, unsigned first,
+                                    unsigned count, unsigned *out );
+
+    /*
+     * fetch_stream_name - names the stream of a binary column without opening it
+     *
+     *  Returns the database holding the stream and its decoded and encoded
+     *   names, which stay valid until the table is changed.  Use
+     *   msi_view_fetch_stream_name, which fails for views that don't
+     *   implement this so that the caller can use fetch_stream instead.
+     */
+    unsigned (*fetch_stream_name)( LibmsiView *view, unsigned row, unsigned col,
+                                   LibmsiDatabase **db, const char **name, const char **encname );
+
+    /*
+     * fetch_string - gets the text of a string column that is not in the string table
+     *
+     *  For views that make up their own strings; the string stays valid
+     *   until the view is executed again or deleted.  The string columns of
+     *   views without it hold string ids, read with fetch_int.
+     */
+    unsigned (*fetch_string)( LibmsiView *view, unsigned row, unsigned col, const char **str );
 } LibmsiViewOps;
 
 struct _LibmsiView
@@ -345,10 +439,20 @@ enum StringPersistence
 
 extern int _libmsi_add_string( string_table *st, const char *data, int len, uint16_t refcount, enum StringPersistence persistence );
 extern unsigned _libmsi_id_from_string_utf8( const string_table *st, const char *buffer, unsigned *id );
+extern unsigned _libmsi_add_string_ref( string_table *st, unsigned id, enum StringPersistence persistence );
+extern unsigned msi_string_intern_many( string_table *st, const char **strs, unsigned count,
+                                        unsigned *ids, unsigned *added, unsigned *num_added,
+                                        enum StringPersistence persistence );
+extern void msi_string_release_many( string_table *st, const unsigned *ids, unsigned count,
+                                     enum StringPersistence persistence );
+extern string_table *msi_string_table_ref( string_table *st );
 extern void msi_destroy_stringtable( string_table *st );
 extern const char *msi_string_lookup_id( const string_table *st, unsigned id );
+extern unsigned msi_string_count( const string_table *st );
+extern bool msi_string_has_duplicates( const string_table *st );
+extern uint32_t *msi_string_find_prefix( const string_table *st, const char *prefix, unsigned *size );
 extern string_table *msi_init_string_table( unsigned *bytes_per_strref );
-extern string_table *msi_load_string_table( GsfInfile *stg, unsigned *bytes_per_strref );
+extern string_table *msi_load_string_table( LibmsiDatabase *db, GsfInfile *stg, unsigned *bytes_per_strref );
 extern unsigned msi_save_string_table( const string_table *st, LibmsiDatabase *db, unsigned *bytes_per_strref );
 extern unsigned msi_get_string_table_codepage( const string_table *st );
 extern unsigned msi_set_string_table_codepage( string_table *st, unsigned codepage );
@@ -357,13 +461,16 @@ unsigned _libmsi_open_table( LibmsiDatabase *db, const char *name, bool encoded
 extern bool table_view_exists( LibmsiDatabase *db, const char *name );
 extern LibmsiCondition _libmsi_database_is_table_persistent( LibmsiDatabase *db, const char *table );
 
-extern unsigned read_stream_data( GsfInfile *stg, const char *stname,
+extern unsigned read_stream_data( LibmsiDatabase *db, GsfInfile *stg, const char *stname,
                               uint8_t **pdata, unsigned *psz );
 extern unsigned write_stream_data( LibmsiDatabase *db, const char *stname,
                                const void *data, unsigned sz );
 extern unsigned write_raw_stream_data( LibmsiDatabase *db, const char *stname,
                         const void *data, unsigned sz, GsfInput **outstm );
 extern unsigned _libmsi_database_commit_streams( LibmsiDatabase *db );
+extern void msi_load_all_tables( LibmsiDatabase *db );
+extern void msi_run_jobs( GFunc func, gpointer *jobs, unsigned count );
+extern GsfInput *msi_open_file_input( const char *path, bool map );
 
 /* transform functions */
 extern unsigned msi_table_apply_transform( LibmsiDatabase *db, GsfInfile *stg );
@@ -376,7 +483,12 @@ extern unsigned _libmsi_database_commit_storages( LibmsiDatabase *db );
 extern void _libmsi_record_destroy( LibmsiRecord * );
 extern unsigned _libmsi_record_set_gsf_input( LibmsiRecord *, unsigned, GsfInput *);
 extern unsigned _libmsi_record_get_gsf_input( const LibmsiRecord *, unsigned, GsfInput **);
+extern bool _libmsi_record_is_stream( const LibmsiRecord *, unsigned );
+extern void _libmsi_record_set_stream_ref( LibmsiRecord *, unsigned, GsfInput *, const char *);
 extern const char *_libmsi_record_get_string_raw( const LibmsiRecord *, unsigned );
+extern void _libmsi_record_set_shared_string( LibmsiRecord *, unsigned, const char *, GBytes * );
+extern void _libmsi_record_set_borrowed_string( LibmsiRecord *, unsigned, const char *, string_table * );
+extern void _libmsi_record_reset( LibmsiRecord * );
 extern unsigned _libmsi_record_get_string( const LibmsiRecord *, unsigned, char *, unsigned *);
 extern unsigned _libmsi_record_save_stream( const LibmsiRecord *, unsigned, char *, unsigned *);
 extern unsigned _libmsi_record_load_stream(LibmsiRecord *, unsigned, GsfInput *);
@@ -387,24 +499,39 @@ extern bool _libmsi_record_compare( const LibmsiRecord *, const LibmsiRecord * )
 extern bool _libmsi_record_compare_fields(const LibmsiRecord *a, const LibmsiRecord *b, unsigned field);
 
 /* stream internals */
-extern void enum_stream_names( GsfInfile *stg );
+extern void enum_stream_names( LibmsiDatabase *db, GsfInfile *stg );
 extern char *encode_streamname(bool bTable, const char *in);
 extern char *decode_streamname(const char *in);
+extern const char *msi_db_encode_streamname( LibmsiDatabase *db, bool bTable, const char *in );
+extern const char *msi_db_decode_streamname( LibmsiDatabase *db, const char *in );
 
 /* database internals */
 extern LibmsiResult _libmsi_database_start_transaction(LibmsiDatabase *db);
 extern LibmsiResult _libmsi_database_open(LibmsiDatabase *db);
 extern LibmsiResult _libmsi_database_close(LibmsiDatabase *db, bool committed);
+extern unsigned _libmsi_database_attach( LibmsiDatabase *db, LibmsiDatabase *other, const char *alias );
+extern void _libmsi_database_reload_attached( LibmsiDatabase *db );
+extern void _libmsi_database_free_attached( LibmsiDatabase *db );
 unsigned msi_create_stream( LibmsiDatabase *db, const char *stname, GsfInput *stm );
 extern unsigned msi_get_raw_stream( LibmsiDatabase *, const char *, GsfInput **);
+extern unsigned msi_peek_raw_stream( LibmsiDatabase *, const char *, GsfInput **);
 void msi_destroy_stream( LibmsiDatabase *, const char * );
 extern unsigned msi_enum_db_streams(LibmsiDatabase *, unsigned (*fn)(const char *, GsfInput *, void *), void *);
 unsigned msi_create_storage( LibmsiDatabase *db, const char *stname, GsfInput *stm );
 unsigned msi_open_storage( LibmsiDatabase *db, const char *stname );
 void msi_destroy_storage( LibmsiDatabase *db, const char *stname );
 extern unsigned msi_enum_db_storages(LibmsiDatabase *, unsigned (*fn)(const char *, GsfInfile *, void *), void *);
+extern void msi_db_intern_streams( LibmsiDatabase * );
+extern unsigned msi_db_stream_count( LibmsiDatabase * );
+extern const char *msi_db_stream_name( LibmsiDatabase *, unsigned, unsigned *, GsfInput ** );
+extern bool msi_db_find_stream( LibmsiDatabase *, const char *, unsigned * );
+extern void msi_db_intern_storages( LibmsiDatabase * );
+extern unsigned msi_db_storage_count( LibmsiDatabase * );
+extern const char *msi_db_storage_name( LibmsiDatabase *, unsigned, unsigned * );
+extern bool msi_db_find_storage( LibmsiDatabase *, const char *, unsigned * );
 extern unsigned _libmsi_database_open_query(LibmsiDatabase *, const char *, LibmsiQuery **);
 extern unsigned _libmsi_query_open( LibmsiDatabase *, LibmsiQuery **, const char *, ... ) G_GNUC_PRINTF(3,4);
+/* the record is refilled for the next row, use _libmsi_record_clone to keep it */
 typedef unsigned (*record_func)( LibmsiRecord *, void *);
 extern unsigned _libmsi_query_iterate_records( LibmsiQuery *, unsigned *, record_func, void *);
 extern LibmsiRecord *_libmsi_query_get_record( LibmsiDatabase *db, const char *query, ... ) G_GNUC_PRINTF(2,3);
@@ -416,6 +543,14 @@ extern LibmsiResult _libmsi_query_fetch( LibmsiQuery*, LibmsiRecord ** );
 extern LibmsiResult _libmsi_query_get_column_info(LibmsiQuery *, LibmsiColInfo, LibmsiRecord **);
 extern unsigned _libmsi_view_find_column( LibmsiView *, const char *, const char *, unsigned *);
 extern unsigned msi_view_get_row(LibmsiDatabase *, LibmsiView *, unsigned, LibmsiRecord **);
+extern unsigned msi_view_fill_row(LibmsiDatabase *, LibmsiView *, unsigned, LibmsiRecord *);
+extern void msi_view_explain(LibmsiView *, GString *, unsigned);
+extern unsigned msi_view_fetch_column_range(LibmsiView *, unsigned, unsigned, unsigned, unsigned *);
+extern unsigned msi_view_fetch_stream_name(LibmsiView *, unsigned, unsigned, LibmsiDatabase **,
+                                           const char **, const char **);
+
+/* rows read at a time by scans that use msi_view_fetch_column_range */
+#define MSI_FETCH_ROWS 256
 
 /* summary information */
 extern unsigned msi_add_suminfo( LibmsiDatabase *db, char ***records, int num_records, int num_columns );
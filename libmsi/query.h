@@ -39,6 +39,7 @@
 #define OP_NE       8
 #define OP_ISNULL   9
 #define OP_NOTNULL  10
+#define OP_LIKE     11
 
 #define EXPR_COMPLEX  1
 #define EXPR_COLUMN   2
@@ -51,12 +52,28 @@
 #define EXPR_COL_NUMBER_STRING 10
 #define EXPR_COL_NUMBER32 11
 #define EXPR_UNARY    12
+#define EXPR_LIKE     13
+#define EXPR_PREFIX   14
+
+#define AGGREGATE_NONE        0
+#define AGGREGATE_COUNT_STAR  1
+#define AGGREGATE_COUNT       2
+#define AGGREGATE_MIN         3
+#define AGGREGATE_MAX         4
 
 struct sql_str {
     const char *data;
     int len;
 };
 
+/* one parenthesised row of an INSERT ... VALUES list */
+typedef struct _value_list
+{
+    column_info *vals;
+    struct _value_list *next;
+    struct _value_list *tail;   /* last row, only set on the first one */
+} value_list;
+
 struct complex_expr
 {
     unsigned op;
@@ -64,6 +81,15 @@ struct complex_expr
     struct expr *right;
 };
 
+/* a LIKE pattern of the form 'prefix%', resolved against the string table */
+struct prefix_expr
+{
+    const char *str;
+    unsigned len;
+    uint32_t *ids;      /* bitmap of the string ids starting with str */
+    unsigned size;      /* number of string ids covered by ids */
+};
+
 struct tagJOINTABLE;
 union ext_column
 {
@@ -89,19 +115,41 @@ struct expr
         unsigned  uval;
         const char *sval;
         union ext_column column;
+        struct prefix_expr prefix;
     } u;
 };
 
+/* a token of a script, located by its offset in the script text */
+struct sql_token
+{
+    int type;
+    unsigned offset;
+    unsigned len;
+    unsigned skip;
+};
+
 unsigned _libmsi_parse_sql( LibmsiDatabase *db, const char *command, LibmsiView **phview,
                    struct list *mem );
 
+unsigned _libmsi_parse_sql_tokens( LibmsiDatabase *db, const char *command,
+                   const struct sql_token *tokens, unsigned count,
+                   LibmsiView **phview, struct list *mem );
+
 unsigned table_view_create( LibmsiDatabase *db, const char *name, LibmsiView **view );
+unsigned msi_table_load_text_rows( LibmsiView *view, char **fields, unsigned count );
+
+bool msi_view_is_table( const LibmsiView *view );
 
 unsigned select_view_create( LibmsiDatabase *db, LibmsiView **view, LibmsiView *table,
                         const column_info *columns );
 
 unsigned distinct_view_create( LibmsiDatabase *db, LibmsiView **view, LibmsiView *table );
 
+unsigned explain_view_create( LibmsiDatabase *db, LibmsiView **view, LibmsiView *table );
+
+unsigned aggregate_view_create( LibmsiDatabase *db, LibmsiView **view, LibmsiView *table,
+                            const column_info *columns, const column_info *group );
+
 unsigned order_view_create( LibmsiDatabase *db, LibmsiView **view, LibmsiView *table,
                        column_info *columns );
 
@@ -112,7 +160,10 @@ unsigned create_view_create( LibmsiDatabase *db, LibmsiView **view, const char *
                         column_info *col_info, bool hold );
 
 unsigned insert_view_create( LibmsiDatabase *db, LibmsiView **view, const char *table,
-                        column_info *columns, column_info *values, bool temp );
+                        column_info *columns, value_list *values, bool temp );
+
+unsigned insert_select_view_create( LibmsiDatabase *db, LibmsiView **view, const char *table,
+                        column_info *columns, LibmsiView *source, bool temp );
 
 unsigned update_view_create( LibmsiDatabase *db, LibmsiView **view, char *table,
                         column_info *list, struct expr *expr );
@@ -125,10 +176,18 @@ unsigned streams_view_create( LibmsiDatabase *db, LibmsiView **view );
 
 unsigned storages_view_create( LibmsiDatabase *db, LibmsiView **view );
 
+unsigned attached_view_create( LibmsiDatabase *db, const char *name, LibmsiView **view );
+
 unsigned drop_view_create( LibmsiDatabase *db, LibmsiView **view, const char *name );
 
 int sql_get_token(const char *z, int *tokenType, int *skip);
 
+unsigned sql_tokenize(const char *z, struct sql_token **tokens);
+
+bool sql_starts_statement(const struct sql_token *tokens, unsigned i);
+
+bool sql_changes_schema(const struct sql_token *tokens);
+
 LibmsiRecord *msi_query_merge_record( unsigned fields, const column_info *vl, LibmsiRecord *rec );
 
 unsigned msi_create_table( LibmsiDatabase *db, const char *name, column_info *col_info,
@@ -61,6 +61,28 @@ static unsigned select_view_fetch_int( LibmsiView *view, unsigned row, unsigned
     return sv->table->ops->fetch_int( sv->table, row, col, val );
 }
 
+static unsigned select_view_fetch_column_range( LibmsiView *view, unsigned col, unsigned first,
+                                                unsigned count, unsigned *out )
+{
+    LibmsiSelectView *sv = (LibmsiSelectView*)view;
+
+    TRACE("%p %d %d %d %p\n", sv, col, first, count, out );
+
+    if( !sv->table )
+         return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    if( !col || col > sv->num_cols )
+         return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    col = sv->cols[ col - 1 ];
+    if( !col )
+    {
+        memset( out, 0, count * sizeof(*out) );
+        return LIBMSI_RESULT_SUCCESS;
+    }
+    return msi_view_fetch_column_range( sv->table, col, first, count, out );
+}
+
 static unsigned select_view_fetch_stream( LibmsiView *view, unsigned row, unsigned col, GsfInput **stm)
 {
     LibmsiSelectView *sv = (LibmsiSelectView*)view;
@@ -82,6 +104,20 @@ static unsigned select_view_fetch_stream( LibmsiView *view, unsigned row, unsign
     return sv->table->ops->fetch_stream( sv->table, row, col, stm );
 }
 
+static unsigned select_view_fetch_stream_name( LibmsiView *view, unsigned row, unsigned col,
+                                               LibmsiDatabase **db, const char **name,
+                                               const char **encname )
+{
+    LibmsiSelectView *sv = (LibmsiSelectView*)view;
+
+    TRACE("%p %d %d\n", sv, row, col );
+
+    if( !sv->table || !col || col > sv->num_cols || !sv->cols[ col - 1 ] )
+         return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    return msi_view_fetch_stream_name( sv->table, row, sv->cols[ col - 1 ], db, name, encname );
+}
+
 static unsigned select_view_get_row( LibmsiView *view, unsigned row, LibmsiRecord **rec )
 {
     LibmsiSelectView *sv = (LibmsiSelectView *)view;
@@ -268,6 +304,15 @@ static unsigned select_view_find_matching_rows( LibmsiView *view, unsigned col,
 }
 
 
+static void select_view_explain( LibmsiView *view, GString *str, unsigned depth )
+{
+    LibmsiSelectView *sv = (LibmsiSelectView*)view;
+
+    g_string_append_printf( str, "%*sSELECT columns=%u\n", depth * 2, "", sv->num_cols );
+    if( sv->table )
+        msi_view_explain( sv->table, str, depth + 1 );
+}
+
 static const LibmsiViewOps select_ops =
 {
     select_view_fetch_int,
@@ -288,6 +333,12 @@ static const LibmsiViewOps select_ops =
     NULL,
     NULL,
     NULL,
+    select_view_explain,
+    NULL,
+    NULL,
+    select_view_fetch_column_range,
+    select_view_fetch_stream_name,
+    NULL,
 };
 
 static unsigned select_view_add_column( LibmsiSelectView *sv, const char *name,
@@ -42,6 +42,8 @@ typedef struct _LibmsiSQLInput
     LibmsiDatabase *db;
     const char *command;
     unsigned n, len;
+    const struct sql_token *tokens; /* already split, for scripts */
+    unsigned token, token_count;
     unsigned r;
     LibmsiView **view;  /* View structure for the resulting query.  This value
                       * tracks the view currently being created so we can free
@@ -55,8 +57,11 @@ static int sql_atoi( void *info );
 static int sql_lex( void *SQL_lval, SQL_input *info );
 
 static char *parser_add_table( void *info, const char *list, const char *table );
+static char *parser_qualify_table( void *info, const char *alias, const char *table );
 static void *parser_alloc( void *info, unsigned int sz );
 static column_info *parser_alloc_column( void *info, const char *table, const char *column );
+static column_info *parser_alloc_aggregate( void *info, const char *function, column_info *column );
+static bool parser_has_aggregate( const column_info *columns );
 
 static bool sql_mark_primary_keys( column_info **cols, column_info *keys);
 
@@ -83,6 +88,7 @@ static struct expr * build_expr_wildcard( void *info );
     struct sql_str str;
     char *string;
     column_info *column_list;
+    value_list *value_list;
     LibmsiView *query;
     struct expr *expr;
     uint16_t column_type;
@@ -90,7 +96,7 @@ static struct expr * build_expr_wildcard( void *info );
 }
 
 %token TK_ALTER TK_AND TK_BY TK_CHAR TK_COMMA TK_CREATE TK_DELETE TK_DROP
-%token TK_DISTINCT TK_DOT TK_EQ TK_FREE TK_FROM TK_GE TK_GT TK_HOLD TK_ADD
+%token TK_DISTINCT TK_DOT TK_EQ TK_EXPLAIN TK_FREE TK_FROM TK_GE TK_GROUP TK_GT TK_HOLD TK_ADD
 %token <str> TK_ID
 %token TK_ILLEGAL TK_INSERT TK_INT
 %token <str> TK_INTEGER
@@ -110,11 +116,13 @@ static struct expr * build_expr_wildcard( void *info );
 %nonassoc END_OF_FILE ILLEGAL SPACE UNCLOSED_STRING COMMENT FUNCTION
           COLUMN AGG_FUNCTION.
 
-%type <string> table tablelist id string
+%type <string> table tablelist fromtable id string
 %type <column_list> selcollist collist selcolumn column column_and_type column_def table_def
 %type <column_list> column_assignment update_assign_list constlist
+%type <value_list> valuelist
 %type <query> query from selectfrom unorderdfrom
 %type <query> oneupdate onedelete oneselect onequery onecreate oneinsert onealter onedrop
+%type <query> oneexplain
 %type <expr> expr val column_val const_val
 %type <column_type> column_type data_type data_type_l data_count
 %type <integer> number alterop
@@ -143,26 +151,53 @@ onequery:
   | onedelete
   | onealter
   | onedrop
+  | oneexplain
+    ;
+
+oneexplain:
+    TK_EXPLAIN oneselect
+        {
+            SQL_input* sql = (SQL_input*) info;
+            LibmsiView* explain = NULL;
+            unsigned r;
+
+            r = explain_view_create( sql->db, &explain, $2 );
+            if (r != LIBMSI_RESULT_SUCCESS)
+                YYABORT;
+
+            PARSER_BUBBLE_UP_VIEW( sql, $$, explain );
+        }
     ;
 
 oneinsert:
-    TK_INSERT TK_INTO table TK_LP collist TK_RP TK_VALUES TK_LP constlist TK_RP
+    TK_INSERT TK_INTO table TK_LP collist TK_RP TK_VALUES valuelist
+        {
+            SQL_input *sql = (SQL_input*) info;
+            LibmsiView *insert = NULL;
+
+            insert_view_create( sql->db, &insert, $3, $5, $8, false );
+            if( !insert )
+                YYABORT;
+
+            PARSER_BUBBLE_UP_VIEW( sql, $$,  insert );
+        }
+  | TK_INSERT TK_INTO table TK_LP collist TK_RP TK_VALUES valuelist TK_TEMPORARY
         {
             SQL_input *sql = (SQL_input*) info;
             LibmsiView *insert = NULL;
 
-            insert_view_create( sql->db, &insert, $3, $5, $9, false );
+            insert_view_create( sql->db, &insert, $3, $5, $8, true );
             if( !insert )
                 YYABORT;
 
             PARSER_BUBBLE_UP_VIEW( sql, $$,  insert );
         }
-  | TK_INSERT TK_INTO table TK_LP collist TK_RP TK_VALUES TK_LP constlist TK_RP TK_TEMPORARY
+  | TK_INSERT TK_INTO table TK_LP collist TK_RP oneselect
         {
             SQL_input *sql = (SQL_input*) info;
             LibmsiView *insert = NULL;
 
-            insert_view_create( sql->db, &insert, $3, $5, $9, true );
+            insert_select_view_create( sql->db, &insert, $3, $5, $7, false );
             if( !insert )
                 YYABORT;
 
@@ -170,6 +205,30 @@ oneinsert:
         }
     ;
 
+/* left recursive, so that long lists don't pile up on the parser stack */
+valuelist:
+    TK_LP constlist TK_RP
+        {
+            $$ = parser_alloc( info, sizeof *$$ );
+            if( !$$ )
+                YYABORT;
+            $$->vals = $2;
+            $$->next = NULL;
+            $$->tail = $$;
+        }
+  | valuelist TK_COMMA TK_LP constlist TK_RP
+        {
+            value_list *row = parser_alloc( info, sizeof *row );
+            if( !row )
+                YYABORT;
+            row->vals = $4;
+            row->next = NULL;
+            $1->tail->next = row;
+            $1->tail = row;
+            $$ = $1;
+        }
+    ;
+
 onecreate:
     TK_CREATE TK_TABLE table TK_LP table_def TK_RP
         {
@@ -432,7 +491,15 @@ selectfrom:
             LibmsiView* select = NULL;
             unsigned r;
 
-            if( $1 )
+            if( $1 && parser_has_aggregate( $1 ) )
+            {
+                r = aggregate_view_create( sql->db, &select, $2, $1, NULL );
+                if (r != LIBMSI_RESULT_SUCCESS)
+                    YYABORT;
+
+                PARSER_BUBBLE_UP_VIEW( sql, $$, select );
+            }
+            else if( $1 )
             {
                 r = select_view_create( sql->db, &select, $2, $1 );
                 if (r != LIBMSI_RESULT_SUCCESS)
@@ -443,6 +510,21 @@ selectfrom:
             else
                 $$ = $2;
         }
+  | selcollist unorderdfrom TK_GROUP TK_BY collist
+        {
+            SQL_input* sql = (SQL_input*) info;
+            LibmsiView* aggregate = NULL;
+            unsigned r;
+
+            if( !$1 || !$5 )
+                YYABORT;
+
+            r = aggregate_view_create( sql->db, &aggregate, $2, $1, $5 );
+            if (r != LIBMSI_RESULT_SUCCESS)
+                YYABORT;
+
+            PARSER_BUBBLE_UP_VIEW( sql, $$, aggregate );
+        }
     ;
 
 selcollist:
@@ -470,7 +552,7 @@ collist:
     ;
 
 from:
-    TK_FROM table
+    TK_FROM fromtable
         {
             SQL_input* sql = (SQL_input*) info;
             LibmsiView* table = NULL;
@@ -526,11 +608,11 @@ unorderdfrom:
     ;
 
 tablelist:
-    table
+    fromtable
         {
             $$ = $1;
         }
-  | table TK_COMMA tablelist
+  | fromtable TK_COMMA tablelist
         {
             $$ = parser_add_table( info, $3, $1 );
             if (!$$)
@@ -593,6 +675,12 @@ expr:
             if( !$$ )
                 YYABORT;
         }
+  | column_val TK_LIKE val
+        {
+            $$ = build_expr_complex( info, $1, OP_LIKE, $3 );
+            if( !$$ )
+                YYABORT;
+        }
   | column_val TK_IS TK_NULL
         {
             $$ = build_expr_unary( info, $1, OP_ISNULL );
@@ -690,6 +778,15 @@ column:
             if( !$$ )
                 YYABORT;
         }
+  | table TK_DOT id TK_DOT id
+        {
+            char *table = parser_qualify_table( info, $1, $3 );
+            if( !table )
+                YYABORT;
+            $$ = parser_alloc_column( info, table, $5 );
+            if( !$$ )
+                YYABORT;
+        }
   | id
         {
             $$ = parser_alloc_column( info, NULL, $1 );
@@ -705,6 +802,15 @@ selcolumn:
             if( !$$ )
                 YYABORT;
         }
+  | table TK_DOT id TK_DOT id
+        {
+            char *table = parser_qualify_table( info, $1, $3 );
+            if( !table )
+                YYABORT;
+            $$ = parser_alloc_column( info, table, $5 );
+            if( !$$ )
+                YYABORT;
+        }
   | id
         {
             $$ = parser_alloc_column( info, NULL, $1 );
@@ -717,6 +823,18 @@ selcolumn:
             if( !$$ )
                 YYABORT;
         }
+  | id TK_LP TK_STAR TK_RP
+        {
+            $$ = parser_alloc_aggregate( info, $1, NULL );
+            if( !$$ )
+                YYABORT;
+        }
+  | id TK_LP column TK_RP
+        {
+            $$ = parser_alloc_aggregate( info, $1, $3 );
+            if( !$$ )
+                YYABORT;
+        }
     ;
 
 table:
@@ -726,6 +844,17 @@ table:
         }
     ;
 
+/* a table of the database, or alias.table for a table of an attached one */
+fromtable:
+    table
+  | table TK_DOT id
+        {
+            $$ = parser_qualify_table( info, $1, $3 );
+            if( !$$ )
+                YYABORT;
+        }
+    ;
+
 id:
     TK_ID
         {
@@ -767,6 +896,21 @@ static char *parser_add_table( void *info, const char *list, const char *table )
     return ret;
 }
 
+static char *parser_qualify_table( void *info, const char *alias, const char *table )
+{
+    unsigned len = strlen( alias ) + strlen( table ) + 2;
+    char *ret;
+
+    ret = parser_alloc( info, len * sizeof(char) );
+    if( ret )
+    {
+        strcpy( ret, alias );
+        strcat( ret, "." );
+        strcat( ret, table );
+    }
+    return ret;
+}
+
 static void *parser_alloc( void *info, unsigned int sz )
 {
     SQL_input* sql = (SQL_input*) info;
@@ -788,17 +932,65 @@ static column_info *parser_alloc_column( void *info, const char *table, const ch
         col->column = column;
         col->val = NULL;
         col->type = 0;
+        col->aggregate = AGGREGATE_NONE;
         col->next = NULL;
     }
 
     return col;
 }
 
+static column_info *parser_alloc_aggregate( void *info, const char *function, column_info *column )
+{
+    unsigned aggregate;
+
+    if( !g_ascii_strcasecmp( function, "COUNT" ) )
+        aggregate = column ? AGGREGATE_COUNT : AGGREGATE_COUNT_STAR;
+    else if( !g_ascii_strcasecmp( function, "MIN" ) && column )
+        aggregate = AGGREGATE_MIN;
+    else if( !g_ascii_strcasecmp( function, "MAX" ) && column )
+        aggregate = AGGREGATE_MAX;
+    else
+        return NULL;
+
+    if( !column )
+    {
+        column = parser_alloc_column( info, NULL, szEmpty );
+        if( !column )
+            return NULL;
+    }
+    column->aggregate = aggregate;
+    return column;
+}
+
+G_GNUC_PURE
+static bool parser_has_aggregate( const column_info *columns )
+{
+    for( ; columns; columns = columns->next )
+        if( columns->aggregate != AGGREGATE_NONE )
+            return true;
+    return false;
+}
+
 static int sql_lex( void *SQL_lval, SQL_input *sql )
 {
     int token, skip;
     struct sql_str * str = SQL_lval;
 
+    if( sql->tokens )
+    {
+        const struct sql_token *tok;
+
+        if( sql->token == sql->token_count )
+            return 0;  /* end of statement */
+
+        tok = &sql->tokens[sql->token++];
+        str->data = &sql->command[tok->offset];
+        str->len = tok->len;
+        sql->n = tok->offset + tok->skip;
+        sql->len = tok->len;
+        return tok->type;
+    }
+
     do
     {
         sql->n += sql->len;
@@ -997,8 +1189,9 @@ static bool sql_mark_primary_keys( column_info **cols,
     return found;
 }
 
-unsigned _libmsi_parse_sql( LibmsiDatabase *db, const char *command, LibmsiView **phview,
-                   struct list *mem )
+static unsigned parse_sql( LibmsiDatabase *db, const char *command,
+                   const struct sql_token *tokens, unsigned count,
+                   LibmsiView **phview, struct list *mem )
 {
     SQL_input sql;
     int r;
@@ -1009,6 +1202,9 @@ unsigned _libmsi_parse_sql( LibmsiDatabase *db, const char *command, LibmsiView
     sql.command = command;
     sql.n = 0;
     sql.len = 0;
+    sql.tokens = tokens;
+    sql.token = 0;
+    sql.token_count = count;
     sql.r = LIBMSI_RESULT_BAD_QUERY_SYNTAX;
     sql.view = phview;
     sql.mem = mem;
@@ -1028,3 +1224,17 @@ unsigned _libmsi_parse_sql( LibmsiDatabase *db, const char *command, LibmsiView
 
     return LIBMSI_RESULT_SUCCESS;
 }
+
+unsigned _libmsi_parse_sql( LibmsiDatabase *db, const char *command, LibmsiView **phview,
+                   struct list *mem )
+{
+    return parse_sql( db, command, NULL, 0, phview, mem );
+}
+
+/* parses a statement of a script split by sql_tokenize */
+unsigned _libmsi_parse_sql_tokens( LibmsiDatabase *db, const char *command,
+                   const struct sql_token *tokens, unsigned count,
+                   LibmsiView **phview, struct list *mem )
+{
+    return parse_sql( db, command, tokens, count, phview, mem );
+}
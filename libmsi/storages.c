@@ -30,47 +30,13 @@
 #define NUM_STORAGES_COLS    2
 #define MAX_STORAGES_NAME_LEN 62
 
-typedef struct tabSTORAGE
-{
-    unsigned str_index;
-} STORAGE;
-
+/* the rows are the storages of the database */
 typedef struct _LibmsiStorageView
 {
     LibmsiView view;
     LibmsiDatabase *db;
-    STORAGE **storages;
-    unsigned max_storages;
-    unsigned num_rows;
-    unsigned row_size;
 } LibmsiStorageView;
 
-static bool storages_set_table_size(LibmsiStorageView *sv, unsigned size)
-{
-    if (size >= sv->max_storages)
-    {
-        sv->max_storages *= 2;
-        sv->storages = msi_realloc(sv->storages, sv->max_storages * sizeof(STORAGE *));
-        if (!sv->storages)
-            return false;
-    }
-
-    return true;
-}
-
-static STORAGE *create_storage(LibmsiStorageView *sv, const char *name)
-{
-    STORAGE *storage;
-
-    storage = msi_alloc(sizeof(STORAGE));
-    if (!storage)
-        return NULL;
-
-    storage->str_index = _libmsi_add_string(sv->db->strings, name, -1, 1, StringNonPersistent);
-
-    return storage;
-}
-
 static unsigned storages_view_fetch_int(LibmsiView *view, unsigned row, unsigned col, unsigned *val)
 {
     LibmsiStorageView *sv = (LibmsiStorageView *)view;
@@ -80,11 +46,9 @@ static unsigned storages_view_fetch_int(LibmsiView *view, unsigned row, unsigned
     if (col != 1)
         return LIBMSI_RESULT_INVALID_PARAMETER;
 
-    if (row >= sv->num_rows)
+    if (!msi_db_storage_name(sv->db, row, val))
         return NO_MORE_ITEMS;
 
-    *val = sv->storages[row]->str_index;
-
     return LIBMSI_RESULT_SUCCESS;
 }
 
@@ -94,7 +58,7 @@ static unsigned storages_view_fetch_stream(LibmsiView *view, unsigned row, unsig
 
     TRACE("(%p, %d, %d, %p)\n", view, row, col, stm);
 
-    if (row >= sv->num_rows)
+    if (row >= msi_db_storage_count(sv->db))
         return LIBMSI_RESULT_FUNCTION_FAILED;
 
     return LIBMSI_RESULT_INVALID_DATA;
@@ -112,30 +76,24 @@ static unsigned storages_view_get_row( LibmsiView *view, unsigned row, LibmsiRec
 static unsigned storages_view_set_row(LibmsiView *view, unsigned row, LibmsiRecord *rec, unsigned mask)
 {
     LibmsiStorageView *sv = (LibmsiStorageView *)view;
-    STORAGE *storage;
     GsfInput *stm;
-    char *name = NULL;
+    const char *name;
     unsigned r = LIBMSI_RESULT_FUNCTION_FAILED;
 
     TRACE("(%p, %p)\n", view, rec);
 
-    if (row > sv->num_rows)
-        return LIBMSI_RESULT_FUNCTION_FAILED;
-
     r = _libmsi_record_get_gsf_input(rec, 2, &stm);
     if (r != LIBMSI_RESULT_SUCCESS)
         return r;
 
-    if (sv->storages[row]) {
+    name = msi_db_storage_name(sv->db, row, NULL);
+    if (name) {
         if (mask & 1) {
             g_warning("FIXME: renaming storage via UPDATE on _Storages table\n");
             goto done;
         }
-
-        storage = sv->storages[row];
-        name = strdup(msi_string_lookup_id(sv->db->strings, storage->str_index));
     } else {
-        name = strdup(_libmsi_record_get_string_raw(rec, 1));
+        name = _libmsi_record_get_string_raw(rec, 1);
     }
     if (!name)
     {
@@ -144,44 +102,27 @@ static unsigned storages_view_set_row(LibmsiView *view, unsigned row, LibmsiReco
     }
 
     msi_create_storage(sv->db, name, stm);
-    storage = create_storage(sv, name);
-    if (!storage)
-        r = LIBMSI_RESULT_FUNCTION_FAILED;
-
-    sv->storages[row] = storage;
 
 done:
-    msi_free(name);
     g_object_unref(G_OBJECT(stm));
 
     return r;
 }
 
+/* new storages are always added after the existing ones */
 static unsigned storages_view_insert_row(LibmsiView *view, LibmsiRecord *rec, unsigned row, bool temporary)
 {
     LibmsiStorageView *sv = (LibmsiStorageView *)view;
 
-    if (!storages_set_table_size(sv, ++sv->num_rows))
-        return LIBMSI_RESULT_FUNCTION_FAILED;
-
-    if (row == -1)
-        row = sv->num_rows - 1;
-
-    /* FIXME have to readjust rows */
-
-    return storages_view_set_row(view, row, rec, 0);
+    return storages_view_set_row(view, msi_db_storage_count(sv->db), rec, 0);
 }
 
 static unsigned storages_view_delete_row(LibmsiView *view, unsigned row)
 {
     LibmsiStorageView *sv = (LibmsiStorageView *)view;
     const char *name;
-    unsigned i;
 
-    if (row > sv->num_rows)
-        return LIBMSI_RESULT_FUNCTION_FAILED;
-
-    name = msi_string_lookup_id(sv->db->strings, sv->storages[row]->str_index);
+    name = msi_db_storage_name(sv->db, row, NULL);
     if (!name)
     {
         g_warning("failed to retrieve storage name\n");
@@ -190,13 +131,6 @@ static unsigned storages_view_delete_row(LibmsiView *view, unsigned row)
 
     msi_destroy_storage(sv->db, name);
 
-    /* shift the remaining rows */
-    for (i = row + 1; i < sv->num_rows; i++)
-    {
-        sv->storages[i - 1] = sv->storages[i];
-    }
-    sv->num_rows--;
-
     return LIBMSI_RESULT_SUCCESS;
 }
 
@@ -219,7 +153,7 @@ static unsigned storages_view_get_dimensions(LibmsiView *view, unsigned *rows, u
     TRACE("(%p, %p, %p)\n", view, rows, cols);
 
     if (cols) *cols = NUM_STORAGES_COLS;
-    if (rows) *rows = sv->num_rows;
+    if (rows) *rows = msi_db_storage_count(sv->db);
 
     return LIBMSI_RESULT_SUCCESS;
 }
@@ -256,49 +190,45 @@ static unsigned storages_view_get_column_info( LibmsiView *view, unsigned n, con
 static unsigned storages_view_delete(LibmsiView *view)
 {
     LibmsiStorageView *sv = (LibmsiStorageView *)view;
-    unsigned i;
 
     TRACE("(%p)\n", view);
 
-    for (i = 0; i < sv->num_rows; i++)
-        msi_free(sv->storages[i]);
-
-    msi_free(sv->storages);
-    sv->storages = NULL;
     msi_free(sv);
 
     return LIBMSI_RESULT_SUCCESS;
 }
 
+/* the names are unique, so there is at most one matching row */
 static unsigned storages_view_find_matching_rows(LibmsiView *view, unsigned col,
                                        unsigned val, unsigned *row, MSIITERHANDLE *handle)
 {
     LibmsiStorageView *sv = (LibmsiStorageView *)view;
-    unsigned index = (uintptr_t)*handle;
+    const char *name;
 
     TRACE("(%d, %d): %d\n", *row, col, val);
 
     if (col == 0 || col > NUM_STORAGES_COLS)
         return LIBMSI_RESULT_INVALID_PARAMETER;
 
-    while (index < sv->num_rows)
-    {
-        if (sv->storages[index]->str_index == val)
-        {
-            *row = index;
-            break;
-        }
-
-        index++;
-    }
+    if (col != 1 || *handle)
+        return NO_MORE_ITEMS;
 
-    *handle = (MSIITERHANDLE)(uintptr_t)++index;
-    if (index >= sv->num_rows)
+    name = msi_string_lookup_id(sv->db->strings, val);
+    if (!name || !msi_db_find_storage(sv->db, name, row))
         return NO_MORE_ITEMS;
 
+    *handle = (MSIITERHANDLE)(uintptr_t)1;
+
     return LIBMSI_RESULT_SUCCESS;
 }
 
+static void storages_view_explain( LibmsiView *view, GString *str, unsigned depth )
+{
+    LibmsiStorageView *sv = (LibmsiStorageView*)view;
+
+    g_string_append_printf( str, "%*sSTORAGES rows=%u\n", depth * 2, "", msi_db_storage_count( sv->db ) );
+}
+
 static const LibmsiViewOps storages_ops =
 {
     storages_view_fetch_int,
@@ -319,41 +249,17 @@ static const LibmsiViewOps storages_ops =
     NULL,
     NULL,
     NULL,
+    storages_view_explain,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
 };
 
-static unsigned add_storage_to_table(const char *name, GsfInfile *stg, void *opaque)
-{
-    LibmsiStorageView *sv = (LibmsiStorageView *)opaque;
-    STORAGE *storage;
-
-    storage = create_storage(sv, name);
-    if (!storage)
-        return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
-
-    if (!storages_set_table_size(sv, ++sv->num_rows))
-    {
-        msi_free(storage);
-        return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
-    }
-
-    sv->storages[sv->num_rows - 1] = storage;
-    return LIBMSI_RESULT_SUCCESS;
-}
-
-static unsigned add_storages_to_table(LibmsiStorageView *sv)
-{
-    sv->max_storages = 1;
-    sv->storages = msi_alloc_zero(sizeof(STORAGE *));
-    if (!sv->storages)
-        return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
-
-    return msi_enum_db_storages(sv->db, add_storage_to_table, sv);
-}
-
 unsigned storages_view_create(LibmsiDatabase *db, LibmsiView **view)
 {
     LibmsiStorageView *sv;
-    unsigned r;
 
     TRACE("(%p, %p)\n", db, view);
 
@@ -363,13 +269,7 @@ unsigned storages_view_create(LibmsiDatabase *db, LibmsiView **view)
 
     sv->view.ops = &storages_ops;
     sv->db = db;
-
-    r = add_storages_to_table(sv);
-    if (r)
-    {
-        msi_free( sv );
-        return r;
-    }
+    msi_db_intern_storages(db);
 
     *view = (LibmsiView *)sv;
 
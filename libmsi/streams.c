@@ -29,60 +29,14 @@
 
 #define NUM_STREAMS_COLS    2
 
-typedef struct tabSTREAM
-{
-    unsigned str_index;
-    GsfInput *stream;
-} STREAM;
-
+/* the rows are the streams of the database, so the view doesn't need
+ * to list them when it is created */
 typedef struct _LibmsiStreamsView
 {
     LibmsiView view;
     LibmsiDatabase *db;
-    STREAM **streams;
-    unsigned max_streams;
-    unsigned num_rows;
-    unsigned row_size;
 } LibmsiStreamsView;
 
-static bool streams_set_table_size(LibmsiStreamsView *sv, unsigned size)
-{
-    if (size >= sv->max_streams)
-    {
-        sv->streams = msi_realloc_zero(sv->streams, sv->max_streams * sizeof(STREAM *),
-                                       sv->max_streams * 2 * sizeof(STREAM *));
-        sv->max_streams *= 2;
-        if (!sv->streams)
-            return false;
-    }
-
-    return true;
-}
-
-static STREAM *create_stream(LibmsiStreamsView *sv, const char *name, bool encoded, GsfInput *stm)
-{
-    STREAM *stream;
-    g_autofree char *decoded = NULL;
-
-    stream = msi_alloc(sizeof(STREAM));
-    if (!stream)
-        return NULL;
-
-    if (encoded)
-    {
-        decoded = decode_streamname(name);
-        TRACE("stream -> %s %s\n", debugstr_a(name), debugstr_a(decoded));
-        name = decoded;
-    }
-
-    stream->str_index = _libmsi_add_string(sv->db->strings, name, -1, 1, StringNonPersistent);
-    stream->stream = stm;
-    if (stream->stream)
-        g_object_ref(G_OBJECT(stm));
-
-    return stream;
-}
-
 static unsigned streams_view_fetch_int(LibmsiView *view, unsigned row, unsigned col, unsigned *val)
 {
     LibmsiStreamsView *sv = (LibmsiStreamsView *)view;
@@ -92,11 +46,9 @@ static unsigned streams_view_fetch_int(LibmsiView *view, unsigned row, unsigned
     if (col != 1)
         return LIBMSI_RESULT_INVALID_PARAMETER;
 
-    if (row >= sv->num_rows)
+    if (!msi_db_stream_name(sv->db, row, val, NULL))
         return NO_MORE_ITEMS;
 
-    *val = sv->streams[row]->str_index;
-
     return LIBMSI_RESULT_SUCCESS;
 }
 
@@ -106,11 +58,10 @@ static unsigned streams_view_fetch_stream(LibmsiView *view, unsigned row, unsign
 
     TRACE("(%p, %d, %d, %p)\n", view, row, col, stm);
 
-    if (row >= sv->num_rows)
+    if (!msi_db_stream_name(sv->db, row, NULL, stm))
         return LIBMSI_RESULT_FUNCTION_FAILED;
 
-    g_object_ref(G_OBJECT(sv->streams[row]->stream));
-    *stm = sv->streams[row]->stream;
+    g_object_ref(G_OBJECT(*stm));
 
     return LIBMSI_RESULT_SUCCESS;
 }
@@ -127,109 +78,69 @@ static unsigned streams_view_get_row( LibmsiView *view, unsigned row, LibmsiReco
 static unsigned streams_view_set_row(LibmsiView *view, unsigned row, LibmsiRecord *rec, unsigned mask)
 {
     LibmsiStreamsView *sv = (LibmsiStreamsView *)view;
-    STREAM *stream = NULL;
     GsfInput *stm;
-    char *name = NULL;
+    const char *name;
     unsigned r;
 
     TRACE("(%p, %d, %p, %08x)\n", view, row, rec, mask);
 
-    if (row > sv->num_rows)
-        return LIBMSI_RESULT_FUNCTION_FAILED;
-
     r = _libmsi_record_get_gsf_input(rec, 2, &stm);
     if (r != LIBMSI_RESULT_SUCCESS)
         return r;
 
-    if (sv->streams[row]) {
+    name = msi_db_stream_name(sv->db, row, NULL, NULL);
+    if (name) {
         if (mask & 1) {
             g_warning("FIXME: renaming stream via UPDATE on _Streams table");
             goto done;
         }
-
-        stream = sv->streams[row];
-        name = strdup(msi_string_lookup_id(sv->db->strings, stream->str_index));
     } else {
-        name = strdup(_libmsi_record_get_string_raw(rec, 1));
+        name = _libmsi_record_get_string_raw(rec, 1);
         if (!name)
         {
             g_warning("failed to retrieve stream name\n");
             goto done;
         }
-
-        stream = create_stream(sv, name, false, stm);
     }
 
-    if (!stream)
-        goto done;
-
     r = msi_create_stream(sv->db, name, stm);
     if (r != LIBMSI_RESULT_SUCCESS)
-    {
         g_warning("failed to create stream: %08x\n", r);
-        g_object_unref(G_OBJECT(stream->stream));
-        msi_free(stream);
-        goto done;
-    }
-
-    sv->streams[row] = stream;
 
 done:
-    msi_free(name);
-
     g_object_unref(G_OBJECT(stm));
 
     return r;
 }
 
+/* new streams are always added after the existing ones */
 static unsigned streams_view_insert_row(LibmsiView *view, LibmsiRecord *rec, unsigned row, bool temporary)
 {
     LibmsiStreamsView *sv = (LibmsiStreamsView *)view;
-    unsigned i;
 
     TRACE("(%p, %p, %d, %d)\n", view, rec, row, temporary);
 
-    if (!streams_set_table_size(sv, ++sv->num_rows))
-        return LIBMSI_RESULT_FUNCTION_FAILED;
-
-    if (row == -1)
-        row = sv->num_rows - 1;
-
-    /* shift the rows to make room for the new row */
-    for (i = sv->num_rows - 1; i > row; i--)
-    {
-        sv->streams[i] = sv->streams[i - 1];
-    }
-
-    return streams_view_set_row(view, row, rec, 0);
+    return streams_view_set_row(view, msi_db_stream_count(sv->db), rec, 0);
 }
 
 static unsigned streams_view_delete_row(LibmsiView *view, unsigned row)
 {
     LibmsiStreamsView *sv = (LibmsiStreamsView *)view;
     const char *name;
-    char *encname;
-    unsigned i;
-
-    if (row > sv->num_rows)
-        return LIBMSI_RESULT_FUNCTION_FAILED;
+    const char *encname;
 
-    name = msi_string_lookup_id(sv->db->strings, sv->streams[row]->str_index);
+    name = msi_db_stream_name(sv->db, row, NULL, NULL);
     if (!name)
     {
         g_warning("failed to retrieve stream name\n");
         return LIBMSI_RESULT_FUNCTION_FAILED;
     }
 
-    encname = encode_streamname(false, name);
-    msi_destroy_stream(sv->db, encname);
+    encname = msi_db_encode_streamname(sv->db, false, name);
+    if (!encname)
+        return LIBMSI_RESULT_OUTOFMEMORY;
 
-    /* shift the remaining rows */
-    for (i = row + 1; i < sv->num_rows; i++)
-    {
-        sv->streams[i - 1] = sv->streams[i];
-    }
-    sv->num_rows--;
+    msi_destroy_stream(sv->db, encname);
 
     return LIBMSI_RESULT_SUCCESS;
 }
@@ -253,7 +164,7 @@ static unsigned streams_view_get_dimensions(LibmsiView *view, unsigned *rows, un
     TRACE("(%p, %p, %p)\n", view, rows, cols);
 
     if (cols) *cols = NUM_STREAMS_COLS;
-    if (rows) *rows = sv->num_rows;
+    if (rows) *rows = msi_db_stream_count(sv->db);
 
     return LIBMSI_RESULT_SUCCESS;
 }
@@ -290,56 +201,45 @@ static unsigned streams_view_get_column_info( LibmsiView *view, unsigned n, cons
 static unsigned streams_view_delete(LibmsiView *view)
 {
     LibmsiStreamsView *sv = (LibmsiStreamsView *)view;
-    unsigned i;
 
     TRACE("(%p)\n", view);
 
-    for (i = 0; i < sv->num_rows; i++)
-    {
-        if (sv->streams[i])
-        {
-            if (sv->streams[i]->stream)
-                g_object_unref(G_OBJECT(sv->streams[i]->stream));
-            msi_free(sv->streams[i]);
-        }
-    }
-
-    msi_free(sv->streams);
     msi_free(sv);
 
     return LIBMSI_RESULT_SUCCESS;
 }
 
+/* the names are unique, so there is at most one matching row */
 static unsigned streams_view_find_matching_rows(LibmsiView *view, unsigned col,
                                        unsigned val, unsigned *row, MSIITERHANDLE *handle)
 {
     LibmsiStreamsView *sv = (LibmsiStreamsView *)view;
-    unsigned index = (uintptr_t)(*handle);
+    const char *name;
 
     TRACE("(%p, %d, %d, %p, %p)\n", view, col, val, row, handle);
 
     if (col == 0 || col > NUM_STREAMS_COLS)
         return LIBMSI_RESULT_INVALID_PARAMETER;
 
-    while (index < sv->num_rows)
-    {
-        if (sv->streams[index]->str_index == val)
-        {
-            *row = index;
-            break;
-        }
-
-        index++;
-    }
-
-    *handle = (MSIITERHANDLE)(uintptr_t)++index;
+    if (col != 1 || *handle)
+        return NO_MORE_ITEMS;
 
-    if (index > sv->num_rows)
+    name = msi_string_lookup_id(sv->db->strings, val);
+    if (!name || !msi_db_find_stream(sv->db, name, row))
         return NO_MORE_ITEMS;
 
+    *handle = (MSIITERHANDLE)(uintptr_t)1;
+
     return LIBMSI_RESULT_SUCCESS;
 }
 
+static void streams_view_explain( LibmsiView *view, GString *str, unsigned depth )
+{
+    LibmsiStreamsView *sv = (LibmsiStreamsView*)view;
+
+    g_string_append_printf( str, "%*sSTREAMS rows=%u\n", depth * 2, "", msi_db_stream_count( sv->db ) );
+}
+
 static const LibmsiViewOps streams_ops =
 {
     streams_view_fetch_int,
@@ -360,41 +260,17 @@ static const LibmsiViewOps streams_ops =
     NULL,
     NULL,
     NULL,
+    streams_view_explain,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
 };
 
-static unsigned add_stream_to_table(const char *name, GsfInput *stm, void *opaque)
-{
-    LibmsiStreamsView *sv = (LibmsiStreamsView *)opaque;
-    STREAM *stream;
-
-    stream = create_stream(sv, name, true, stm);
-    if (!stream)
-        return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
-
-    if (!streams_set_table_size(sv, ++sv->num_rows))
-    {
-        msi_free(stream);
-        return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
-    }
-
-    sv->streams[sv->num_rows - 1] = stream;
-    return LIBMSI_RESULT_SUCCESS;
-}
-
-static unsigned add_streams_to_table(LibmsiStreamsView *sv)
-{
-    sv->max_streams = 1;
-    sv->streams = msi_alloc_zero(sizeof(STREAM *));
-    if (!sv->streams)
-        return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
-
-    return msi_enum_db_streams(sv->db, add_stream_to_table, sv);
-}
-
 unsigned streams_view_create(LibmsiDatabase *db, LibmsiView **view)
 {
     LibmsiStreamsView *sv;
-    unsigned r;
 
     TRACE("(%p, %p)\n", db, view);
 
@@ -404,12 +280,7 @@ unsigned streams_view_create(LibmsiDatabase *db, LibmsiView **view)
 
     sv->view.ops = &streams_ops;
     sv->db = db;
-    r = add_streams_to_table(sv);
-    if (r)
-    {
-        msi_free( sv );
-        return r;
-    }
+    msi_db_intern_streams(db);
 
     *view = (LibmsiView *)sv;
 
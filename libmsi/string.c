@@ -41,10 +41,12 @@ struct msistring
 
 struct string_table
 {
+    int refs;                  /* the database, and records borrowing its strings */
     unsigned maxcount;         /* the number of strings */
     unsigned freeslot;
     unsigned codepage;
     unsigned sortcount;
+    unsigned dupcount;         /* strings left out of the index, their text is already in it */
     struct msistring *strings; /* an array of strings */
     unsigned *sorted;              /* index */
 };
@@ -99,18 +101,31 @@ static string_table *init_stringtable( int entries, unsigned codepage )
         return NULL;
     }
 
+    st->refs = 1;
     st->maxcount = entries;
     st->freeslot = 1;
     st->codepage = codepage;
     st->sortcount = 0;
+    st->dupcount = 0;
 
     return st;
 }
 
+/* strings are never freed before the table itself, so holding a
+ * reference keeps every pointer returned by msi_string_lookup_id valid */
+string_table *msi_string_table_ref( string_table *st )
+{
+    g_atomic_int_inc( &st->refs );
+    return st;
+}
+
 void msi_destroy_stringtable( string_table *st )
 {
     unsigned i;
 
+    if (!g_atomic_int_dec_and_test( &st->refs ))
+        return;
+
     for( i=0; i<st->maxcount; i++ )
     {
         if( st->strings[i].persistent_refcount ||
@@ -191,17 +206,18 @@ static void insert_string_sorted( string_table *st, unsigned string_id )
 
     i = find_insert_index( st, string_id );
     if (i == -1)
+    {
+        st->dupcount++;
         return;
+    }
 
     memmove( &st->sorted[i] + 1, &st->sorted[i], (st->sortcount - i) * sizeof(unsigned) );
     st->sorted[i] = string_id;
     st->sortcount++;
 }
 
-static void set_st_entry( string_table *st, unsigned n, char *str, uint16_t refcount, enum StringPersistence persistence )
+static void store_st_entry( string_table *st, unsigned n, char *str, uint16_t refcount, enum StringPersistence persistence )
 {
-    g_return_if_fail(str != NULL);
-
     if (persistence == StringPersistent)
     {
         st->strings[n].persistent_refcount = refcount;
@@ -215,92 +231,16 @@ static void set_st_entry( string_table *st, unsigned n, char *str, uint16_t refc
 
     st->strings[n].str = str;
 
-    insert_string_sorted( st, n );
-
     if( n < st->maxcount )
         st->freeslot = n + 1;
 }
 
-static unsigned _libmsi_id_from_string( const string_table *st, const char *buffer, unsigned *id )
-{
-    size_t sz;
-    unsigned r = LIBMSI_RESULT_INVALID_PARAMETER;
-    char *str;
-    int codepage;
-    GIConv cpconv;
-
-    TRACE("Finding string %s in string table\n", debugstr_a(buffer) );
-
-    if( buffer[0] == 0 )
-    {
-        *id = 0;
-        return LIBMSI_RESULT_SUCCESS;
-    }
-
-    codepage = st->codepage ? st->codepage : gsf_msole_iconv_win_codepage();
-    cpconv = gsf_msole_iconv_open_codepage_for_export(codepage);
-    str = g_convert_with_iconv(buffer, -1, cpconv, NULL, &sz, NULL);
-    g_iconv_close(cpconv);
-    if( !str )
-        return r;
-
-    r = _libmsi_id_from_string_utf8( st, str, id );
-    msi_free( str );
-    return r;
-}
-
-static int msi_addstring( string_table *st, unsigned n, const char *data, int len, uint16_t refcount, enum StringPersistence persistence )
+static void set_st_entry( string_table *st, unsigned n, char *str, uint16_t refcount, enum StringPersistence persistence )
 {
-    char *str;
-    size_t sz;
-    int codepage;
-    GIConv cpconv;
-    GError *err = NULL;
-
-    if( !data )
-        return 0;
-    if( !data[0] )
-        return 0;
-    if( n > 0 )
-    {
-        if( st->strings[n].persistent_refcount ||
-            st->strings[n].nonpersistent_refcount )
-            return -1;
-    }
-    else
-    {
-        if( LIBMSI_RESULT_SUCCESS == _libmsi_id_from_string( st, data, &n ) )
-        {
-            if (persistence == StringPersistent)
-                st->strings[n].persistent_refcount += refcount;
-            else
-                st->strings[n].nonpersistent_refcount += refcount;
-            return n;
-        }
-        n = st_find_free_entry( st );
-        if( n == -1 )
-            return -1;
-    }
-
-    if( n < 1 )
-    {
-        g_critical("invalid index adding %s (%d)\n", debugstr_a( data ), n );
-        return -1;
-    }
-
-    /* allocate a new string */
-    codepage = st->codepage ? st->codepage : gsf_msole_iconv_win_codepage();
-    cpconv = gsf_msole_iconv_open_for_import(codepage);
-    str = g_convert_with_iconv(data, len, cpconv, NULL, &sz, &err);
-    g_iconv_close(cpconv);
-    if (err) {
-        g_warning("iconv failed: %s", err->message);
-        g_clear_error(&err);
-    } else {
-        set_st_entry( st, n, str, refcount, persistence);
-    }
+    g_return_if_fail(str != NULL);
 
-    return n;
+    store_st_entry( st, n, str, refcount, persistence );
+    insert_string_sorted( st, n );
 }
 
 int _libmsi_add_string( string_table *st, const char *data, int len, uint16_t refcount, enum StringPersistence persistence )
@@ -342,6 +282,183 @@ int _libmsi_add_string( string_table *st, const char *data, int len, uint16_t re
     return n;
 }
 
+static void remove_string_sorted( string_table *st, unsigned string_id )
+{
+    int i, c, low = 0, high = st->sortcount - 1;
+
+    while (low <= high)
+    {
+        i = (low + high) / 2;
+        c = strcmp( st->strings[string_id].str, st->strings[st->sorted[i]].str );
+
+        if (c < 0)
+            high = i - 1;
+        else if (c > 0)
+            low = i + 1;
+        else
+        {
+            /* another id may hold the same text */
+            if (st->sorted[i] != string_id)
+                return;
+            memmove( &st->sorted[i], &st->sorted[i] + 1, (st->sortcount - i - 1) * sizeof(unsigned) );
+            st->sortcount--;
+            return;
+        }
+    }
+}
+
+/*
+ *  msi_string_release_many
+ *
+ *  [in] st         - pointer to the string table
+ *  [in] ids        - string ids, 0 is ignored
+ *  [in] count      - number of ids
+ *
+ * Drops one reference to each string, e.g. the strings msi_string_intern_many
+ * added for rows that were not inserted after all.  Strings left without
+ * references are removed.
+ */
+void msi_string_release_many( string_table *st, const unsigned *ids, unsigned count,
+                              enum StringPersistence persistence )
+{
+    struct msistring *entry;
+    unsigned i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (!ids[i] || ids[i] >= st->maxcount)
+            continue;
+
+        entry = &st->strings[ids[i]];
+        if (persistence == StringPersistent && entry->persistent_refcount)
+            entry->persistent_refcount--;
+        else if (persistence == StringNonPersistent && entry->nonpersistent_refcount)
+            entry->nonpersistent_refcount--;
+        else
+            continue;
+
+        if (!entry->persistent_refcount && !entry->nonpersistent_refcount)
+        {
+            remove_string_sorted( st, ids[i] );
+            msi_free( entry->str );
+            entry->str = NULL;
+        }
+    }
+}
+
+static int compare_string_ids( const void *a, const void *b, void *user_data )
+{
+    const string_table *st = user_data;
+
+    return strcmp( st->strings[*(const unsigned *)a].str, st->strings[*(const unsigned *)b].str );
+}
+
+/*
+ *  msi_string_intern_many
+ *
+ *  [in] st         - pointer to the string table
+ *  [in] strs       - UTF8 strings to look up, possibly repeated
+ *  [in] count      - number of strings
+ *  [out] ids       - id of each string, 0 for empty strings
+ *  [out] added     - ids of the strings that were not in the table, room for count
+ *  [out] num_added - number of ids in added
+ *
+ * Like looking up each string and calling _libmsi_add_string for the ones
+ * that are missing, as table_view_set_row does: only new strings get a
+ * reference, so repeated values don't overflow the reference counts.  The
+ * new strings are added to the sorted index at the end, with one sort and
+ * one merge.
+ */
+unsigned msi_string_intern_many( string_table *st, const char **strs, unsigned count,
+                                 unsigned *ids, unsigned *added, unsigned *pnum_added,
+                                 enum StringPersistence persistence )
+{
+    unsigned r = LIBMSI_RESULT_SUCCESS;
+    unsigned num_added = 0, i, id;
+    GHashTable *names;
+    int n, j, k;
+    char *str;
+
+    *pnum_added = 0;
+    if (!count)
+        return LIBMSI_RESULT_SUCCESS;
+
+    /* the strings added by this call are not in the sorted index yet */
+    names = g_hash_table_new( g_str_hash, g_str_equal );
+
+    for (i = 0; i < count; i++)
+    {
+        if (!strs[i] || !strs[i][0])
+        {
+            ids[i] = 0;
+            continue;
+        }
+
+        if (_libmsi_id_from_string_utf8( st, strs[i], &id ) == LIBMSI_RESULT_SUCCESS ||
+            (id = GPOINTER_TO_UINT( g_hash_table_lookup( names, strs[i] ) )))
+        {
+            ids[i] = id;
+            continue;
+        }
+
+        n = st_find_free_entry( st );
+        str = strdup( strs[i] );
+        if (n == -1 || !str)
+        {
+            msi_free( str );
+            r = LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+            break;
+        }
+
+        store_st_entry( st, n, str, 1, persistence );
+        g_hash_table_insert( names, str, GUINT_TO_POINTER( n ) );
+        added[num_added++] = n;
+        ids[i] = n;
+    }
+
+    /* merge from the end, the index has room for every string id */
+    g_qsort_with_data( added, num_added, sizeof(*added), compare_string_ids, st );
+    j = (int)st->sortcount - 1;
+    k = (int)(st->sortcount + num_added) - 1;
+    for (n = (int)num_added - 1; n >= 0; n--)
+    {
+        while (j >= 0 && strcmp( st->strings[st->sorted[j]].str, st->strings[added[n]].str ) > 0)
+            st->sorted[k--] = st->sorted[j--];
+        st->sorted[k--] = added[n];
+    }
+    st->sortcount += num_added;
+
+    if (r != LIBMSI_RESULT_SUCCESS)
+        msi_string_release_many( st, added, num_added, persistence );
+    else
+        *pnum_added = num_added;
+
+    g_hash_table_destroy( names );
+    return r;
+}
+
+/* add a reference to a string that is already in the table, by its id */
+unsigned _libmsi_add_string_ref( string_table *st, unsigned id, enum StringPersistence persistence )
+{
+    if( id == 0 )
+        return LIBMSI_RESULT_SUCCESS;
+    if( id >= st->maxcount || !st->strings[id].str )
+        return LIBMSI_RESULT_INVALID_PARAMETER;
+
+    if (persistence == StringPersistent)
+        st->strings[id].persistent_refcount++;
+    else
+        st->strings[id].nonpersistent_refcount++;
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+/* the number of string ids in use, including the ids of deleted strings */
+G_GNUC_PURE
+unsigned msi_string_count( const string_table *st )
+{
+    return st->maxcount;
+}
+
 /* find the string identified by an id - return null if there's none */
 G_GNUC_PURE
 const char *msi_string_lookup_id( const string_table *st, unsigned id )
@@ -428,6 +545,73 @@ unsigned _libmsi_id_from_string_utf8( const string_table *st, const char *str, u
     return LIBMSI_RESULT_INVALID_PARAMETER;
 }
 
+/* equal strings only have equal ids if no text is stored twice */
+bool msi_string_has_duplicates( const string_table *st )
+{
+    return st->dupcount != 0;
+}
+
+/*
+ *  msi_string_find_prefix
+ *
+ *  [in] st         - pointer to the string table
+ *  [in] prefix     - UTF8 prefix to look for
+ *  [out] size      - number of string ids covered by the returned bitmap
+ *
+ * Returns a bitmap with the ids of all the strings starting with prefix set,
+ * to be freed with msi_free.  Strings sharing a prefix are adjacent in the
+ * sorted index, so this is a binary search followed by a short scan.  Pools
+ * that store the same text more than once are scanned in full instead, as
+ * only one id of each text is in the index.
+ */
+uint32_t *msi_string_find_prefix( const string_table *st, const char *prefix, unsigned *size )
+{
+    int i, c, low = 0, high = st->sortcount - 1;
+    size_t len = strlen( prefix );
+    uint32_t *ids;
+
+    ids = msi_alloc_zero( ((st->maxcount + 31) / 32) * sizeof(uint32_t) );
+    if (!ids)
+        return NULL;
+    *size = st->maxcount;
+
+    if (st->dupcount)
+    {
+        unsigned id;
+
+        for (id = 1; id < st->maxcount; id++)
+        {
+            if ((st->strings[id].persistent_refcount || st->strings[id].nonpersistent_refcount) &&
+                st->strings[id].str && !strncmp( st->strings[id].str, prefix, len ))
+                ids[id / 32] |= 1u << (id % 32);
+        }
+        return ids;
+    }
+
+    /* find the first string not sorting before the prefix */
+    while (low <= high)
+    {
+        i = (low + high) / 2;
+        c = strcmp( prefix, st->strings[st->sorted[i]].str );
+
+        if (c <= 0)
+            high = i - 1;
+        else
+            low = i + 1;
+    }
+
+    for (i = low; i < st->sortcount; i++)
+    {
+        unsigned id = st->sorted[i];
+
+        if (strncmp( st->strings[id].str, prefix, len ))
+            break;
+        ids[id / 32] |= 1u << (id % 32);
+    }
+
+    return ids;
+}
+
 static void string_totalsize( const string_table *st, unsigned *datasize, unsigned *poolsize )
 {
     unsigned i, holesize;
@@ -480,18 +664,69 @@ string_table *msi_init_string_table( unsigned *bytes_per_strref )
     return st;
 }
 
-string_table *msi_load_string_table( GsfInfile *stg, unsigned *bytes_per_strref )
+/* strings converted together by a thread, when loading in parallel */
+#define STRING_LOAD_CHUNK 4096
+
+/* a string of the pool, found by the first pass of msi_load_string_table */
+struct string_load
+{
+    unsigned n;
+    unsigned offset;
+    unsigned len;
+    uint16_t refs;
+    char *str;
+};
+
+struct string_load_chunk
+{
+    const char *data;
+    unsigned codepage;
+    struct string_load *strings;
+    unsigned count;
+};
+
+/* only reads the raw data, so chunks can be converted concurrently */
+static void convert_strings( gpointer data, gpointer user_data )
+{
+    struct string_load_chunk *chunk = data;
+    GError *err = NULL;
+    GIConv cpconv;
+    size_t sz;
+    unsigned i;
+
+    cpconv = gsf_msole_iconv_open_for_import( chunk->codepage );
+    for (i = 0; i < chunk->count; i++)
+    {
+        struct string_load *load = &chunk->strings[i];
+
+        load->str = g_convert_with_iconv( chunk->data + load->offset, load->len,
+                                          cpconv, NULL, &sz, &err );
+        if (err)
+        {
+            g_warning("iconv failed: %s", err->message);
+            g_clear_error(&err);
+            msi_free( load->str );
+            load->str = NULL;
+        }
+    }
+    g_iconv_close( cpconv );
+}
+
+string_table *msi_load_string_table( LibmsiDatabase *db, GsfInfile *stg, unsigned *bytes_per_strref )
 {
     string_table *st = NULL;
     char *data = NULL;
     uint16_t *pool = NULL;
+    struct string_load *strings = NULL;
+    struct string_load_chunk *chunks = NULL;
+    gpointer *jobs = NULL;
     unsigned r, datasize = 0, poolsize = 0, codepage;
-    unsigned i, count, offset, len, n, refs;
+    unsigned i, count, offset, len, n, refs, loaded = 0, nchunks;
 
-    r = read_stream_data( stg, szStringPool, (uint8_t **)&pool, &poolsize );
+    r = read_stream_data( db, stg, szStringPool, (uint8_t **)&pool, &poolsize );
     if( r != LIBMSI_RESULT_SUCCESS)
         goto end;
-    r = read_stream_data( stg, szStringData, (uint8_t **)&data, &datasize );
+    r = read_stream_data( db, stg, szStringData, (uint8_t **)&data, &datasize );
     if( r != LIBMSI_RESULT_SUCCESS)
         goto end;
 
@@ -510,6 +745,11 @@ string_table *msi_load_string_table( GsfInfile *stg, unsigned *bytes_per_strref
     if (!st)
         goto end;
 
+    strings = msi_alloc( count * sizeof(*strings) );
+    if (!strings)
+        goto end;
+
+    /* first find every string, then convert them, then add them */
     offset = 0;
     n = 1;
     i = 1;
@@ -548,8 +788,15 @@ string_table *msi_load_string_table( GsfInfile *stg, unsigned *bytes_per_strref
             break;
         }
 
-        r = msi_addstring( st, n, data+offset, len, refs, StringPersistent );
-        if( r != n )
+        if( offset < datasize && data[offset] )
+        {
+            strings[loaded].n = n;
+            strings[loaded].offset = offset;
+            strings[loaded].len = len;
+            strings[loaded].refs = refs;
+            loaded++;
+        }
+        else
             g_critical("Failed to add string %d\n", n );
         n++;
         offset += len;
@@ -558,9 +805,49 @@ string_table *msi_load_string_table( GsfInfile *stg, unsigned *bytes_per_strref
     if ( datasize != offset )
         g_critical("string table load failed! (%08x != %08x), please report\n", datasize, offset );
 
+    /* the pool of an eagerly opened database is converted on all processors */
+    nchunks = 1;
+    if (db->flags & LIBMSI_DB_FLAGS_EAGER)
+        nchunks = (loaded + STRING_LOAD_CHUNK - 1) / STRING_LOAD_CHUNK;
+    if (!nchunks)
+        nchunks = 1;
+
+    chunks = msi_alloc( nchunks * sizeof(*chunks) );
+    jobs = msi_alloc( nchunks * sizeof(*jobs) );
+    if (!chunks || !jobs)
+    {
+        msi_destroy_stringtable( st );
+        st = NULL;
+        goto end;
+    }
+
+    codepage = st->codepage ? st->codepage : gsf_msole_iconv_win_codepage();
+    for (i = 0; i < nchunks; i++)
+    {
+        unsigned first = (guint64)loaded * i / nchunks;
+
+        chunks[i].data = data;
+        chunks[i].codepage = codepage;
+        chunks[i].strings = strings + first;
+        chunks[i].count = (guint64)loaded * (i + 1) / nchunks - first;
+        jobs[i] = &chunks[i];
+    }
+    msi_run_jobs( convert_strings, jobs, nchunks );
+
+    /* the sorted index is built in order of string id */
+    for (i = 0; i < loaded; i++)
+    {
+        if (strings[i].str)
+            set_st_entry( st, strings[i].n, strings[i].str,
+                          strings[i].refs, StringPersistent );
+    }
+
     TRACE("Loaded %d strings\n", count);
 
 end:
+    msi_free( jobs );
+    msi_free( chunks );
+    msi_free( strings );
     msi_free( pool );
     msi_free( data );
 
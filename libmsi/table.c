@@ -51,11 +51,18 @@ typedef struct _LibmsiColumnInfo
     LibmsiColumnHashEntry **hash_table;
 } LibmsiColumnInfo;
 
+typedef struct _LibmsiStreamName
+{
+    char *name;
+    const char *encname;    /* owned by the name cache of the database */
+} LibmsiStreamName;
+
 struct _LibmsiTable
 {
     uint8_t **data;
     bool *data_persistent;
     unsigned row_count;
+    LibmsiStreamName *stream_names; /* per row, filled by table_view_fetch_stream_name */
     struct list entry;
     LibmsiColumnInfo *colinfo;
     unsigned col_count;
@@ -233,56 +240,109 @@ char *decode_streamname(const char *in)
     return out;
 }
 
-void enum_stream_names( GsfInfile *stg )
+/* the names are converted once and then kept until the database goes away */
+const char *msi_db_decode_streamname( LibmsiDatabase *db, const char *in )
+{
+    const uint8_t *p = (const uint8_t *)in;
+    GHashTable *encoded;
+    const char *key;
+    char *out;
+
+    out = g_hash_table_lookup( db->names.decoded, in );
+    if (out)
+        return out;
+
+    out = decode_streamname( in );
+    if (!out)
+        return NULL;
+    g_hash_table_insert( db->names.decoded, g_strdup( in ), out );
+
+    /* encoding back gives the name that is actually in the file */
+    key = out;
+    encoded = db->names.streams;
+    /* UTF-8 encoding of 0x4840.  */
+    if (p[0] == 0xe4 && p[1] == 0xa1 && p[2] == 0x80)
+    {
+        key = out + 3;
+        encoded = db->names.tables;
+    }
+    if (!g_hash_table_contains( encoded, key ))
+        g_hash_table_insert( encoded, g_strdup( key ), strdup( in ) );
+    return out;
+}
+
+const char *msi_db_encode_streamname( LibmsiDatabase *db, bool bTable, const char *in )
+{
+    GHashTable *encoded = bTable ? db->names.tables : db->names.streams;
+    char *out;
+
+    out = g_hash_table_lookup( encoded, in );
+    if (out)
+        return out;
+
+    out = encode_streamname( bTable, in );
+    if (!out)
+        return NULL;
+    g_hash_table_insert( encoded, g_strdup( in ), out );
+
+    if (!g_hash_table_contains( db->names.decoded, out ))
+        g_hash_table_insert( db->names.decoded, g_strdup( out ),
+                             bTable ? g_strconcat( "\xe4\xa1\x80", in, NULL ) : g_strdup( in ) );
+    return out;
+}
+
+void enum_stream_names( LibmsiDatabase *db, GsfInfile *stg )
 {
     unsigned n, i;
 
     n = gsf_infile_num_children(stg);
     for (i = 0; i < n; i++)
     {
-        g_autofree char *name = NULL;
+        const char *name;
         const char *stname = gsf_infile_name_by_index(stg, i);
 
         if (!stname)
             continue;
 
-        name = decode_streamname(stname);
+        name = msi_db_decode_streamname(db, stname);
         TRACE("stream %2d -> %s %s\n", n,
               debugstr_a(stname), debugstr_a(name) );
     }
 }
 
-unsigned read_stream_data( GsfInfile *stg, const char *stname,
+unsigned read_stream_data( LibmsiDatabase *db, GsfInfile *stg, const char *stname,
                        uint8_t **pdata, unsigned *psz )
 {
     unsigned ret = LIBMSI_RESULT_FUNCTION_FAILED;
     void *data;
-    unsigned sz;
+    gsf_off_t sz;
     GsfInput *stm = NULL;
-    char *encname;
+    const char *encname;
 
-    encname = encode_streamname(true, stname);
+    encname = msi_db_encode_streamname(db, true, stname);
 
     TRACE("%s -> %s\n",debugstr_a(stname),debugstr_a(encname));
 
-    if ( !stg )
+    if ( !stg || !encname )
         return LIBMSI_RESULT_FUNCTION_FAILED;
 
     stm = gsf_infile_child_by_name(stg, encname );
-    msi_free(encname);
     if( !stm )
     {
         TRACE("open stream failed - empty table?\n");
         return ret;
     }
 
-    if( gsf_input_size(stm) >> 32 )
+    /* tables and the string pool are decoded in memory with 32-bit
+     * sizes; binary streams are read through msi_get_raw_stream */
+    sz = gsf_input_size(stm);
+    if( sz > G_MAXUINT )
     {
-        g_warning("Too big!\n");
+        g_warning("stream %s is too big (%" G_GINT64_FORMAT " bytes)\n",
+                  debugstr_a(stname), (gint64)sz);
         goto end;
     }
-        
-    sz = gsf_input_size(stm);
+
     if ( !sz )
     {
         data = NULL;
@@ -292,7 +352,7 @@ unsigned read_stream_data( GsfInfile *stg, const char *stname,
         data = g_try_malloc( sz );
         if( !data )
         {
-            g_warning("couldn't allocate memory (%u bytes)!\n", sz);
+            g_warning("couldn't allocate memory (%u bytes)!\n", (unsigned)sz);
             ret = LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
             goto end;
         }
@@ -319,16 +379,17 @@ unsigned write_stream_data( LibmsiDatabase *db, const char *stname,
                         const void *data, unsigned sz )
 {
     unsigned ret = LIBMSI_RESULT_FUNCTION_FAILED;
-    char *encname;
+    const char *encname;
     GsfOutput *stm;
 
     if (!db->outfile)
         return ret;
 
-    encname = encode_streamname(true, stname );
+    encname = msi_db_encode_streamname( db, true, stname );
+    if (!encname)
+        return ret;
 
     stm = gsf_outfile_new_child( db->outfile, encname, false );
-    msi_free( encname );
     if( !stm )
     {
         g_warning("open stream failed\n");
@@ -355,15 +416,44 @@ static void msi_free_colinfo( LibmsiColumnInfo *colinfo, unsigned count )
     for (i = 0; i < count; i++) msi_free( colinfo[i].hash_table );
 }
 
-static void free_table( LibmsiTable *table )
+/* the stream names depend on the keys and the position of each row */
+static void free_stream_names( LibmsiTable *table )
+{
+    unsigned i;
+
+    if (!table->stream_names)
+        return;
+
+    for (i = 0; i < table->row_count; i++)
+    {
+        msi_free( table->stream_names[i].name );
+    }
+    msi_free( table->stream_names );
+    table->stream_names = NULL;
+}
+
+/* back to the state of a table that was opened but never read */
+static void unload_table( LibmsiTable *table )
 {
     unsigned i;
+    free_stream_names( table );
     for( i=0; i<table->row_count; i++ )
         msi_free( table->data[i] );
     msi_free( table->data );
     msi_free( table->data_persistent );
-    msi_free_colinfo( table->colinfo, table->col_count );
+    if( table->colinfo )
+        msi_free_colinfo( table->colinfo, table->col_count );
     msi_free( table->colinfo );
+    table->data = NULL;
+    table->data_persistent = NULL;
+    table->row_count = 0;
+    table->colinfo = NULL;
+    table->col_count = 0;
+}
+
+static void free_table( LibmsiTable *table )
+{
+    unload_table( table );
     msi_free( table );
 }
 
@@ -384,22 +474,15 @@ static unsigned msi_table_get_row_size( LibmsiDatabase *db, const LibmsiColumnIn
     return last_col->offset + bytes_per_column( db, last_col, bytes_per_strref );
 }
 
-/* add this table to the list of cached tables in the database */
-static unsigned read_table_from_storage( LibmsiDatabase *db, LibmsiTable *t, GsfInfile *stg )
+/* only touches the table itself, so tables can be decoded concurrently */
+static unsigned decode_table_data( LibmsiDatabase *db, LibmsiTable *t,
+                                   const uint8_t *rawdata, unsigned rawsize )
 {
-    uint8_t *rawdata = NULL;
-    unsigned rawsize = 0, i, j, row_size, row_size_mem;
-
-    TRACE("%s\n",debugstr_a(t->name));
+    unsigned i, j, row_size, row_size_mem;
 
     row_size = msi_table_get_row_size( db, t->colinfo, t->col_count, db->bytes_per_strref );
     row_size_mem = msi_table_get_row_size( db, t->colinfo, t->col_count, LONG_STR_BYTES );
 
-    /* if we can't read the table, just assume that it's empty */
-    read_stream_data( stg, t->name, &rawdata, &rawsize );
-    if( !rawdata )
-        return LIBMSI_RESULT_SUCCESS;
-
     TRACE("Read %d bytes\n", rawsize );
 
     if( rawsize % row_size )
@@ -458,13 +541,29 @@ static unsigned read_table_from_storage( LibmsiDatabase *db, LibmsiTable *t, Gsf
         }
     }
 
-    msi_free( rawdata );
     return LIBMSI_RESULT_SUCCESS;
 err:
-    msi_free( rawdata );
     return LIBMSI_RESULT_FUNCTION_FAILED;
 }
 
+/* add this table to the list of cached tables in the database */
+static unsigned read_table_from_storage( LibmsiDatabase *db, LibmsiTable *t, GsfInfile *stg )
+{
+    uint8_t *rawdata = NULL;
+    unsigned rawsize = 0, r;
+
+    TRACE("%s\n",debugstr_a(t->name));
+
+    /* if we can't read the table, just assume that it's empty */
+    read_stream_data( db, stg, t->name, &rawdata, &rawsize );
+    if( !rawdata )
+        return LIBMSI_RESULT_SUCCESS;
+
+    r = decode_table_data( db, t, rawdata, rawsize );
+    msi_free( rawdata );
+    return r;
+}
+
 void free_cached_tables( LibmsiDatabase *db )
 {
     while( !list_empty( &db->tables ) )
@@ -636,6 +735,88 @@ static unsigned get_table( LibmsiDatabase *db, const char *name, LibmsiTable **t
     return LIBMSI_RESULT_SUCCESS;
 }
 
+typedef struct _LibmsiTableLoad
+{
+    LibmsiDatabase *db;
+    LibmsiTable *table;
+    uint8_t *rawdata;
+    unsigned rawsize;
+    unsigned r;
+} LibmsiTableLoad;
+
+static void decode_table_job( gpointer data, gpointer user_data )
+{
+    LibmsiTableLoad *load = data;
+
+    load->r = decode_table_data( load->db, load->table, load->rawdata, load->rawsize );
+}
+
+/*
+ * Reads every table of the database that is not cached yet, for
+ * LIBMSI_DB_FLAGS_EAGER.  libgsf is not thread safe, so the streams are
+ * read one after the other and only the decoding is spread over threads.
+ * A table that fails to decode is left unread, and reports its error
+ * when it is first used.
+ */
+void msi_load_all_tables( LibmsiDatabase *db )
+{
+    LibmsiTableLoad *loads = NULL;
+    gpointer *jobs = NULL;
+    LibmsiTable *t;
+    unsigned i, count = 0, n = 0;
+
+    /* the column definitions of every table come from _Columns */
+    if (get_table( db, szColumns, &t ) != LIBMSI_RESULT_SUCCESS)
+        return;
+
+    LIST_FOR_EACH_ENTRY( t, &db->tables, LibmsiTable, entry )
+        count++;
+
+    loads = msi_alloc_zero( count * sizeof(*loads) );
+    jobs = msi_alloc( count * sizeof(*jobs) );
+    if (!loads || !jobs)
+        goto end;
+
+    LIST_FOR_EACH_ENTRY( t, &db->tables, LibmsiTable, entry )
+    {
+        LibmsiTableLoad *load = &loads[n];
+        LibmsiColumnInfo *colinfo;
+        unsigned col_count;
+
+        if (t->colinfo)
+            continue;
+        if (table_get_column_info( db, t->name, &colinfo, &col_count ) != LIBMSI_RESULT_SUCCESS)
+            continue;
+
+        t->colinfo = colinfo;
+        t->col_count = col_count;
+
+        /* if we can't read the table, just assume that it's empty */
+        read_stream_data( db, db->infile, t->name, &load->rawdata, &load->rawsize );
+        if (!load->rawdata)
+            continue;
+
+        load->db = db;
+        load->table = t;
+        jobs[n++] = load;
+    }
+
+    msi_run_jobs( decode_table_job, jobs, n );
+
+    for (i = 0; i < n; i++)
+    {
+        LibmsiTableLoad *load = jobs[i];
+
+        if (load->r != LIBMSI_RESULT_SUCCESS)
+            unload_table( load->table );
+        msi_free( load->rawdata );
+    }
+
+end:
+    msi_free( jobs );
+    msi_free( loads );
+}
+
 static unsigned read_table_int( uint8_t *const *data, unsigned row, unsigned col, unsigned bytes )
 {
     unsigned ret = 0, i;
@@ -868,12 +1049,28 @@ err:
     return r;
 }
 
-static unsigned save_table( LibmsiDatabase *db, const LibmsiTable *t, unsigned bytes_per_strref )
+/* a table being committed, encoded on a worker and written in order */
+typedef struct _LibmsiTableSave
+{
+    LibmsiDatabase *db;
+    LibmsiTable *table;
+    unsigned bytes_per_strref;
+    bool write;
+    uint8_t *rawdata;
+    unsigned rawsize;
+    unsigned r;
+} LibmsiTableSave;
+
+/* only reads the table, so tables can be encoded concurrently */
+static unsigned encode_table( LibmsiDatabase *db, const LibmsiTable *t, unsigned bytes_per_strref,
+                              uint8_t **prawdata, unsigned *prawsize, bool *pwrite )
 {
     uint8_t *rawdata = NULL;
     unsigned rawsize, i, j, row_size, row_count;
     unsigned r = LIBMSI_RESULT_FUNCTION_FAILED;
 
+    *pwrite = false;
+
     /* Nothing to do for non-persistent tables */
     if( t->persistent == LIBMSI_CONDITION_FALSE )
         return LIBMSI_RESULT_SUCCESS;
@@ -942,14 +1139,40 @@ static unsigned save_table( LibmsiDatabase *db, const LibmsiTable *t, unsigned b
         rawsize += row_size;
     }
 
-    TRACE("writing %d bytes\n", rawsize);
-    r = write_stream_data( db, t->name, rawdata, rawsize );
+    *prawdata = rawdata;
+    *prawsize = rawsize;
+    *pwrite = true;
+    return LIBMSI_RESULT_SUCCESS;
 
 err:
     msi_free( rawdata );
     return r;
 }
 
+static void encode_table_job( gpointer data, gpointer user_data )
+{
+    LibmsiTableSave *save = data;
+
+    save->r = encode_table( save->db, save->table, save->bytes_per_strref,
+                            &save->rawdata, &save->rawsize, &save->write );
+}
+
+static unsigned save_table( LibmsiDatabase *db, const LibmsiTable *t, unsigned bytes_per_strref )
+{
+    uint8_t *rawdata = NULL;
+    unsigned rawsize, r;
+    bool write;
+
+    r = encode_table( db, t, bytes_per_strref, &rawdata, &rawsize, &write );
+    if( r == LIBMSI_RESULT_SUCCESS && write )
+    {
+        TRACE("writing %d bytes\n", rawsize);
+        r = write_stream_data( db, t->name, rawdata, rawsize );
+    }
+    msi_free( rawdata );
+    return r;
+}
+
 static void msi_update_table_columns( LibmsiDatabase *db, const char *name )
 {
     LibmsiTable *table;
@@ -958,6 +1181,7 @@ static void msi_update_table_columns( LibmsiDatabase *db, const char *name )
 
     table = find_cached_table( db, name );
     old_count = table->col_count;
+    free_stream_names( table );
     msi_free_colinfo( table->colinfo, table->col_count );
     msi_free( table->colinfo );
     table->colinfo = NULL;
@@ -1059,6 +1283,36 @@ static unsigned table_view_fetch_int( LibmsiView *view, unsigned row, unsigned c
     return LIBMSI_RESULT_SUCCESS;
 }
 
+static unsigned table_view_fetch_column_range( LibmsiView *view, unsigned col, unsigned first,
+                                               unsigned count, unsigned *out )
+{
+    LibmsiTableView *tv = (LibmsiTableView*)view;
+    unsigned offset, n, i;
+
+    if( !tv->table )
+        return LIBMSI_RESULT_INVALID_PARAMETER;
+
+    if( (col==0) || (col>tv->num_cols) )
+        return LIBMSI_RESULT_INVALID_PARAMETER;
+
+    if( first > tv->table->row_count || count > tv->table->row_count - first )
+        return NO_MORE_ITEMS;
+
+    /* the width and offset are the same for every row */
+    n = bytes_per_column( tv->db, &tv->columns[col - 1], LONG_STR_BYTES );
+    if (n != 2 && n != 3 && n != 4)
+    {
+        g_critical("oops! what is %d bytes per column?\n", n );
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+    }
+
+    offset = tv->columns[col-1].offset;
+    for (i = 0; i < count; i++)
+        out[i] = read_table_int(tv->table->data, first + i, offset, n);
+
+    return LIBMSI_RESULT_SUCCESS;
+}
+
 static unsigned msi_stream_name( const LibmsiTableView *tv, unsigned row, char **pstname )
 {
     char *p;
@@ -1155,7 +1409,7 @@ static unsigned table_view_fetch_stream( LibmsiView *view, unsigned row, unsigne
 {
     LibmsiTableView *tv = (LibmsiTableView*)view;
     unsigned r;
-    char *encname;
+    const char *encname;
     char *full_name = NULL;
 
     if( !view->ops->fetch_int )
@@ -1168,7 +1422,13 @@ static unsigned table_view_fetch_stream( LibmsiView *view, unsigned row, unsigne
         return r;
     }
 
-    encname = encode_streamname( false, full_name );
+    encname = msi_db_encode_streamname( tv->db, false, full_name );
+    if ( !encname )
+    {
+        msi_free( full_name );
+        return LIBMSI_RESULT_OUTOFMEMORY;
+    }
+
     r = msi_get_raw_stream( tv->db, encname, stm );
     if( r )
         g_critical("fetching stream %s, error = %d\n",debugstr_a(full_name), r);
@@ -1177,10 +1437,52 @@ static unsigned table_view_fetch_stream( LibmsiView *view, unsigned row, unsigne
         g_object_set_data_full (G_OBJECT (*stm), "stname", full_name, g_free);
     else
         msi_free( full_name );
-    msi_free( encname );
     return r;
 }
 
+static unsigned table_view_fetch_stream_name( LibmsiView *view, unsigned row, unsigned col,
+                                              LibmsiDatabase **db, const char **name,
+                                              const char **encname )
+{
+    LibmsiTableView *tv = (LibmsiTableView*)view;
+    LibmsiStreamName *entry;
+    unsigned r;
+
+    TRACE("%p %d %d\n", tv, row, col);
+
+    if( !tv->table || row >= tv->table->row_count )
+        return LIBMSI_RESULT_INVALID_PARAMETER;
+
+    if( !tv->table->stream_names )
+    {
+        tv->table->stream_names = msi_alloc_zero( tv->table->row_count * sizeof(LibmsiStreamName) );
+        if( !tv->table->stream_names )
+            return LIBMSI_RESULT_OUTOFMEMORY;
+    }
+
+    /* all of the binary columns of a row share its stream */
+    entry = &tv->table->stream_names[row];
+    if( !entry->encname )
+    {
+        r = msi_stream_name( tv, row, &entry->name );
+        if( r != LIBMSI_RESULT_SUCCESS )
+            return r;
+
+        entry->encname = msi_db_encode_streamname( tv->db, false, entry->name );
+        if( !entry->encname )
+        {
+            msi_free( entry->name );
+            entry->name = NULL;
+            return LIBMSI_RESULT_OUTOFMEMORY;
+        }
+    }
+
+    *db = tv->db;
+    *name = entry->name;
+    *encname = entry->encname;
+    return LIBMSI_RESULT_SUCCESS;
+}
+
 static unsigned table_view_set_int( LibmsiTableView *tv, unsigned row, unsigned col, unsigned val )
 {
     unsigned offset, n, i;
@@ -1204,6 +1506,9 @@ static unsigned table_view_set_int( LibmsiTableView *tv, unsigned row, unsigned
     msi_free( tv->columns[col-1].hash_table );
     tv->columns[col-1].hash_table = NULL;
 
+    if( tv->columns[col-1].type & MSITYPE_KEY )
+        free_stream_names( tv->table );
+
     n = bytes_per_column( tv->db, &tv->columns[col - 1], LONG_STR_BYTES );
     if ( n != 2 && n != 3 && n != 4 )
     {
@@ -1412,6 +1717,8 @@ static unsigned table_create_new_row( LibmsiView *view, unsigned *num, bool temp
     if( !row )
         return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
 
+    free_stream_names( tv->table );
+
     row_count = &tv->table->row_count;
     data_ptr = &tv->table->data;
     data_persist_ptr = &tv->table->data_persistent;
@@ -1523,10 +1830,11 @@ static unsigned table_view_get_column_info( LibmsiView *view,
 }
 
 static unsigned msi_table_find_row( LibmsiTableView *tv, LibmsiRecord *rec, unsigned *row, unsigned *column );
+static unsigned* msi_record_to_row( const LibmsiTableView *tv, LibmsiRecord *rec );
 
-static unsigned table_validate_new( LibmsiTableView *tv, LibmsiRecord *rec, unsigned *column )
+static unsigned table_validate_nulls( LibmsiTableView *tv, LibmsiRecord *rec, unsigned *column )
 {
-    unsigned r, row, i;
+    unsigned i;
 
     /* check there's no null values where they're not allowed */
     for( i = 0; i < tv->num_cols; i++ )
@@ -1559,6 +1867,16 @@ static unsigned table_validate_new( LibmsiTableView *tv, LibmsiRecord *rec, unsi
             }
         }
     }
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+static unsigned table_validate_new( LibmsiTableView *tv, LibmsiRecord *rec, unsigned *column )
+{
+    unsigned r, row;
+
+    r = table_validate_nulls( tv, rec, column );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
 
     /* check there's no duplicate keys */
     r = msi_table_find_row( tv, rec, &row, column );
@@ -1659,6 +1977,469 @@ static unsigned table_view_insert_row( LibmsiView *view, LibmsiRecord *rec, unsi
     return table_view_set_row( view, row, rec, (1<<tv->num_cols) - 1 );
 }
 
+typedef struct
+{
+    LibmsiRecord *rec;  /* NULL for rows given as encoded values */
+    unsigned *data;     /* encoded key values */
+    unsigned row;       /* insert position among the existing rows */
+} INSERTROW;
+
+static int compare_key_data( const LibmsiTableView *tv, const unsigned *a, const unsigned *b )
+{
+    unsigned i;
+
+    for (i = 0; i < tv->num_cols; i++)
+    {
+        if (!(tv->columns[i].type & MSITYPE_KEY))
+            continue;
+        if (a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+/* rows are ordered by the encoded values of their keys, string ids included */
+static int compare_batch_keys( LibmsiTableView *tv, const INSERTROW *x, const INSERTROW *y )
+{
+    return compare_key_data( tv, x->data, y->data );
+}
+
+static int compare_insert_rows( const void *a, const void *b, void *user_data )
+{
+    const INSERTROW *x = a, *y = b;
+
+    if (x->row != y->row)
+        return x->row < y->row ? -1 : 1;
+    return compare_batch_keys( user_data, x, y );
+}
+
+static int compare_key_rows( const void *a, const void *b, void *user_data )
+{
+    return compare_key_data( user_data, *(unsigned * const *)a, *(unsigned * const *)b );
+}
+
+/* like find_insert_index, for a row of encoded values */
+static int find_insert_index_data( LibmsiTableView *tv, const unsigned *data )
+{
+    int idx, c, low = 0, high = tv->table->row_count - 1;
+    unsigned i, x;
+
+    while (low <= high)
+    {
+        idx = (low + high) / 2;
+
+        c = 0;
+        for (i = 0; i < tv->num_cols && !c; i++)
+        {
+            if (!(tv->columns[i].type & MSITYPE_KEY))
+                continue;
+            if (table_view_fetch_int( &tv->view, idx, i + 1, &x ) != LIBMSI_RESULT_SUCCESS)
+                return -1;
+            if (data[i] != x)
+                c = data[i] < x ? -1 : 1;
+        }
+
+        if (c < 0)
+            high = idx - 1;
+        else if (c > 0)
+            low = idx + 1;
+        else
+            return idx;
+    }
+    return high + 1;
+}
+
+/* checks the keys of a batch of new rows against each other and against
+ * the table, with a single pass over the existing rows */
+static unsigned table_validate_batch( LibmsiTableView *tv, INSERTROW *batch, unsigned count )
+{
+    unsigned **keys, *data, i, r, n = 0, x;
+    int low, high, mid, c;
+
+    /* the batch is sorted by position and key, so equal keys are adjacent */
+    for (i = 1; i < count; i++)
+    {
+        if (!compare_batch_keys( tv, &batch[i - 1], &batch[i] ))
+            return LIBMSI_RESULT_FUNCTION_FAILED;
+    }
+
+    keys = msi_alloc( count * sizeof(*keys) );
+    data = msi_alloc_zero( tv->num_cols * sizeof(*data) );
+    if (!keys || !data)
+    {
+        msi_free( keys );
+        msi_free( data );
+        return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+    }
+
+    for (i = 0; i < count; i++)
+        if (batch[i].data)
+            keys[n++] = batch[i].data;
+    g_qsort_with_data( keys, n, sizeof(*keys), compare_key_rows, tv );
+
+    r = LIBMSI_RESULT_SUCCESS;
+    for (x = 0; n && x < tv->table->row_count; x++)
+    {
+        for (i = 0; i < tv->num_cols; i++)
+        {
+            if (!(tv->columns[i].type & MSITYPE_KEY))
+                continue;
+            r = table_view_fetch_int( &tv->view, x, i + 1, &data[i] );
+            if (r != LIBMSI_RESULT_SUCCESS)
+                goto done;
+        }
+
+        low = 0;
+        high = n - 1;
+        while (low <= high)
+        {
+            mid = (low + high) / 2;
+            c = compare_key_data( tv, data, keys[mid] );
+            if (!c)
+            {
+                r = LIBMSI_RESULT_FUNCTION_FAILED;
+                goto done;
+            }
+            if (c < 0)
+                high = mid - 1;
+            else
+                low = mid + 1;
+        }
+    }
+
+done:
+    msi_free( keys );
+    msi_free( data );
+    return r;
+}
+
+/* sorts and validates a batch of new rows, then merges empty rows for
+ * them into the table in a single pass. On success the row member of
+ * each entry holds the index of its new row. */
+static unsigned table_merge_batch( LibmsiTableView *tv, INSERTROW *batch, unsigned count, bool temporary )
+{
+    uint8_t **data;
+    bool *persistent;
+    unsigned i, j, k, n = tv->table->row_count, r;
+
+    g_qsort_with_data( batch, count, sizeof(*batch), compare_insert_rows, tv );
+
+    r = table_validate_batch( tv, batch, count );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
+
+    data = msi_alloc( (n + count) * sizeof(*data) );
+    persistent = msi_alloc( (n + count) * sizeof(*persistent) );
+    if (!data || !persistent)
+    {
+        msi_free( data );
+        msi_free( persistent );
+        return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+    }
+
+    for (i = j = k = 0; i < n + count; i++)
+    {
+        if (k < count && batch[k].row <= j)
+        {
+            data[i] = msi_alloc_zero( tv->row_size );
+            if (!data[i])
+            {
+                while (k--)
+                    msi_free( data[batch[k].row] );
+                msi_free( data );
+                msi_free( persistent );
+                return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+            }
+            persistent[i] = !temporary;
+            batch[k++].row = i;
+        }
+        else
+        {
+            data[i] = tv->table->data[j];
+            persistent[i] = tv->table->data_persistent[j];
+            j++;
+        }
+    }
+
+    free_stream_names( tv->table );
+    msi_free( tv->table->data );
+    msi_free( tv->table->data_persistent );
+    tv->table->data = data;
+    tv->table->data_persistent = persistent;
+    tv->table->row_count = n + count;
+
+    /* reset the hash tables */
+    for (i = 0; i < tv->num_cols; i++)
+    {
+        msi_free( tv->columns[i].hash_table );
+        tv->columns[i].hash_table = NULL;
+    }
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+static unsigned table_view_insert_rows( LibmsiView *view, LibmsiRecord **records,
+                                        const unsigned *rows, unsigned count, bool temporary )
+{
+    LibmsiTableView *tv = (LibmsiTableView*)view;
+    enum StringPersistence persistence;
+    INSERTROW *batch;
+    const char **strs = NULL;
+    unsigned *ids = NULL, *added = NULL;
+    unsigned i, j, n, num_strs = 0, num_added, r;
+
+    TRACE("%p %u %s\n", tv, count, temporary ? "true" : "false" );
+
+    if (!tv->table)
+        return LIBMSI_RESULT_INVALID_PARAMETER;
+
+    batch = msi_alloc_zero( count * sizeof(*batch) );
+    strs = msi_alloc( count * tv->num_cols * sizeof(*strs) );
+    ids = msi_alloc( count * tv->num_cols * sizeof(*ids) );
+    added = msi_alloc( count * tv->num_cols * sizeof(*added) );
+    if (!batch || !strs || !ids || !added)
+    {
+        r = LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+        goto done;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        r = table_validate_nulls( tv, records[i], NULL );
+        if (r != LIBMSI_RESULT_SUCCESS)
+        {
+            r = LIBMSI_RESULT_FUNCTION_FAILED;
+            goto done;
+        }
+
+        for (j = 0; j < tv->num_cols; j++)
+        {
+            if ((tv->columns[j].type & MSITYPE_STRING) &&
+                !MSITYPE_IS_BINARY(tv->columns[j].type))
+                strs[num_strs++] = _libmsi_record_get_string_raw( records[i], j + 1 );
+        }
+    }
+
+    /* the strings get their ids first, so that the new rows can be ordered
+     * the way the table is.  They are added row by row and only new strings
+     * get a reference, as table_view_set_row does, so the string pool ends
+     * up the same as with one INSERT per row */
+    persistence = (tv->table->persistent != LIBMSI_CONDITION_FALSE && !temporary) ?
+                  StringPersistent : StringNonPersistent;
+    r = msi_string_intern_many( tv->db->strings, strs, num_strs, ids, added, &num_added,
+                                persistence );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        goto done;
+
+    n = tv->table->row_count;
+    for (i = 0; i < count; i++)
+    {
+        batch[i].rec = records[i];
+        batch[i].data = msi_record_to_row( tv, records[i] );
+        if (!batch[i].data)
+        {
+            r = LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+            break;
+        }
+        if (rows[i] == -1)
+            batch[i].row = find_insert_index( tv, records[i] );
+        else
+            batch[i].row = MIN( rows[i], n );
+    }
+
+    if (r == LIBMSI_RESULT_SUCCESS)
+        r = table_merge_batch( tv, batch, count, temporary );
+    if (r != LIBMSI_RESULT_SUCCESS)
+    {
+        msi_string_release_many( tv->db->strings, added, num_added, persistence );
+        goto done;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        r = table_view_set_row( view, batch[i].row, batch[i].rec, (1 << tv->num_cols) - 1 );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            break;
+    }
+
+done:
+    for (i = 0; batch && i < count; i++)
+        msi_free( batch[i].data );
+    msi_free( batch );
+    msi_free( strs );
+    msi_free( ids );
+    msi_free( added );
+    return r;
+}
+
+/* add_refs is false when the caller has already added the strings it needed */
+static unsigned table_insert_encoded( LibmsiTableView *tv, unsigned *values,
+                                      unsigned count, bool temporary, bool add_refs )
+{
+    enum StringPersistence persistence;
+    INSERTROW *batch;
+    unsigned i, j, r, *data;
+    int idx;
+
+    TRACE("%p %u %s\n", tv, count, temporary ? "true" : "false" );
+
+    if (!tv->table)
+        return LIBMSI_RESULT_INVALID_PARAMETER;
+
+    batch = msi_alloc_zero( count * sizeof(*batch) );
+    if (!batch)
+        return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+
+    r = LIBMSI_RESULT_FUNCTION_FAILED;
+    for (i = 0; i < count; i++)
+    {
+        bool null_key = false;
+
+        data = batch[i].data = &values[i * tv->num_cols];
+
+        for (j = 0; j < tv->num_cols; j++)
+        {
+            if (MSITYPE_IS_BINARY(tv->columns[j].type))
+                goto done;
+            if (data[j])
+                continue;
+            if (!(tv->columns[j].type & MSITYPE_NULLABLE))
+                goto done;
+            if (tv->columns[j].type & MSITYPE_KEY)
+                null_key = true;
+        }
+
+        /* rows with NULL primary keys are inserted at the beginning of the table */
+        idx = null_key ? 0 : find_insert_index_data( tv, data );
+        if (idx < 0)
+            goto done;
+        batch[i].row = idx;
+    }
+
+    r = table_merge_batch( tv, batch, count, temporary );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        goto done;
+
+    persistence = (tv->table->persistent != LIBMSI_CONDITION_FALSE && !temporary) ?
+                  StringPersistent : StringNonPersistent;
+    for (i = 0; i < count && r == LIBMSI_RESULT_SUCCESS; i++)
+    {
+        data = batch[i].data;
+        for (j = 0; j < tv->num_cols; j++)
+        {
+            if (add_refs && tv->columns[j].type & MSITYPE_STRING)
+            {
+                r = _libmsi_add_string_ref( tv->db->strings, data[j], persistence );
+                if (r != LIBMSI_RESULT_SUCCESS)
+                    break;
+            }
+
+            r = table_view_set_int( tv, batch[i].row, j + 1, data[j] );
+            if (r != LIBMSI_RESULT_SUCCESS)
+                break;
+        }
+    }
+
+done:
+    msi_free( batch );
+    return r;
+}
+
+static unsigned table_view_insert_encoded( LibmsiView *view, unsigned *values,
+                                           unsigned count, bool temporary )
+{
+    return table_insert_encoded( (LibmsiTableView*)view, values, count, temporary, true );
+}
+
+/*
+ * Inserts rows given as text, one field per column as read from an .idt
+ * file, where an empty field is NULL.  The strings of all the rows are
+ * added to the string table together, then the rows are merged into the
+ * table with a single sort.  Binary columns are not supported.
+ */
+unsigned msi_table_load_text_rows( LibmsiView *view, char **fields, unsigned count )
+{
+    LibmsiTableView *tv = (LibmsiTableView*)view;
+    enum StringPersistence persistence;
+    const char **strs = NULL;
+    unsigned *values = NULL, *ids = NULL, *added = NULL;
+    unsigned i, n = 0, total, row_count, num_added, r;
+
+    TRACE("%p %u\n", tv, count);
+
+    if (!tv->table)
+        return LIBMSI_RESULT_INVALID_PARAMETER;
+    if (!count)
+        return LIBMSI_RESULT_SUCCESS;
+
+    total = count * tv->num_cols;
+    values = msi_alloc_zero( total * sizeof(*values) );
+    strs = msi_alloc( total * sizeof(*strs) );
+    ids = msi_alloc( total * sizeof(*ids) );
+    added = msi_alloc( total * sizeof(*added) );
+    if (!values || !strs || !ids || !added)
+    {
+        r = LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+        goto done;
+    }
+
+    r = LIBMSI_RESULT_FUNCTION_FAILED;
+    for (i = 0; i < total; i++)
+    {
+        const LibmsiColumnInfo *col = &tv->columns[i % tv->num_cols];
+        int ival;
+
+        if (!fields[i][0])
+            continue;
+        if (MSITYPE_IS_BINARY(col->type))
+            goto done;
+        if (col->type & MSITYPE_STRING)
+        {
+            strs[n++] = fields[i];
+            continue;
+        }
+
+        ival = atoi( fields[i] );
+        if (bytes_per_column( tv->db, col, LONG_STR_BYTES ) == 2)
+        {
+            values[i] = 0x8000 + ival;
+            if (values[i] & 0xffff0000)
+            {
+                g_critical("field %u value %d out of range\n", i % tv->num_cols + 1, ival);
+                goto done;
+            }
+        }
+        else
+            values[i] = ival ^ 0x80000000;
+    }
+
+    persistence = (tv->table->persistent != LIBMSI_CONDITION_FALSE) ?
+                  StringPersistent : StringNonPersistent;
+    r = msi_string_intern_many( tv->db->strings, strs, n, ids, added, &num_added, persistence );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        goto done;
+
+    /* the ids come back in the order the strings were found */
+    for (i = 0, n = 0; i < total; i++)
+    {
+        if (fields[i][0] && tv->columns[i % tv->num_cols].type & MSITYPE_STRING)
+            values[i] = ids[n++];
+    }
+
+    row_count = tv->table->row_count;
+    r = table_insert_encoded( tv, values, count, false, false );
+
+    /* the batch is validated as a whole, so either every row went in or none */
+    if (r != LIBMSI_RESULT_SUCCESS && tv->table->row_count == row_count)
+        msi_string_release_many( tv->db->strings, added, num_added, persistence );
+
+done:
+    msi_free( added );
+    msi_free( ids );
+    msi_free( strs );
+    msi_free( values );
+    return r;
+}
+
 static unsigned table_view_delete_row( LibmsiView *view, unsigned row )
 {
     LibmsiTableView *tv = (LibmsiTableView*)view;
@@ -1676,6 +2457,7 @@ static unsigned table_view_delete_row( LibmsiView *view, unsigned row )
     if ( row >= num_rows )
         return LIBMSI_RESULT_FUNCTION_FAILED;
 
+    free_stream_names( tv->table );
     num_rows = tv->table->row_count;
     tv->table->row_count--;
 
@@ -1727,7 +2509,7 @@ static unsigned table_view_find_matching_rows( LibmsiView *view, unsigned col,
 
     if( !tv->columns[col-1].hash_table )
     {
-        unsigned i;
+        unsigned i, values[MSI_FETCH_ROWS];
         unsigned num_rows = tv->table->row_count;
         LibmsiColumnHashEntry **hash_table;
         LibmsiColumnHashEntry *new_entry;
@@ -1755,8 +2537,15 @@ static unsigned table_view_find_matching_rows( LibmsiView *view, unsigned col,
         {
             unsigned row_value;
 
-            if (view->ops->fetch_int( view, i, col, &row_value ) != LIBMSI_RESULT_SUCCESS)
-                continue;
+            if (i % MSI_FETCH_ROWS == 0 &&
+                table_view_fetch_column_range( view, col, i, MIN( num_rows - i, MSI_FETCH_ROWS ),
+                                               values ) != LIBMSI_RESULT_SUCCESS)
+            {
+                tv->columns[col-1].hash_table = NULL;
+                msi_free( hash_table );
+                return LIBMSI_RESULT_FUNCTION_FAILED;
+            }
+            row_value = values[i % MSI_FETCH_ROWS];
 
             new_entry->next = NULL;
             new_entry->value = row_value;
@@ -1968,6 +2757,14 @@ done:
     return r;
 }
 
+static void table_view_explain( LibmsiView *view, GString *str, unsigned depth )
+{
+    LibmsiTableView *tv = (LibmsiTableView*)view;
+
+    g_string_append_printf( str, "%*sTABLE `%s` rows=%u\n", depth * 2, "", tv->name,
+                            tv->table ? tv->table->row_count : 0 );
+}
+
 static const LibmsiViewOps table_ops =
 {
     table_view_fetch_int,
@@ -1988,8 +2785,19 @@ static const LibmsiViewOps table_ops =
     table_view_remove_column,
     NULL,
     table_view_drop,
+    table_view_explain,
+    table_view_insert_rows,
+    table_view_insert_encoded,
+    table_view_fetch_column_range,
+    table_view_fetch_stream_name,
+    NULL,
 };
 
+bool msi_view_is_table( const LibmsiView *view )
+{
+    return view->ops == &table_ops;
+}
+
 unsigned table_view_create( LibmsiDatabase *db, const char *name, LibmsiView **view )
 {
     LibmsiTableView *tv ;
@@ -2001,6 +2809,8 @@ unsigned table_view_create( LibmsiDatabase *db, const char *name, LibmsiView **v
         return streams_view_create( db, view );
     else if ( !strcmp( name, szStorages ) )
         return storages_view_create( db, view );
+    else if ( strchr( name, '.' ) && !list_empty( &db->attached ) )
+        return attached_view_create( db, name, view );
 
     sz = sizeof *tv + strlen(name)*sizeof name[0] ;
     tv = msi_alloc_zero( sz );
@@ -2032,18 +2842,52 @@ unsigned table_view_create( LibmsiDatabase *db, const char *name, LibmsiView **v
     return LIBMSI_RESULT_SUCCESS;
 }
 
+/*
+ * Each table is read, encoded and written in turn, so only one table's
+ * encoded data is held at a time.  The tables of a database opened with
+ * LIBMSI_DB_FLAGS_PARALLEL are all read first and encoded concurrently,
+ * and the encoded streams are then written one after the other, since
+ * libgsf is not thread safe.
+ */
 unsigned _libmsi_database_commit_tables( LibmsiDatabase *db, unsigned bytes_per_strref )
 {
     unsigned r = LIBMSI_RESULT_SUCCESS;
+    LibmsiTableSave *saves;
+    gpointer *jobs;
     LibmsiTable *table, *table2;
     LibmsiTable *t;
+    unsigned i, count = 0;
 
     TRACE("%p\n",db);
 
     /* Ensure the Tables stream is written.  */
     get_table( db, szTables, &t );
 
-    LIST_FOR_EACH_ENTRY_SAFE( table, table2, &db->tables, LibmsiTable, entry )
+    if( !(db->flags & LIBMSI_DB_FLAGS_PARALLEL) )
+    {
+        LIST_FOR_EACH_ENTRY_SAFE( table, table2, &db->tables, LibmsiTable, entry )
+        {
+            r = get_table( db, table->name, &t );
+            if( r != LIBMSI_RESULT_SUCCESS )
+            {
+                g_warning("failed to load table %s (r=%08x)\n",
+                      debugstr_a(table->name), r);
+                return r;
+            }
+            r = save_table( db, table, bytes_per_strref );
+            if( r != LIBMSI_RESULT_SUCCESS )
+            {
+                g_warning("failed to save table %s (r=%08x)\n",
+                      debugstr_a(table->name), r);
+                return r;
+            }
+            list_remove(&table->entry);
+            free_table(table);
+        }
+        return r;
+    }
+
+    LIST_FOR_EACH_ENTRY( table, &db->tables, LibmsiTable, entry )
     {
         r = get_table( db, table->name, &t );
         if( r != LIBMSI_RESULT_SUCCESS )
@@ -2052,17 +2896,56 @@ unsigned _libmsi_database_commit_tables( LibmsiDatabase *db, unsigned bytes_per_
                   debugstr_a(table->name), r);
             return r;
         }
-        r = save_table( db, table, bytes_per_strref );
+        count++;
+    }
+
+    saves = msi_alloc_zero( count * sizeof(*saves) );
+    jobs = msi_alloc( count * sizeof(*jobs) );
+    if( !saves || !jobs )
+    {
+        msi_free( saves );
+        msi_free( jobs );
+        return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+    }
+
+    i = 0;
+    LIST_FOR_EACH_ENTRY( table, &db->tables, LibmsiTable, entry )
+    {
+        saves[i].db = db;
+        saves[i].table = table;
+        saves[i].bytes_per_strref = bytes_per_strref;
+        jobs[i] = &saves[i];
+        i++;
+    }
+
+    msi_run_jobs( encode_table_job, jobs, count );
+
+    for( i = 0; i < count; i++ )
+    {
+        LibmsiTableSave *save = &saves[i];
+
+        r = save->r;
+        if( r == LIBMSI_RESULT_SUCCESS && save->write )
+        {
+            TRACE("writing %d bytes\n", save->rawsize);
+            r = write_stream_data( db, save->table->name, save->rawdata, save->rawsize );
+        }
+        msi_free( save->rawdata );
+        save->rawdata = NULL;
         if( r != LIBMSI_RESULT_SUCCESS )
         {
             g_warning("failed to save table %s (r=%08x)\n",
-                  debugstr_a(table->name), r);
-            return r;
+                  debugstr_a(save->table->name), r);
+            break;
         }
-        list_remove(&table->entry);
-        free_table(table);
+        list_remove(&save->table->entry);
+        free_table(save->table);
     }
 
+    for( ; i < count; i++ )
+        msi_free( saves[i].rawdata );
+    msi_free( jobs );
+    msi_free( saves );
     return r;
 }
 
@@ -2390,7 +3273,7 @@ static unsigned msi_table_load_transform( LibmsiDatabase *db, GsfInfile *stg,
     TRACE("%p %p %p %s\n", db, stg, st, debugstr_a(name) );
 
     /* read the transform data */
-    read_stream_data( stg, name, &rawdata, &rawsize );
+    read_stream_data( db, stg, name, &rawdata, &rawsize );
     if ( !rawdata )
     {
         TRACE("table %s empty\n", debugstr_a(name) );
@@ -2564,7 +3447,7 @@ unsigned msi_table_apply_transform( LibmsiDatabase *db, GsfInfile *stg )
 
     TRACE("%p %p\n", db, stg );
 
-    strings = msi_load_string_table( stg, &bytes_per_strref );
+    strings = msi_load_string_table( db, stg, &bytes_per_strref );
     if( !strings )
         goto end;
 
@@ -2576,13 +3459,15 @@ unsigned msi_table_apply_transform( LibmsiDatabase *db, GsfInfile *stg )
     {
         LibmsiTableView *tv = NULL;
         const uint8_t *encname;
-        g_autofree char *name = NULL;
+        const char *name;
 
         encname = (const uint8_t *) gsf_infile_name_by_index(stg, i);
         if ( encname[0] != 0xe4 || encname[1] != 0xa1 || encname[2] != 0x80)
             continue;
 
-        name = decode_streamname((char*)encname);
+        name = msi_db_decode_streamname(db, (const char*)encname);
+        if ( !name )
+            break;
         if ( !strcmp( name+3, szStringPool ) ||
              !strcmp( name+3, szStringData ) )
             continue;
@@ -50,8 +50,10 @@ static const Keyword aKeywordTable[] = {
   { "DELETE", TK_DELETE },
   { "DISTINCT", TK_DISTINCT },
   { "DROP", TK_DROP },
+  { "EXPLAIN", TK_EXPLAIN },
   { "FREE", TK_FREE },
   { "FROM", TK_FROM },
+  { "GROUP", TK_GROUP },
   { "HOLD", TK_HOLD },
   { "INSERT", TK_INSERT },
   { "INT", TK_INT },
@@ -260,3 +262,92 @@ int sql_get_token(const char *zz, int *tokenType, int *skip){
   *tokenType = TK_ILLEGAL;
   return 1;
 }
+
+/*
+** Split a whole script into tokens, leaving out the white space, so that
+** its statements can be told apart and parsed without scanning the text
+** again.  Returns the number of tokens; the array is freed with msi_free.
+*/
+unsigned sql_tokenize(const char *z, struct sql_token **tokens){
+  unsigned n = 0, count = 0, size = 64;
+  struct sql_token *tok;
+  int len, type, skip;
+
+  *tokens = msi_alloc( size * sizeof(**tokens) );
+  if( !*tokens ) return 0;
+
+  while( z[n] ){
+    len = sql_get_token(&z[n], &type, &skip);
+    if( len<=0 ){
+      /* incomplete token, let the parser report it */
+      len = 1;
+      type = TK_ILLEGAL;
+      skip = 0;
+    }
+    if( type!=TK_SPACE ){
+      if( count==size ){
+        tok = msi_realloc( *tokens, size * 2 * sizeof(**tokens) );
+        if( !tok ){
+          msi_free( *tokens );
+          *tokens = NULL;
+          return 0;
+        }
+        *tokens = tok;
+        size *= 2;
+      }
+      tok = &(*tokens)[count++];
+      tok->type = type;
+      tok->offset = n;
+      tok->len = len;
+      tok->skip = skip;
+    }
+    n += len + skip;
+  }
+  return count;
+}
+
+/*
+** Return true if the i-th token of a script is the SELECT of an
+** INSERT INTO table ( columns ) SELECT statement.
+*/
+static bool sql_is_insert_select(const struct sql_token *tokens, unsigned i){
+  if( i==0 || tokens[i-1].type!=TK_RP ) return false;
+
+  /* the column list holds no nested parentheses */
+  for( i--; i>0 && tokens[i].type!=TK_LP; i-- ){}
+  return i>=2 && tokens[i-1].type==TK_ID && tokens[i-2].type==TK_INTO;
+}
+
+/*
+** Return true if the statement starting at tokens changes the schema.
+*/
+bool sql_changes_schema(const struct sql_token *tokens){
+  switch( tokens[0].type ){
+    case TK_ALTER:
+    case TK_CREATE:
+    case TK_DROP:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/*
+** Return true if the i-th token of a script begins a new statement.
+*/
+bool sql_starts_statement(const struct sql_token *tokens, unsigned i){
+  switch( tokens[i].type ){
+    case TK_ALTER:
+    case TK_CREATE:
+    case TK_DELETE:
+    case TK_DROP:
+    case TK_EXPLAIN:
+    case TK_INSERT:
+    case TK_UPDATE:
+      return true;
+    case TK_SELECT:
+      return i==0 || (tokens[i-1].type!=TK_EXPLAIN && !sql_is_insert_select(tokens, i));
+    default:
+      return false;
+  }
+}
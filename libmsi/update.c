@@ -204,6 +204,13 @@ static const LibmsiViewOps update_ops =
     NULL,
     NULL,
     NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
 };
 
 unsigned update_view_create( LibmsiDatabase *db, LibmsiView **view, char *table,
@@ -21,6 +21,11 @@
 
 #include <stdarg.h>
 #include <assert.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "debug.h"
 #include "libmsi.h"
@@ -43,12 +48,16 @@ typedef struct tagJOINTABLE
     unsigned col_count;
     unsigned row_count;
     unsigned table_index;
+    unsigned join_order;    /* position in the join chosen by ordertables */
+    unsigned rows_scanned;
+    unsigned rows_matched;
+    unsigned hash_lookups;  /* rows of the outer tables looked up with find_matching_rows */
 } JOINTABLE;
 
 typedef struct _LibmsiOrderInfo
 {
     unsigned col_count;
-    unsigned error;
+    unsigned **keys;        /* while sorting, the values of each column by row of its table */
     union ext_column columns[1];
 } LibmsiOrderInfo;
 
@@ -65,6 +74,10 @@ typedef struct _LibmsiWhereView
     struct expr   *cond;
     unsigned           rec_index;
     LibmsiOrderInfo  *order_info;
+    unsigned           index_lookups; /* prefix patterns resolved by the string index */
+    unsigned           index_hits;    /* rows matched through those */
+    unsigned           partitions;    /* number of threads that scanned the table */
+    bool               batch;         /* condition is evaluated a block of rows at a time */
 } LibmsiWhereView;
 
 static unsigned where_view_evaluate( LibmsiWhereView *wv, const unsigned rows[],
@@ -74,6 +87,14 @@ static unsigned where_view_evaluate( LibmsiWhereView *wv, const unsigned rows[],
 
 #define INVALID_ROW_INDEX (-1)
 
+/* smallest table that is split between threads when the database
+ * was opened with LIBMSI_DB_FLAGS_PARALLEL */
+#define PARALLEL_SCAN_MIN_ROWS 16384
+
+/* rows evaluated together by the batch path, a multiple of 32 */
+#define BATCH_ROWS 1024
+#define BATCH_WORDS (BATCH_ROWS / 32)
+
 static void free_reorder(LibmsiWhereView *wv)
 {
     unsigned i;
@@ -228,6 +249,35 @@ static unsigned where_view_fetch_int( LibmsiView *view, unsigned row, unsigned c
     return table->view->ops->fetch_int(table->view, rows[table->table_index], col, val);
 }
 
+static unsigned where_view_fetch_column_range( LibmsiView *view, unsigned col, unsigned first,
+                                               unsigned count, unsigned *out )
+{
+    LibmsiWhereView *wv = (LibmsiWhereView*)view;
+    JOINTABLE *table;
+    unsigned i, r;
+
+    TRACE("%p %d %d %d %p\n", wv, col, first, count, out );
+
+    if( !wv->tables )
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    if (first > wv->row_count || count > wv->row_count - first)
+        return NO_MORE_ITEMS;
+
+    table = find_table(wv, col, &col);
+    if (!table)
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    for (i = 0; i < count; i++)
+    {
+        r = table->view->ops->fetch_int(table->view, wv->reorder[first + i]->values[table->table_index],
+                                        col, &out[i]);
+        if (r != LIBMSI_RESULT_SUCCESS)
+            return r;
+    }
+    return LIBMSI_RESULT_SUCCESS;
+}
+
 static unsigned where_view_fetch_stream( LibmsiView *view, unsigned row, unsigned col, GsfInput **stm )
 {
     LibmsiWhereView *wv = (LibmsiWhereView*)view;
@@ -251,6 +301,31 @@ static unsigned where_view_fetch_stream( LibmsiView *view, unsigned row, unsigne
     return table->view->ops->fetch_stream( table->view, rows[table->table_index], col, stm );
 }
 
+static unsigned where_view_fetch_stream_name( LibmsiView *view, unsigned row, unsigned col,
+                                              LibmsiDatabase **db, const char **name,
+                                              const char **encname )
+{
+    LibmsiWhereView *wv = (LibmsiWhereView*)view;
+    JOINTABLE *table;
+    unsigned *rows;
+    unsigned r;
+
+    TRACE("%p %d %d\n", wv, row, col );
+
+    if( !wv->tables )
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    r = find_row(wv, row, &rows);
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
+
+    table = find_table(wv, col, &col);
+    if (!table)
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    return msi_view_fetch_stream_name( table->view, rows[table->table_index], col, db, name, encname );
+}
+
 static unsigned where_view_get_row( LibmsiView *view, unsigned row, LibmsiRecord **rec )
 {
     LibmsiWhereView *wv = (LibmsiWhereView *)view;
@@ -355,6 +430,9 @@ static unsigned where_view_delete_row(LibmsiView *view, unsigned row)
     if (wv->table_count > 1)
         return LIBMSI_RESULT_CALL_NOT_IMPLEMENTED;
 
+    if (!wv->tables->view->ops->delete_row)
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
     return wv->tables->view->ops->delete_row(wv->tables->view, rows[0]);
 }
 
@@ -538,6 +616,80 @@ static unsigned expr_eval_strcmp( LibmsiWhereView *wv, const unsigned rows[], co
     return LIBMSI_RESULT_SUCCESS;
 }
 
+/* '%' matches any run of characters and '_' exactly one; on a mismatch
+ * only the most recent '%' needs to be retried, so this is a single pass */
+static bool like_match( const char *str, const char *pattern )
+{
+    const char *star = NULL, *retry = NULL;
+
+    while (*str)
+    {
+        if (*pattern == '%')
+        {
+            while (*pattern == '%')
+                pattern++;
+            if (!*pattern)
+                return true;
+            star = pattern;
+            retry = str;
+        }
+        else if (*pattern == '_')
+        {
+            pattern++;
+            str = g_utf8_next_char( str );
+        }
+        else if (*pattern == *str)
+        {
+            pattern++;
+            str++;
+        }
+        else if (star)
+        {
+            pattern = star;
+            retry = g_utf8_next_char( retry );
+            str = retry;
+        }
+        else
+            return false;
+    }
+
+    while (*pattern == '%')
+        pattern++;
+    return !*pattern;
+}
+
+static unsigned expr_eval_like( LibmsiWhereView *wv, const unsigned rows[], const struct complex_expr *expr,
+                             int *val, const LibmsiRecord *record )
+{
+    const struct expr *pattern = expr->right;
+    const char *str, *pat;
+    unsigned r, id;
+
+    *val = true;
+    r = expr_fetch_value(&expr->left->u.column, rows, &id);
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
+
+    if (pattern->type == EXPR_PREFIX)
+    {
+        *val = id < pattern->u.prefix.size &&
+               (pattern->u.prefix.ids[id / 32] & (1u << (id % 32)));
+        if (*val)
+            wv->index_hits++;
+        return LIBMSI_RESULT_SUCCESS;
+    }
+
+    r = expr_eval_string(wv, rows, pattern, record, &pat);
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
+
+    /* NULL is not like anything, not even '%' */
+    str = msi_string_lookup_id(wv->db->strings, id);
+    *val = str && pat && like_match( str, pat );
+
+    return LIBMSI_RESULT_SUCCESS;
+}
+
 static unsigned where_view_evaluate( LibmsiWhereView *wv, const unsigned rows[],
                             struct expr *cond, int *val, LibmsiRecord *record )
 {
@@ -578,6 +730,9 @@ static unsigned where_view_evaluate( LibmsiWhereView *wv, const unsigned rows[],
     case EXPR_STRCMP:
         return expr_eval_strcmp( wv, rows, &cond->u.expr, val, record );
 
+    case EXPR_LIKE:
+        return expr_eval_like( wv, rows, &cond->u.expr, val, record );
+
     case EXPR_WILDCARD:
         *val = libmsi_record_get_int( record, ++wv->rec_index );
         return LIBMSI_RESULT_SUCCESS;
@@ -590,23 +745,106 @@ static unsigned where_view_evaluate( LibmsiWhereView *wv, const unsigned rows[],
     return LIBMSI_RESULT_SUCCESS;
 }
 
+static bool is_column_expr( const struct expr *e )
+{
+    return e->type == EXPR_COL_NUMBER || e->type == EXPR_COL_NUMBER32 ||
+           e->type == EXPR_COL_NUMBER_STRING;
+}
+
+/*
+ * Looks in the top level ANDs of cond for an equality between a column
+ * of table and a column of a table whose row is already chosen.  Both
+ * columns hold the same encoding, so matching rows have the same value;
+ * for strings that only holds when string_ids is set, i.e. the pool
+ * stores each text under a single id.
+ */
+static bool find_join_columns( const struct expr *cond, const JOINTABLE *table,
+                               const unsigned table_rows[], bool string_ids,
+                               const union ext_column **inner, const union ext_column **outer )
+{
+    const struct expr *l, *r;
+
+    if (!cond || (cond->type != EXPR_COMPLEX && cond->type != EXPR_STRCMP))
+        return false;
+
+    if (cond->type == EXPR_COMPLEX && cond->u.expr.op == OP_AND)
+        return find_join_columns( cond->u.expr.left, table, table_rows, string_ids, inner, outer ) ||
+               find_join_columns( cond->u.expr.right, table, table_rows, string_ids, inner, outer );
+
+    if (cond->u.expr.op != OP_EQ)
+        return false;
+
+    l = cond->u.expr.left;
+    r = cond->u.expr.right;
+    if (!is_column_expr( l ) || l->type != r->type)
+        return false;
+    if (l->type == EXPR_COL_NUMBER_STRING && !string_ids)
+        return false;
+
+    if (r->u.column.parsed.table == table)
+    {
+        const struct expr *t = l;
+        l = r;
+        r = t;
+    }
+    if (l->u.column.parsed.table != table || r->u.column.parsed.table == table ||
+        table_rows[r->u.column.parsed.table->table_index] == INVALID_ROW_INDEX)
+        return false;
+
+    *inner = &l->u.column;
+    *outer = &r->u.column;
+    return true;
+}
+
 static unsigned check_condition( LibmsiWhereView *wv, LibmsiRecord *record, JOINTABLE **tables,
                              unsigned table_rows[] )
 {
     unsigned r = LIBMSI_RESULT_FUNCTION_FAILED;
+    const union ext_column *inner, *outer;
+    MSIITERHANDLE handle = NULL;
+    LibmsiView *view = (*tables)->view;
+    unsigned row, value = 0;
+    bool hashed;
     int val;
 
-    for (table_rows[(*tables)->table_index] = 0;
-         table_rows[(*tables)->table_index] < (*tables)->row_count;
-         table_rows[(*tables)->table_index]++)
+    /* joined on a column of a table we already have a row for, so only
+     * the rows with a matching value need to be evaluated */
+    hashed = view->ops->find_matching_rows &&
+             find_join_columns( wv->cond, *tables, table_rows,
+                                !msi_string_has_duplicates( wv->db->strings ), &inner, &outer );
+    if (hashed)
     {
+        r = outer->parsed.table->view->ops->fetch_int( outer->parsed.table->view,
+                table_rows[outer->parsed.table->table_index], outer->parsed.column, &value );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            return r;
+        (*tables)->hash_lookups++;
+    }
+
+    for (row = 0; ; row++)
+    {
+        if (hashed)
+        {
+            if (view->ops->find_matching_rows( view, inner->parsed.column, value,
+                                               &row, &handle ) != LIBMSI_RESULT_SUCCESS)
+            {
+                r = LIBMSI_RESULT_SUCCESS;
+                break;
+            }
+        }
+        else if (row >= (*tables)->row_count)
+            break;
+
+        table_rows[(*tables)->table_index] = row;
         val = 0;
         wv->rec_index = 0;
+        (*tables)->rows_scanned++;
         r = where_view_evaluate( wv, table_rows, wv->cond, &val, record );
         if (r != LIBMSI_RESULT_SUCCESS && r != LIBMSI_RESULT_CONTINUE)
             break;
         if (val)
         {
+            (*tables)->rows_matched++;
             if (*(tables + 1))
             {
                 r = check_condition(wv, record, tables + 1, table_rows);
@@ -625,13 +863,488 @@ static unsigned check_condition( LibmsiWhereView *wv, LibmsiRecord *record, JOIN
     return r;
 }
 
+/*
+ * Conditions on a single table made only of comparisons between columns
+ * and constants can be evaluated for a block of rows at once: each
+ * column is read into an array and each comparison sets one bit per row
+ * in a bitmap, which AND and OR then combine a word at a time.
+ */
+static bool batch_operand( const struct expr *e, bool string )
+{
+    switch (e->type)
+    {
+    case EXPR_COL_NUMBER:
+    case EXPR_COL_NUMBER32:
+    case EXPR_UVAL:
+        return !string;
+    case EXPR_COL_NUMBER_STRING:
+    case EXPR_SVAL:
+        return string;
+    case EXPR_WILDCARD:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool batch_supported( const LibmsiWhereView *wv, const struct expr *cond )
+{
+    switch (cond->type)
+    {
+    case EXPR_COMPLEX:
+        if (cond->u.expr.op == OP_AND || cond->u.expr.op == OP_OR)
+            return batch_supported( wv, cond->u.expr.left ) &&
+                   batch_supported( wv, cond->u.expr.right );
+        return cond->u.expr.op >= OP_EQ && cond->u.expr.op <= OP_NE &&
+               batch_operand( cond->u.expr.left, false ) &&
+               batch_operand( cond->u.expr.right, false );
+    case EXPR_STRCMP:
+        /* strings are compared by id, the text path handles duplicates */
+        return !msi_string_has_duplicates( wv->db->strings ) &&
+               batch_operand( cond->u.expr.left, true ) &&
+               batch_operand( cond->u.expr.right, true );
+    case EXPR_UNARY:
+        return true;
+    case EXPR_LIKE:
+        return cond->u.expr.right->type == EXPR_PREFIX;
+    default:
+        return false;
+    }
+}
+
+static inline unsigned fetch_column( const union ext_column *column, unsigned first,
+                                     unsigned count, unsigned *out )
+{
+    return msi_view_fetch_column_range( column->parsed.table->view, column->parsed.column,
+                                        first, count, out );
+}
+
+static unsigned batch_string_id( const LibmsiWhereView *wv, const char *str )
+{
+    unsigned id;
+
+    if (!str || !*str)
+        return 0;
+    /* a string that isn't in the table doesn't match any row */
+    if (_libmsi_id_from_string_utf8( wv->db->strings, str, &id ) != LIBMSI_RESULT_SUCCESS)
+        return ~0u;
+    return id;
+}
+
+/* fills out with the values where_view_evaluate would give for each row */
+static unsigned load_operand( LibmsiWhereView *wv, const struct expr *e, LibmsiRecord *record,
+                              bool string, unsigned first, unsigned count, int *out )
+{
+    unsigned i, r, val;
+
+    switch (e->type)
+    {
+    case EXPR_COL_NUMBER:
+        r = fetch_column( &e->u.column, first, count, (unsigned *)out );
+        for (i = 0; i < count; i++)
+            out[i] -= 0x8000;
+        return r;
+
+    case EXPR_COL_NUMBER32:
+        r = fetch_column( &e->u.column, first, count, (unsigned *)out );
+        for (i = 0; i < count; i++)
+            out[i] ^= 0x80000000;
+        return r;
+
+    case EXPR_COL_NUMBER_STRING:
+        return fetch_column( &e->u.column, first, count, (unsigned *)out );
+
+    case EXPR_UVAL:
+        val = e->u.uval;
+        break;
+
+    case EXPR_SVAL:
+        val = batch_string_id( wv, e->u.sval );
+        break;
+
+    case EXPR_WILDCARD:
+        if (string)
+            val = batch_string_id( wv, _libmsi_record_get_string_raw( record, ++wv->rec_index ) );
+        else
+            val = libmsi_record_get_int( record, ++wv->rec_index );
+        break;
+
+    default:
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+    }
+
+    for (i = 0; i < count; i++)
+        out[i] = val;
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+static inline bool compare_int( int a, int b, unsigned op )
+{
+    switch (op)
+    {
+    case OP_EQ: return a == b;
+    case OP_GT: return a > b;
+    default:    return a < b;
+    }
+}
+
+/* sets bit i of bits when a[i] op b[i], the bits past count in the
+ * last word are cleared */
+static void compare_block( const int *a, const int *b, unsigned count, unsigned op, unsigned *bits )
+{
+    bool invert = false;
+    unsigned i, j, word;
+
+    /* only equal, greater and less have vector instructions */
+    switch (op)
+    {
+    case OP_NE: op = OP_EQ; invert = true; break;
+    case OP_LE: op = OP_GT; invert = true; break;
+    case OP_GE: op = OP_LT; invert = true; break;
+    }
+
+    for (i = 0; i + 32 <= count; i += 32)
+    {
+        word = 0;
+#if defined(__AVX2__)
+        for (j = 0; j < 32; j += 8)
+        {
+            __m256i x = _mm256_loadu_si256( (const __m256i *)(a + i + j) );
+            __m256i y = _mm256_loadu_si256( (const __m256i *)(b + i + j) );
+            __m256i m = op == OP_EQ ? _mm256_cmpeq_epi32( x, y ) :
+                        op == OP_GT ? _mm256_cmpgt_epi32( x, y ) : _mm256_cmpgt_epi32( y, x );
+            word |= (unsigned)_mm256_movemask_ps( _mm256_castsi256_ps( m ) ) << j;
+        }
+#elif defined(__SSE2__)
+        for (j = 0; j < 32; j += 4)
+        {
+            __m128i x = _mm_loadu_si128( (const __m128i *)(a + i + j) );
+            __m128i y = _mm_loadu_si128( (const __m128i *)(b + i + j) );
+            __m128i m = op == OP_EQ ? _mm_cmpeq_epi32( x, y ) :
+                        op == OP_GT ? _mm_cmpgt_epi32( x, y ) : _mm_cmplt_epi32( x, y );
+            word |= (unsigned)_mm_movemask_ps( _mm_castsi128_ps( m ) ) << j;
+        }
+#else
+        for (j = 0; j < 32; j++)
+            word |= (unsigned)compare_int( a[i + j], b[i + j], op ) << j;
+#endif
+        bits[i / 32] = invert ? ~word : word;
+    }
+
+    if (i < count)
+    {
+        word = 0;
+        for (j = 0; i + j < count; j++)
+            word |= (unsigned)compare_int( a[i + j], b[i + j], op ) << j;
+        if (invert)
+            word = ~word & ((1u << j) - 1);
+        bits[i / 32] = word;
+    }
+}
+
+static unsigned eval_block( LibmsiWhereView *wv, const struct expr *cond, LibmsiRecord *record,
+                            unsigned first, unsigned count, unsigned *bits );
+
+static unsigned eval_block_compare( LibmsiWhereView *wv, const struct expr *cond, LibmsiRecord *record,
+                                    unsigned first, unsigned count, unsigned *bits )
+{
+    int a[BATCH_ROWS], b[BATCH_ROWS];
+    bool string = cond->type == EXPR_STRCMP;
+    unsigned r, i, hits;
+
+    switch (cond->type)
+    {
+    case EXPR_UNARY:
+        r = fetch_column( &cond->u.expr.left->u.column, first, count, (unsigned *)a );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            return r;
+        memset( b, 0, count * sizeof(*b) );
+        compare_block( a, b, count, cond->u.expr.op == OP_ISNULL ? OP_EQ : OP_NE, bits );
+        return LIBMSI_RESULT_SUCCESS;
+
+    case EXPR_LIKE:
+    {
+        const struct expr *pattern = cond->u.expr.right;
+
+        r = fetch_column( &cond->u.expr.left->u.column, first, count, (unsigned *)a );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            return r;
+        memset( bits, 0, BATCH_WORDS * sizeof(*bits) );
+        for (i = hits = 0; i < count; i++)
+        {
+            unsigned id = a[i];
+
+            if (id < pattern->u.prefix.size &&
+                (pattern->u.prefix.ids[id / 32] & (1u << (id % 32))))
+            {
+                bits[i / 32] |= 1u << (i % 32);
+                hits++;
+            }
+        }
+        wv->index_hits += hits;
+        return LIBMSI_RESULT_SUCCESS;
+    }
+
+    default:
+        r = load_operand( wv, cond->u.expr.left, record, string, first, count, a );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            return r;
+        r = load_operand( wv, cond->u.expr.right, record, string, first, count, b );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            return r;
+        compare_block( a, b, count, cond->u.expr.op, bits );
+        return LIBMSI_RESULT_SUCCESS;
+    }
+}
+
+static unsigned eval_block( LibmsiWhereView *wv, const struct expr *cond, LibmsiRecord *record,
+                            unsigned first, unsigned count, unsigned *bits )
+{
+    unsigned right[BATCH_WORDS];
+    unsigned i, r, words = (count + 31) / 32;
+
+    if (cond->type != EXPR_COMPLEX ||
+        (cond->u.expr.op != OP_AND && cond->u.expr.op != OP_OR))
+        return eval_block_compare( wv, cond, record, first, count, bits );
+
+    /* both sides are evaluated, so wildcards are numbered as they are
+     * by where_view_evaluate */
+    r = eval_block( wv, cond->u.expr.left, record, first, count, bits );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
+    r = eval_block( wv, cond->u.expr.right, record, first, count, right );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
+
+    if (cond->u.expr.op == OP_AND)
+        for (i = 0; i < words; i++)
+            bits[i] &= right[i];
+    else
+        for (i = 0; i < words; i++)
+            bits[i] |= right[i];
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+/*
+ * Evaluates the condition for up to BATCH_ROWS rows of a single table
+ * from first, storing the rows that match in matches.
+ */
+static unsigned scan_block( LibmsiWhereView *wv, LibmsiRecord *record, unsigned first,
+                            unsigned count, unsigned *matches, unsigned *found )
+{
+    unsigned bits[BATCH_WORDS];
+    unsigned i, r, row;
+    gint bit;
+    int val;
+
+    *found = 0;
+    if (!wv->batch)
+    {
+        for (row = first; row < first + count; row++)
+        {
+            val = 0;
+            wv->rec_index = 0;
+            r = where_view_evaluate( wv, &row, wv->cond, &val, record );
+            if (r != LIBMSI_RESULT_SUCCESS)
+                return r;
+            if (val)
+                matches[(*found)++] = row;
+        }
+        return LIBMSI_RESULT_SUCCESS;
+    }
+
+    wv->rec_index = 0;
+    r = eval_block( wv, wv->cond, record, first, count, bits );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
+
+    for (i = 0; i < (count + 31) / 32; i++)
+    {
+        for (bit = -1; (bit = g_bit_nth_lsf( bits[i], bit )) >= 0; )
+            matches[(*found)++] = first + i * 32 + bit;
+    }
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+static unsigned check_condition_batch( LibmsiWhereView *wv, LibmsiRecord *record )
+{
+    JOINTABLE *table = wv->tables;
+    unsigned matches[BATCH_ROWS];
+    unsigned first, count, found, i, r = LIBMSI_RESULT_SUCCESS;
+
+    for (first = 0; first < table->row_count; first += count)
+    {
+        count = MIN( table->row_count - first, BATCH_ROWS );
+        r = scan_block( wv, record, first, count, matches, &found );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            break;
+
+        table->rows_scanned += count;
+        table->rows_matched += found;
+        for (i = 0; r == LIBMSI_RESULT_SUCCESS && i < found; i++)
+            r = add_row( wv, &matches[i] );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            break;
+    }
+    return r;
+}
+
+typedef struct _LibmsiScanPartition
+{
+    LibmsiWhereView wv;     /* private copy, evaluating updates rec_index and index_hits */
+    LibmsiRecord *record;
+    unsigned first;
+    unsigned last;
+    unsigned *matches;
+    unsigned count;
+    unsigned r;
+} LibmsiScanPartition;
+
+static void scan_partition( gpointer data, gpointer user_data )
+{
+    LibmsiScanPartition *part = data;
+    unsigned first, count, found;
+
+    for (first = part->first; first < part->last; first += count)
+    {
+        count = MIN( part->last - first, BATCH_ROWS );
+        part->r = scan_block( &part->wv, part->record, first, count,
+                              part->matches + part->count, &found );
+        part->count += found;
+        if (part->r != LIBMSI_RESULT_SUCCESS)
+            break;
+    }
+}
+
+static unsigned use_parallel_scan( const LibmsiWhereView *wv )
+{
+    unsigned n;
+
+    if (!(wv->db->flags & LIBMSI_DB_FLAGS_PARALLEL) || wv->table_count != 1 ||
+        wv->tables->row_count < PARALLEL_SCAN_MIN_ROWS ||
+        !msi_view_is_table( wv->tables->view ))
+        return 0;
+
+    n = g_get_num_processors();
+    if (n > wv->tables->row_count / (PARALLEL_SCAN_MIN_ROWS / 4))
+        n = wv->tables->row_count / (PARALLEL_SCAN_MIN_ROWS / 4);
+    return n > 1 ? n : 0;
+}
+
+/*
+ * Splits the rows of a single cached table into contiguous ranges and
+ * evaluates the condition on each range in a thread of its own.  The
+ * matches are then added range by range, so they keep the order of a
+ * sequential scan.  Evaluating only reads the table data, the string
+ * table and the record.
+ */
+static unsigned check_condition_parallel( LibmsiWhereView *wv, LibmsiRecord *record,
+                                          unsigned count )
+{
+    JOINTABLE *table = wv->tables;
+    LibmsiScanPartition *parts;
+    GThreadPool *pool;
+    unsigned i, j, r = LIBMSI_RESULT_SUCCESS;
+
+    parts = msi_alloc_zero( count * sizeof(*parts) );
+    if (!parts)
+        return LIBMSI_RESULT_OUTOFMEMORY;
+
+    for (i = 0; i < count; i++)
+    {
+        parts[i].wv = *wv;
+        parts[i].wv.index_hits = 0;
+        parts[i].record = record;
+        parts[i].first = (guint64)table->row_count * i / count;
+        parts[i].last = (guint64)table->row_count * (i + 1) / count;
+        parts[i].matches = msi_alloc( (parts[i].last - parts[i].first) * sizeof(unsigned) );
+        if (!parts[i].matches)
+            r = LIBMSI_RESULT_OUTOFMEMORY;
+    }
+
+    if (r == LIBMSI_RESULT_SUCCESS)
+    {
+        pool = g_thread_pool_new( scan_partition, NULL, count - 1, FALSE, NULL );
+        if (pool)
+        {
+            for (i = 1; i < count; i++)
+                g_thread_pool_push( pool, &parts[i], NULL );
+        }
+        else
+        {
+            for (i = 1; i < count; i++)
+                scan_partition( &parts[i], NULL );
+        }
+
+        /* the first range is ours */
+        scan_partition( &parts[0], NULL );
+        if (pool)
+            g_thread_pool_free( pool, FALSE, TRUE );
+
+        for (i = 0; i < count; i++)
+        {
+            table->rows_scanned += parts[i].last - parts[i].first;
+            table->rows_matched += parts[i].count;
+            wv->index_hits += parts[i].wv.index_hits;
+            for (j = 0; r == LIBMSI_RESULT_SUCCESS && j < parts[i].count; j++)
+                r = add_row( wv, &parts[i].matches[j] );
+            if (r == LIBMSI_RESULT_SUCCESS)
+                r = parts[i].r;
+        }
+        wv->partitions = count;
+    }
+
+    for (i = 0; i < count; i++)
+        msi_free( parts[i].matches );
+    msi_free( parts );
+    return r;
+}
+
+/* reads each ORDER BY column whole, rather than a value per comparison */
+static unsigned load_order_keys( LibmsiOrderInfo *order )
+{
+    unsigned i, r;
+
+    order->keys = msi_alloc_zero( order->col_count * sizeof(*order->keys) );
+    if (!order->keys)
+        return LIBMSI_RESULT_OUTOFMEMORY;
+
+    for (i = 0; i < order->col_count; i++)
+    {
+        const JOINTABLE *table = order->columns[i].parsed.table;
+
+        order->keys[i] = msi_alloc( (table->row_count ? table->row_count : 1) * sizeof(unsigned) );
+        if (!order->keys[i])
+            return LIBMSI_RESULT_OUTOFMEMORY;
+
+        r = msi_view_fetch_column_range( table->view, order->columns[i].parsed.column,
+                                         0, table->row_count, order->keys[i] );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            return r;
+    }
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+static void free_order_keys( LibmsiOrderInfo *order )
+{
+    unsigned i;
+
+    if (!order->keys)
+        return;
+
+    for (i = 0; i < order->col_count; i++)
+        msi_free( order->keys[i] );
+    msi_free( order->keys );
+    order->keys = NULL;
+}
+
 static int compare_entry( const void *left, const void *right )
 {
     const LibmsiRowEntry *le = *(const LibmsiRowEntry**)left;
     const LibmsiRowEntry *re = *(const LibmsiRowEntry**)right;
     const LibmsiWhereView *wv = le->wv;
     LibmsiOrderInfo *order = wv->order_info;
-    unsigned i, j, r, l_val, r_val;
+    unsigned i, j, l_val, r_val;
 
     assert(le->wv == re->wv);
 
@@ -639,26 +1352,10 @@ static int compare_entry( const void *left, const void *right )
     {
         for (i = 0; i < order->col_count; i++)
         {
-            const union ext_column *column = &order->columns[i];
-
-            r = column->parsed.table->view->ops->fetch_int(column->parsed.table->view,
-                          le->values[column->parsed.table->table_index],
-                          column->parsed.column, &l_val);
-            if (r != LIBMSI_RESULT_SUCCESS)
-            {
-                order->error = r;
-                return 0;
-            }
-
-            r = column->parsed.table->view->ops->fetch_int(column->parsed.table->view,
-                          re->values[column->parsed.table->table_index],
-                          column->parsed.column, &r_val);
-            if (r != LIBMSI_RESULT_SUCCESS)
-            {
-                order->error = r;
-                return 0;
-            }
+            unsigned index = order->columns[i].parsed.table->table_index;
 
+            l_val = order->keys[i][le->values[index]];
+            r_val = order->keys[i][re->values[index]];
             if (l_val != r_val)
                 return l_val < r_val ? -1 : 1;
         }
@@ -701,6 +1398,7 @@ static unsigned reorder_check( const struct expr *expr, JOINTABLE **ordered_tabl
     {
         case EXPR_WILDCARD:
         case EXPR_SVAL:
+        case EXPR_PREFIX:
         case EXPR_UVAL:
             return 0;
         case EXPR_COL_NUMBER:
@@ -711,6 +1409,7 @@ static unsigned reorder_check( const struct expr *expr, JOINTABLE **ordered_tabl
             *lastused = expr->u.column.parsed.table;
             return CONST_EXPR;
         case EXPR_STRCMP:
+        case EXPR_LIKE:
         case EXPR_COMPLEX:
             res = reorder_check(expr->u.expr.right, ordered_tables, process_joins, lastused);
             /* fall through */
@@ -730,6 +1429,58 @@ static unsigned reorder_check( const struct expr *expr, JOINTABLE **ordered_tabl
     }
 }
 
+/* looks up the strings matching each 'prefix%' pattern in the string table,
+ * which may have changed since the last execution */
+static unsigned load_prefixes( LibmsiWhereView *wv, struct expr *cond )
+{
+    unsigned r;
+
+    switch (cond->type)
+    {
+    case EXPR_PREFIX:
+        msi_free( cond->u.prefix.ids );
+        cond->u.prefix.ids = msi_string_find_prefix( wv->db->strings, cond->u.prefix.str,
+                                                     &cond->u.prefix.size );
+        if (!cond->u.prefix.ids)
+            return LIBMSI_RESULT_OUTOFMEMORY;
+        wv->index_lookups++;
+        return LIBMSI_RESULT_SUCCESS;
+    case EXPR_COMPLEX:
+    case EXPR_STRCMP:
+    case EXPR_LIKE:
+        r = load_prefixes( wv, cond->u.expr.right );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            return r;
+        /* fall through */
+    case EXPR_UNARY:
+        return load_prefixes( wv, cond->u.expr.left );
+    default:
+        return LIBMSI_RESULT_SUCCESS;
+    }
+}
+
+static void free_prefixes( struct expr *cond )
+{
+    switch (cond->type)
+    {
+    case EXPR_PREFIX:
+        msi_free( cond->u.prefix.ids );
+        cond->u.prefix.ids = NULL;
+        cond->u.prefix.size = 0;
+        break;
+    case EXPR_COMPLEX:
+    case EXPR_STRCMP:
+    case EXPR_LIKE:
+        free_prefixes( cond->u.expr.right );
+        /* fall through */
+    case EXPR_UNARY:
+        free_prefixes( cond->u.expr.left );
+        break;
+    default:
+        break;
+    }
+}
+
 /* reorders the tablelist in a way to evaluate the condition as fast as possible */
 static JOINTABLE **ordertables( LibmsiWhereView *wv )
 {
@@ -773,6 +1524,19 @@ static unsigned where_view_execute( LibmsiView *view, LibmsiRecord *record )
     if (r != LIBMSI_RESULT_SUCCESS)
         return r;
 
+    wv->index_lookups = 0;
+    wv->index_hits = 0;
+    wv->partitions = 0;
+    wv->batch = false;
+    do
+    {
+        table->rows_scanned = 0;
+        table->rows_matched = 0;
+        table->hash_lookups = 0;
+    }
+    while ((table = table->next));
+
+    table = wv->tables;
     do
     {
         table->view->ops->execute(table->view, NULL);
@@ -790,21 +1554,40 @@ static unsigned where_view_execute( LibmsiView *view, LibmsiRecord *record )
     }
     while ((table = table->next));
 
+    if (wv->cond)
+    {
+        r = load_prefixes( wv, wv->cond );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            return r;
+    }
+
     ordered_tables = ordertables( wv );
+    for (i = 0; ordered_tables[i]; i++)
+        ordered_tables[i]->join_order = i;
 
     rows = msi_alloc( wv->table_count * sizeof(*rows) );
     for (i = 0; i < wv->table_count; i++)
         rows[i] = INVALID_ROW_INDEX;
 
-    r =  check_condition(wv, record, ordered_tables, rows);
+    if (wv->table_count == 1 && wv->cond)
+        wv->batch = batch_supported( wv, wv->cond );
+
+    i = use_parallel_scan( wv );
+    if (i)
+        r = check_condition_parallel( wv, record, i );
+    else if (wv->batch)
+        r = check_condition_batch( wv, record );
+    else
+        r = check_condition( wv, record, ordered_tables, rows );
 
     if (wv->order_info)
-        wv->order_info->error = LIBMSI_RESULT_SUCCESS;
+        r = load_order_keys( wv->order_info );
 
-    qsort(wv->reorder, wv->row_count, sizeof(LibmsiRowEntry *), compare_entry);
+    if (!wv->order_info || r == LIBMSI_RESULT_SUCCESS)
+        qsort(wv->reorder, wv->row_count, sizeof(LibmsiRowEntry *), compare_entry);
 
     if (wv->order_info)
-        r = wv->order_info->error;
+        free_order_keys( wv->order_info );
 
     msi_free( rows );
     msi_free( ordered_tables );
@@ -889,6 +1672,9 @@ static unsigned where_view_delete( LibmsiView *view )
     wv->tables = NULL;
     wv->table_count = 0;
 
+    if (wv->cond)
+        free_prefixes(wv->cond);
+
     free_reorder(wv);
 
     msi_free(wv->order_info);
@@ -958,6 +1744,7 @@ static unsigned where_view_sort(LibmsiView *view, column_info *columns)
         return LIBMSI_RESULT_OUTOFMEMORY;
 
     orderinfo->col_count = count;
+    orderinfo->keys = NULL;
 
     column = columns;
 
@@ -979,6 +1766,43 @@ error:
     return r;
 }
 
+static void where_view_explain( LibmsiView *view, GString *str, unsigned depth )
+{
+    LibmsiWhereView *wv = (LibmsiWhereView*)view;
+    JOINTABLE *table;
+    unsigned i;
+
+    g_string_append_printf( str, "%*sWHERE join=%s rows=%u", depth * 2, "",
+                            wv->table_count > 1 ? "nested-loop" : "scan", wv->row_count );
+    if (wv->index_lookups)
+        g_string_append_printf( str, " index=prefix hits=%u", wv->index_hits );
+    if (wv->batch)
+        g_string_append( str, " eval=batch" );
+    if (wv->partitions)
+        g_string_append_printf( str, " partitions=%u", wv->partitions );
+    if (wv->order_info)
+        g_string_append_printf( str, " order=%u", wv->order_info->col_count );
+    g_string_append_c( str, '\n' );
+
+    /* outermost loop first */
+    for (i = 0; i < wv->table_count; i++)
+    {
+        for (table = wv->tables; table; table = table->next)
+        {
+            if (table->join_order != i)
+                continue;
+
+            g_string_append_printf( str, "%*sSCAN step=%u scanned=%u matched=%u",
+                                    (depth + 1) * 2, "", i + 1,
+                                    table->rows_scanned, table->rows_matched );
+            if (table->hash_lookups)
+                g_string_append_printf( str, " hash-lookups=%u", table->hash_lookups );
+            g_string_append_c( str, '\n' );
+            msi_view_explain( table->view, str, depth + 2 );
+        }
+    }
+}
+
 static const LibmsiViewOps where_ops =
 {
     where_view_fetch_int,
@@ -999,6 +1823,12 @@ static const LibmsiViewOps where_ops =
     NULL,
     where_view_sort,
     NULL,
+    where_view_explain,
+    NULL,
+    NULL,
+    where_view_fetch_column_range,
+    where_view_fetch_stream_name,
+    NULL,
 };
 
 static unsigned where_view_verify_condition( LibmsiWhereView *wv, struct expr *cond,
@@ -1038,6 +1868,38 @@ static unsigned where_view_verify_condition( LibmsiWhereView *wv, struct expr *c
         if( r != LIBMSI_RESULT_SUCCESS )
             return r;
 
+        if( cond->u.expr.op == OP_LIKE )
+        {
+            struct expr *pattern = cond->u.expr.right;
+
+            if( cond->u.expr.left->type != EXPR_COL_NUMBER_STRING ||
+                ( pattern->type != EXPR_SVAL && pattern->type != EXPR_WILDCARD ) )
+            {
+                *valid = false;
+                return LIBMSI_RESULT_INVALID_PARAMETER;
+            }
+
+            /* 'prefix%' can be answered from the sorted string index */
+            if( pattern->type == EXPR_SVAL )
+            {
+                char *str = (char *)pattern->u.sval;
+                size_t len = strcspn( str, "%_" );
+
+                if( len && str[len] == '%' && !str[strspn( str + len, "%" ) + len] )
+                {
+                    str[len] = 0;
+                    pattern->type = EXPR_PREFIX;
+                    pattern->u.prefix.str = str;
+                    pattern->u.prefix.len = len;
+                    pattern->u.prefix.ids = NULL;
+                    pattern->u.prefix.size = 0;
+                }
+            }
+
+            cond->type = EXPR_LIKE;
+            break;
+        }
+
         /* check the type of the comparison */
         if( ( cond->u.expr.left->type == EXPR_SVAL ) ||
             ( cond->u.expr.left->type == EXPR_COL_NUMBER_STRING ) ||
@@ -1141,6 +2003,10 @@ unsigned where_view_create( LibmsiDatabase *db, LibmsiView **view, char *tables,
 
         wv->col_count += table->col_count;
         table->table_index = wv->table_count++;
+        table->join_order = table->table_index;
+        table->rows_scanned = 0;
+        table->rows_matched = 0;
+        table->hash_lookups = 0;
 
         table->next = wv->tables;
         wv->tables = table;
@@ -25,6 +25,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <stdint.h>
 
@@ -7467,6 +7468,2099 @@ static void test_select_column_names(void)
     g_object_unref( hdb );
 }
 
+static void test_aggregates(void)
+{
+    LibmsiDatabase *hdb = 0;
+    LibmsiRecord *rec;
+    LibmsiQuery *query;
+    unsigned r;
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    r = run_query( hdb, 0,
+            "CREATE TABLE `Media` ("
+            "`DiskId` SHORT NOT NULL, "
+            "`LastSequence` LONG, "
+            "`Cabinet` CHAR(255) "
+            "PRIMARY KEY `DiskId`)" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "cannot create Media table: %d\n", r );
+
+    r = run_query( hdb, 0, "INSERT INTO `Media` ( `DiskId`, `LastSequence`, `Cabinet` ) "
+            "VALUES ( 1, 5, 'one.cab' )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "cannot add to the Media table: %d\n", r );
+    r = run_query( hdb, 0, "INSERT INTO `Media` ( `DiskId`, `LastSequence`, `Cabinet` ) "
+            "VALUES ( 2, -3, 'one.cab' )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "cannot add to the Media table: %d\n", r );
+    r = run_query( hdb, 0, "INSERT INTO `Media` ( `DiskId`, `Cabinet` ) "
+            "VALUES ( 3, 'two.cab' )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "cannot add to the Media table: %d\n", r );
+
+    r = do_query( hdb, "SELECT COUNT(*) FROM `Media`", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 3, "wrong count\n");
+    g_object_unref( rec );
+
+    r = do_query( hdb, "SELECT COUNT(`LastSequence`), MIN(`LastSequence`), MAX(`LastSequence`) FROM `Media`", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 2, "wrong count\n");
+    ok( libmsi_record_get_int( rec, 2 ) == -3, "wrong min\n");
+    ok( libmsi_record_get_int( rec, 3 ) == 5, "wrong max\n");
+    g_object_unref( rec );
+
+    r = do_query( hdb, "SELECT COUNT(*) FROM `Media` WHERE `DiskId` > 5", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 0, "wrong count\n");
+    g_object_unref( rec );
+
+    query = libmsi_query_new( hdb, "SELECT `Cabinet`, COUNT(*) FROM `Media` GROUP BY `Cabinet`", NULL );
+    ok( query, "failed to open query\n");
+
+    r = libmsi_query_execute( query, 0, NULL );
+    ok( r, "failed to execute query\n");
+
+    rec = libmsi_query_fetch( query, NULL );
+    ok( rec, "failed to fetch query\n");
+    check_record_string( rec, 1, "one.cab" );
+    ok( libmsi_record_get_int( rec, 2 ) == 2, "wrong count\n");
+    g_object_unref( rec );
+
+    rec = libmsi_query_fetch( query, NULL );
+    ok( rec, "failed to fetch query\n");
+    check_record_string( rec, 1, "two.cab" );
+    ok( libmsi_record_get_int( rec, 2 ) == 1, "wrong count\n");
+    g_object_unref( rec );
+
+    query_check_no_more( query );
+
+    libmsi_query_close( query, NULL );
+    g_object_unref( query );
+
+    r = try_query( hdb, "SELECT `DiskId`, COUNT(*) FROM `Media` GROUP BY `Cabinet`" );
+    ok( r == LIBMSI_RESULT_BAD_QUERY_SYNTAX, "query failed: %u\n", r );
+
+    r = try_query( hdb, "SELECT MIN(`Cabinet`) FROM `Media`" );
+    ok( r == LIBMSI_RESULT_BAD_QUERY_SYNTAX, "query failed: %u\n", r );
+
+    g_object_unref( hdb );
+    unlink( msifile );
+}
+
+static void test_like(void)
+{
+    LibmsiDatabase *hdb = 0;
+    LibmsiRecord *rec;
+    LibmsiQuery *query;
+    unsigned r;
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    r = run_query( hdb, 0,
+            "CREATE TABLE `Component` ("
+            "`Component` CHAR(72) NOT NULL, "
+            "`Attributes` SHORT "
+            "PRIMARY KEY `Component`)" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "cannot create Component table: %d\n", r );
+
+    r = run_query( hdb, 0, "INSERT INTO `Component` ( `Component`, `Attributes` ) VALUES ( 'alpha', 1 )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "cannot add to the Component table: %d\n", r );
+    r = run_query( hdb, 0, "INSERT INTO `Component` ( `Component`, `Attributes` ) VALUES ( 'alphabet', 2 )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "cannot add to the Component table: %d\n", r );
+    r = run_query( hdb, 0, "INSERT INTO `Component` ( `Component`, `Attributes` ) VALUES ( 'beta', 3 )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "cannot add to the Component table: %d\n", r );
+    r = run_query( hdb, 0, "INSERT INTO `Component` ( `Component`, `Attributes` ) VALUES ( 'gamma', 4 )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "cannot add to the Component table: %d\n", r );
+
+    r = do_query( hdb, "SELECT COUNT(*) FROM `Component` WHERE `Component` LIKE 'alpha%'", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 2, "wrong count\n");
+    g_object_unref( rec );
+
+    r = do_query( hdb, "SELECT COUNT(*) FROM `Component` WHERE `Component` LIKE 'alp%' AND `Attributes` > 1", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 1, "wrong count\n");
+    g_object_unref( rec );
+
+    r = do_query( hdb, "SELECT COUNT(*) FROM `Component` WHERE `Component` LIKE 'delta%'", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 0, "wrong count\n");
+    g_object_unref( rec );
+
+    r = do_query( hdb, "SELECT `Component` FROM `Component` WHERE `Component` LIKE '_eta'", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    check_record_string( rec, 1, "beta" );
+    g_object_unref( rec );
+
+    r = do_query( hdb, "SELECT `Component` FROM `Component` WHERE `Component` LIKE '%mm%'", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    check_record_string( rec, 1, "gamma" );
+    g_object_unref( rec );
+
+    r = do_query( hdb, "SELECT COUNT(*) FROM `Component` WHERE `Component` LIKE '%a%a%'", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 3, "wrong count\n");
+    g_object_unref( rec );
+
+    query = libmsi_query_new( hdb, "SELECT `Component` FROM `Component` WHERE `Component` LIKE ?", NULL );
+    ok( query, "failed to open query\n");
+
+    rec = libmsi_record_new( 1 );
+    libmsi_record_set_string( rec, 1, "%bet" );
+    r = libmsi_query_execute( query, rec, NULL );
+    ok( r, "failed to execute query\n");
+    g_object_unref( rec );
+
+    rec = libmsi_query_fetch( query, NULL );
+    ok( rec, "failed to fetch query\n");
+    check_record_string( rec, 1, "alphabet" );
+    g_object_unref( rec );
+
+    query_check_no_more( query );
+
+    libmsi_query_close( query, NULL );
+    g_object_unref( query );
+
+    r = try_query( hdb, "SELECT * FROM `Component` WHERE `Attributes` LIKE 'a%'" );
+    ok( r == LIBMSI_RESULT_BAD_QUERY_SYNTAX, "query failed: %u\n", r );
+
+    g_object_unref( hdb );
+    unlink( msifile );
+}
+
+/* databases written by other tools may store the same text under several
+ * string ids; build one by renaming a string in the committed file */
+static LibmsiDatabase *create_duplicate_strings_db(void)
+{
+    LibmsiDatabase *hdb;
+    gchar *data = NULL;
+    gsize i, len = 0;
+    unsigned r;
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    r = run_query( hdb, 0,
+            "CREATE TABLE `Dup` ( `N` SHORT NOT NULL, `S` CHAR(72) PRIMARY KEY `N` )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to create table: %d\n", r );
+    r = run_query( hdb, 0,
+            "INSERT INTO `Dup` ( `N`, `S` ) VALUES ( 1, 'dupe1' ), ( 2, 'dupe2' ), "
+            "( 3, 'other' ), ( 4, '' )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to insert rows: %d\n", r );
+
+    r = run_query( hdb, 0,
+            "CREATE TABLE `Ref` ( `K` CHAR(72) NOT NULL, `V` SHORT PRIMARY KEY `K` )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to create table: %d\n", r );
+    r = run_query( hdb, 0, "INSERT INTO `Ref` ( `K`, `V` ) VALUES ( 'dupe1', 10 ), ( 'other', 30 )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to insert rows: %d\n", r );
+
+    r = libmsi_database_commit( hdb, NULL );
+    ok( r, "failed to commit\n");
+    g_object_unref( hdb );
+
+    /* the string data is stored as is, so 'dupe2' becomes a second 'dupe1' */
+    ok( g_file_get_contents( msifile, &data, &len, NULL ), "failed to read %s\n", msifile );
+    for (i = 0; i + 5 <= len; i++)
+    {
+        if (!memcmp( data + i, "dupe2", 5 ))
+        {
+            data[i + 4] = '1';
+            break;
+        }
+    }
+    ok( i + 5 <= len, "string data not found\n");
+    ok( g_file_set_contents( msifile, data, len, NULL ), "failed to write %s\n", msifile );
+    g_free( data );
+
+    hdb = libmsi_database_new( msifile, LIBMSI_DB_FLAGS_READONLY, NULL, NULL );
+    ok( hdb, "failed to open db\n");
+    return hdb;
+}
+
+static void test_like_duplicates(void)
+{
+    LibmsiDatabase *hdb;
+    LibmsiRecord *rec;
+    unsigned r;
+
+    hdb = create_duplicate_strings_db();
+    if (!hdb)
+        return;
+
+    /* every id with the text matches a prefix, not just the indexed one */
+    r = do_query( hdb, "SELECT COUNT(*) FROM `Dup` WHERE `S` LIKE 'dupe%'", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 2, "wrong count %d\n", libmsi_record_get_int( rec, 1 ) );
+    g_object_unref( rec );
+
+    r = do_query( hdb, "SELECT COUNT(*) FROM `Dup` WHERE `S` LIKE '%pe1'", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 2, "wrong count %d\n", libmsi_record_get_int( rec, 1 ) );
+    g_object_unref( rec );
+
+    /* NULL is not like anything */
+    r = do_query( hdb, "SELECT COUNT(*) FROM `Dup` WHERE `S` LIKE '%'", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 3, "wrong count %d\n", libmsi_record_get_int( rec, 1 ) );
+    g_object_unref( rec );
+
+    g_object_unref( hdb );
+    unlink( msifile );
+}
+
+static void test_explain(void)
+{
+    LibmsiDatabase *hdb = 0;
+    LibmsiRecord *rec;
+    LibmsiQuery *query;
+    gchar *stats;
+    unsigned r;
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    r = run_query( hdb, 0,
+            "CREATE TABLE `Component` ("
+            "`Component` CHAR(72) NOT NULL, "
+            "`Attributes` SHORT "
+            "PRIMARY KEY `Component`)" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "cannot create Component table: %d\n", r );
+
+    r = run_query( hdb, 0, "INSERT INTO `Component` ( `Component`, `Attributes` ) VALUES ( 'alpha', 1 )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "cannot add to the Component table: %d\n", r );
+    r = run_query( hdb, 0, "INSERT INTO `Component` ( `Component`, `Attributes` ) VALUES ( 'alphabet', 2 )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "cannot add to the Component table: %d\n", r );
+    r = run_query( hdb, 0, "INSERT INTO `Component` ( `Component`, `Attributes` ) VALUES ( 'beta', 3 )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "cannot add to the Component table: %d\n", r );
+
+    query = libmsi_query_new( hdb, "EXPLAIN SELECT `Component` FROM `Component` "
+                              "WHERE `Component` LIKE 'alpha%'", NULL );
+    ok( query, "failed to open query\n");
+
+    r = libmsi_query_execute( query, 0, NULL );
+    ok( r, "failed to execute query\n");
+
+    rec = libmsi_query_fetch( query, NULL );
+    ok( rec, "failed to fetch query\n");
+    check_record_string( rec, 1, "SELECT columns=1" );
+    g_object_unref( rec );
+
+    rec = libmsi_query_fetch( query, NULL );
+    ok( rec, "failed to fetch query\n");
+    check_record_string( rec, 1, "  WHERE join=scan rows=2 index=prefix hits=2" );
+    g_object_unref( rec );
+
+    rec = libmsi_query_fetch( query, NULL );
+    ok( rec, "failed to fetch query\n");
+    check_record_string( rec, 1, "    SCAN step=1 scanned=3 matched=2" );
+    g_object_unref( rec );
+
+    rec = libmsi_query_fetch( query, NULL );
+    ok( rec, "failed to fetch query\n");
+    check_record_string( rec, 1, "      TABLE `Component` rows=3" );
+    g_object_unref( rec );
+
+    query_check_no_more( query );
+
+    libmsi_query_close( query, NULL );
+    g_object_unref( query );
+
+    query = libmsi_query_new( hdb, "SELECT `Component` FROM `Component` WHERE `Attributes` > 1", NULL );
+    ok( query, "failed to open query\n");
+
+    r = libmsi_query_execute( query, 0, NULL );
+    ok( r, "failed to execute query\n");
+
+    rec = libmsi_query_fetch( query, NULL );
+    ok( rec, "failed to fetch query\n");
+    g_object_unref( rec );
+
+    stats = libmsi_query_get_stats( query, NULL );
+    ok( stats, "failed to get stats\n");
+    ok( g_str_has_prefix( stats, "SELECT columns=1\n  WHERE join=scan rows=2\n" ),
+        "wrong stats: %s\n", stats );
+    ok( strstr( stats, "fetch rows=1 " ) != NULL, "wrong stats: %s\n", stats );
+    g_free( stats );
+
+    libmsi_query_close( query, NULL );
+    g_object_unref( query );
+
+    g_object_unref( hdb );
+    unlink( msifile );
+}
+
+static void test_fetch_batch(void)
+{
+    LibmsiDatabase *hdb = 0;
+    LibmsiRecord *rec;
+    LibmsiQuery *query;
+    GPtrArray *records;
+    unsigned r;
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    r = run_query( hdb, 0,
+            "CREATE TABLE `Media` ("
+            "`DiskId` SHORT NOT NULL, "
+            "`LastSequence` LONG, "
+            "`Cabinet` CHAR(255) "
+            "PRIMARY KEY `DiskId`)" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "cannot create Media table: %d\n", r );
+
+    r = run_query( hdb, 0, "INSERT INTO `Media` ( `DiskId`, `LastSequence`, `Cabinet` ) "
+            "VALUES ( 1, 5, 'one.cab' )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "cannot add to the Media table: %d\n", r );
+    r = run_query( hdb, 0, "INSERT INTO `Media` ( `DiskId`, `LastSequence` ) "
+            "VALUES ( 2, -3 )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "cannot add to the Media table: %d\n", r );
+    r = run_query( hdb, 0, "INSERT INTO `Media` ( `DiskId`, `Cabinet` ) "
+            "VALUES ( 3, 'two.cab' )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "cannot add to the Media table: %d\n", r );
+
+    query = libmsi_query_new( hdb, "SELECT * FROM `Media`", NULL );
+    ok( query, "failed to open query\n");
+
+    r = libmsi_query_execute( query, 0, NULL );
+    ok( r, "failed to execute query\n");
+
+    records = libmsi_query_fetch_batch( query, 2, NULL );
+    ok( records, "failed to fetch batch\n");
+    ok( records->len == 2, "expected 2 records, got %u\n", records->len );
+
+    rec = g_ptr_array_index( records, 0 );
+    ok( libmsi_record_get_int( rec, 1 ) == 1, "wrong disk id\n");
+    ok( libmsi_record_get_int( rec, 2 ) == 5, "wrong sequence\n");
+    check_record_string( rec, 3, "one.cab" );
+
+    rec = g_ptr_array_index( records, 1 );
+    ok( libmsi_record_get_int( rec, 1 ) == 2, "wrong disk id\n");
+    ok( libmsi_record_get_int( rec, 2 ) == -3, "wrong sequence\n");
+    ok( libmsi_record_is_null( rec, 3 ), "expected a null cabinet\n");
+    g_ptr_array_unref( records );
+
+    /* the last batch is short, and the one after it empty */
+    records = libmsi_query_fetch_batch( query, 2, NULL );
+    ok( records, "failed to fetch batch\n");
+    ok( records->len == 1, "expected 1 record, got %u\n", records->len );
+    rec = g_object_ref( g_ptr_array_index( records, 0 ) );
+    g_ptr_array_unref( records );
+    check_record_string( rec, 3, "two.cab" );
+    ok( libmsi_record_is_null( rec, 2 ), "expected a null sequence\n");
+    g_object_unref( rec );
+
+    records = libmsi_query_fetch_batch( query, 2, NULL );
+    ok( records, "failed to fetch batch\n");
+    ok( records->len == 0, "expected no records, got %u\n", records->len );
+    g_ptr_array_unref( records );
+
+    libmsi_query_close( query, NULL );
+    g_object_unref( query );
+
+    g_object_unref( hdb );
+    unlink( msifile );
+}
+
+static void test_query_cursor(void)
+{
+    LibmsiDatabase *hdb = 0;
+    LibmsiQuery *query;
+    unsigned r;
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    r = run_query( hdb, 0,
+            "CREATE TABLE `Media` ("
+            "`DiskId` SHORT NOT NULL, "
+            "`LastSequence` LONG, "
+            "`Cabinet` CHAR(255) "
+            "PRIMARY KEY `DiskId`)" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "cannot create Media table: %d\n", r );
+
+    r = run_query( hdb, 0, "INSERT INTO `Media` ( `DiskId`, `LastSequence`, `Cabinet` ) "
+            "VALUES ( 1, 5, 'one.cab' )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "cannot add to the Media table: %d\n", r );
+    r = run_query( hdb, 0, "INSERT INTO `Media` ( `DiskId`, `LastSequence` ) "
+            "VALUES ( 2, -3 )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "cannot add to the Media table: %d\n", r );
+
+    query = libmsi_query_new( hdb, "SELECT * FROM `Media`", NULL );
+    ok( query, "failed to open query\n");
+
+    r = libmsi_query_execute( query, 0, NULL );
+    ok( r, "failed to execute query\n");
+
+    ok( libmsi_query_get_int( query, 1 ) == LIBMSI_NULL_INT, "expected no current row\n");
+
+    ok( libmsi_query_next( query, NULL ), "expected a row\n");
+    ok( libmsi_query_get_int( query, 1 ) == 1, "wrong disk id\n");
+    ok( libmsi_query_get_int( query, 2 ) == 5, "wrong sequence\n");
+    ok( !g_strcmp0( libmsi_query_get_string_const( query, 3 ), "one.cab" ), "wrong cabinet\n");
+    ok( libmsi_query_get_string_const( query, 1 ) == NULL, "expected no string\n");
+    ok( libmsi_query_get_int( query, 3 ) == LIBMSI_NULL_INT, "expected no integer\n");
+    ok( libmsi_query_get_int( query, 4 ) == LIBMSI_NULL_INT, "expected no column\n");
+
+    ok( libmsi_query_next( query, NULL ), "expected a row\n");
+    ok( libmsi_query_get_int( query, 1 ) == 2, "wrong disk id\n");
+    ok( libmsi_query_get_int( query, 2 ) == -3, "wrong sequence\n");
+    ok( libmsi_query_get_string_const( query, 3 ) == NULL, "expected a null cabinet\n");
+
+    ok( !libmsi_query_next( query, NULL ), "expected no more rows\n");
+
+    libmsi_query_close( query, NULL );
+    g_object_unref( query );
+
+    g_object_unref( hdb );
+    unlink( msifile );
+}
+
+static void test_execute_script(void)
+{
+    GError *error = NULL;
+    LibmsiDatabase *hdb = 0;
+    LibmsiRecord *rec;
+    unsigned r;
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    rec = libmsi_record_new( 1 );
+    libmsi_record_set_string( rec, 1, "param" );
+
+    r = libmsi_database_execute_script( hdb,
+            "CREATE TABLE `Script` ( `A` SHORT NOT NULL, `B` CHAR(72) PRIMARY KEY `A` )\n"
+            "INSERT INTO `Script` ( `A`, `B` ) VALUES ( 1, 'one' )\n"
+            "INSERT INTO `Script` ( `A`, `B` ) VALUES ( 2, ? )\n"
+            "INSERT INTO `Script` ( `A`, `B` ) VALUES ( 3, 'three' )\n"
+            "DELETE FROM `Script` WHERE `A` = 3\n"
+            "DELETE FROM `Script` WHERE `A` = 3\n"
+            "UPDATE `Script` SET `B` = 'uno' WHERE `A` = 1",
+            rec, &error );
+    ok( r, "failed to execute script\n");
+    ok( !error, "unexpected error\n");
+    g_object_unref( rec );
+
+    r = do_query( hdb, "SELECT COUNT(*) FROM `Script`", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 2, "wrong count\n");
+    g_object_unref( rec );
+
+    r = do_query( hdb, "SELECT `B` FROM `Script` WHERE `A` = 1", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    check_record_string( rec, 1, "uno" );
+    g_object_unref( rec );
+
+    r = do_query( hdb, "SELECT `B` FROM `Script` WHERE `A` = 2", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    check_record_string( rec, 1, "param" );
+    g_object_unref( rec );
+
+    /* execution stops at the first failing statement */
+    r = libmsi_database_execute_script( hdb,
+            "INSERT INTO `Script` ( `A`, `B` ) VALUES ( 4, 'four' ) "
+            "INSERT INTO `Script` ( `A` `B` ) VALUES ( 5, 'five' ) "
+            "INSERT INTO `Script` ( `A`, `B` ) VALUES ( 6, 'six' )",
+            NULL, &error );
+    ok( !r, "script should have failed\n");
+    ok( error && error->code == LIBMSI_RESULT_BAD_QUERY_SYNTAX, "wrong error\n");
+    g_clear_error( &error );
+
+    r = do_query( hdb, "SELECT COUNT(*) FROM `Script`", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 3, "wrong count\n");
+    g_object_unref( rec );
+
+    g_object_unref( hdb );
+    unlink( msifile );
+}
+
+static void test_insert_multirow(void)
+{
+    LibmsiDatabase *hdb = 0;
+    LibmsiQuery *hquery;
+    LibmsiRecord *rec;
+    unsigned r, i;
+    static const int ids[] = { 1, 2, 3, 4, 5 };
+    static const char *names[] = { "one", "two", "three", "four", "five" };
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    r = run_query( hdb, 0,
+            "CREATE TABLE `Multi` ( `A` SHORT NOT NULL, `B` CHAR(72) PRIMARY KEY `A` )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to create table: %d\n", r );
+
+    r = run_query( hdb, 0,
+            "INSERT INTO `Multi` ( `A`, `B` ) VALUES ( 2, 'two' )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to insert: %d\n", r );
+
+    /* rows go in out of order, and are merged with the existing one */
+    rec = libmsi_record_new( 1 );
+    libmsi_record_set_string( rec, 1, "four" );
+    r = run_query( hdb, rec,
+            "INSERT INTO `Multi` ( `A`, `B` ) VALUES ( 5, 'five' ), ( 1, 'one' ), "
+            "( 4, ? ), ( 3, 'three' )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to insert rows: %d\n", r );
+    g_object_unref( rec );
+
+    hquery = libmsi_query_new( hdb, "SELECT `A`, `B` FROM `Multi`", NULL );
+    ok( hquery, "failed to open query\n");
+    r = libmsi_query_execute( hquery, 0, NULL );
+    ok( r, "query execute failed\n");
+    for (i = 0; i < G_N_ELEMENTS(ids); i++)
+    {
+        rec = libmsi_query_fetch( hquery, NULL );
+        ok( rec, "expected row %u\n", i );
+        if (!rec)
+            break;
+        ok( libmsi_record_get_int( rec, 1 ) == ids[i], "wrong key in row %u\n", i );
+        check_record_string( rec, 2, names[i] );
+        g_object_unref( rec );
+    }
+    rec = libmsi_query_fetch( hquery, NULL );
+    ok( !rec, "expected no more rows\n");
+    libmsi_query_close( hquery, NULL );
+    g_object_unref( hquery );
+
+    /* a duplicate key within the batch rejects the whole batch */
+    r = run_query( hdb, 0,
+            "INSERT INTO `Multi` ( `A`, `B` ) VALUES ( 6, 'six' ), ( 6, 'seis' )" );
+    ok( r == LIBMSI_RESULT_FUNCTION_FAILED, "expected failure, got %d\n", r );
+
+    /* as does a key already in the table */
+    r = run_query( hdb, 0,
+            "INSERT INTO `Multi` ( `A`, `B` ) VALUES ( 7, 'seven' ), ( 3, 'drei' )" );
+    ok( r == LIBMSI_RESULT_FUNCTION_FAILED, "expected failure, got %d\n", r );
+
+    r = do_query( hdb, "SELECT COUNT(*) FROM `Multi`", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 5, "wrong count\n");
+    g_object_unref( rec );
+
+    /* every row needs a value for each column */
+    r = run_query( hdb, 0,
+            "INSERT INTO `Multi` ( `A`, `B` ) VALUES ( 8, 'eight' ), ( 9 )" );
+    ok( r == LIBMSI_RESULT_BAD_QUERY_SYNTAX, "expected syntax error, got %d\n", r );
+
+    g_object_unref( hdb );
+    unlink( msifile );
+}
+
+static void test_insert_select(void)
+{
+    GError *error = NULL;
+    LibmsiDatabase *hdb = 0;
+    LibmsiRecord *rec;
+    unsigned r;
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    r = libmsi_database_execute_script( hdb,
+            "CREATE TABLE `Src` ( `A` SHORT NOT NULL, `B` CHAR(72) PRIMARY KEY `A` )\n"
+            "CREATE TABLE `Dst` ( `X` LONG NOT NULL, `Y` CHAR(72), `Z` SHORT PRIMARY KEY `X` )\n"
+            "INSERT INTO `Src` ( `A`, `B` ) VALUES ( 1, 'one' ), ( 2, 'two' ), ( 3, 'three' )\n"
+            "INSERT INTO `Dst` ( `X`, `Y` ) SELECT `A`, `B` FROM `Src` WHERE `A` > 1",
+            NULL, &error );
+    ok( r, "failed to execute script\n");
+    ok( !error, "unexpected error\n");
+
+    r = do_query( hdb, "SELECT COUNT(*) FROM `Dst`", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 2, "wrong count\n");
+    g_object_unref( rec );
+
+    r = do_query( hdb, "SELECT `Y`, `Z` FROM `Dst` WHERE `X` = 3", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    check_record_string( rec, 1, "three" );
+    ok( libmsi_record_is_null( rec, 2 ), "expected a null column\n");
+    g_object_unref( rec );
+
+    /* the columns are matched by position, not by name */
+    r = run_query( hdb, 0,
+            "INSERT INTO `Dst` ( `Y`, `X` ) SELECT `B`, `A` FROM `Src` WHERE `A` = 1" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to insert rows: %d\n", r );
+
+    r = do_query( hdb, "SELECT `Y` FROM `Dst` WHERE `X` = 1", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    check_record_string( rec, 1, "one" );
+    g_object_unref( rec );
+
+    /* the copy fails as a whole on a duplicate key */
+    r = run_query( hdb, 0,
+            "INSERT INTO `Dst` ( `X`, `Y` ) SELECT `A`, `B` FROM `Src`" );
+    ok( r == LIBMSI_RESULT_FUNCTION_FAILED, "expected failure, got %d\n", r );
+
+    r = do_query( hdb, "SELECT COUNT(*) FROM `Dst`", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 3, "wrong count\n");
+    g_object_unref( rec );
+
+    /* the query must select one value for each column */
+    r = run_query( hdb, 0,
+            "INSERT INTO `Dst` ( `X`, `Y` ) SELECT `A` FROM `Src`" );
+    ok( r == LIBMSI_RESULT_BAD_QUERY_SYNTAX, "expected syntax error, got %d\n", r );
+
+    /* a value that doesn't fit the column */
+    r = run_query( hdb, 0,
+            "INSERT INTO `Dst` ( `X`, `Z` ) VALUES ( 100000, 1 )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to insert row: %d\n", r );
+    r = run_query( hdb, 0,
+            "INSERT INTO `Src` ( `A`, `B` ) SELECT `X`, `Y` FROM `Dst` WHERE `X` = 100000" );
+    ok( r == LIBMSI_RESULT_FUNCTION_FAILED, "expected failure, got %d\n", r );
+
+    g_object_unref( hdb );
+    unlink( msifile );
+}
+
+static void test_attach(void)
+{
+    GError *error = NULL;
+    LibmsiDatabase *hdb, *hdb2;
+    LibmsiRecord *rec;
+    unsigned r;
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    hdb2 = libmsi_database_new( msifile2, LIBMSI_DB_FLAGS_CREATE, NULL, NULL );
+    ok( hdb2, "failed to create db\n");
+
+    r = libmsi_database_execute_script( hdb,
+            "CREATE TABLE `File` ( `File` CHAR(72) NOT NULL, `Size` LONG PRIMARY KEY `File` )\n"
+            "INSERT INTO `File` ( `File`, `Size` ) VALUES ( 'a.txt', 1 ), ( 'b.txt', 2 )",
+            NULL, &error );
+    ok( r, "failed to execute script\n");
+
+    /* the strings are added in a different order, so their ids differ */
+    r = libmsi_database_execute_script( hdb2,
+            "CREATE TABLE `File` ( `File` CHAR(72) NOT NULL, `Size` LONG PRIMARY KEY `File` )\n"
+            "INSERT INTO `File` ( `File`, `Size` ) VALUES ( 'c.txt', 30 ), ( 'b.txt', 20 ), ( 'a.txt', 10 )",
+            NULL, &error );
+    ok( r, "failed to execute script\n");
+
+    r = libmsi_database_attach( hdb, hdb2, "old", &error );
+    ok( r, "failed to attach database\n");
+    ok( !error, "unexpected error\n");
+
+    /* the alias can only be used once */
+    r = libmsi_database_attach( hdb, hdb2, "old", &error );
+    ok( !r, "expected failure\n");
+    ok( error && error->code == LIBMSI_RESULT_INVALID_PARAMETER, "wrong error\n");
+    g_clear_error( &error );
+
+    r = do_query( hdb, "SELECT COUNT(*) FROM `old`.`File`", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 3, "wrong count\n");
+    g_object_unref( rec );
+
+    r = do_query( hdb, "SELECT `old`.`File`.`Size` FROM `File`, `old`.`File` "
+                  "WHERE `File`.`File` = `old`.`File`.`File` AND `File`.`Size` = 2", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 20, "wrong size\n");
+    g_object_unref( rec );
+
+    r = do_query( hdb, "SELECT COUNT(*) FROM `File`, `old`.`File` "
+                  "WHERE `File`.`File` = `old`.`File`.`File`", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 2, "wrong count\n");
+    g_object_unref( rec );
+
+    r = do_query( hdb, "SELECT `File` FROM `old`.`File` WHERE `Size` = 30", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    check_record_string( rec, 1, "c.txt" );
+    g_object_unref( rec );
+
+    /* attached tables are read-only */
+    r = run_query( hdb, 0, "DELETE FROM `old`.`File`" );
+    ok( r == LIBMSI_RESULT_BAD_QUERY_SYNTAX, "expected syntax error, got %d\n", r );
+
+    r = do_query( hdb, "SELECT COUNT(*) FROM `nosuch`.`File`", &rec );
+    ok( r == LIBMSI_RESULT_BAD_QUERY_SYNTAX, "expected syntax error, got %d\n", r );
+
+    g_object_unref( hdb );
+    g_object_unref( hdb2 );
+    unlink( msifile );
+    unlink( msifile2 );
+}
+
+static void test_attach_commit(void)
+{
+    GError *error = NULL;
+    LibmsiDatabase *hdb, *hdb2;
+    LibmsiRecord *rec;
+    unsigned r;
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    hdb2 = libmsi_database_new( msifile2, LIBMSI_DB_FLAGS_CREATE, NULL, NULL );
+    ok( hdb2, "failed to create db\n");
+
+    r = libmsi_database_execute_script( hdb,
+            "CREATE TABLE `File` ( `File` CHAR(72) NOT NULL, `Size` LONG PRIMARY KEY `File` )\n"
+            "INSERT INTO `File` ( `File`, `Size` ) VALUES ( 'a.txt', 1 ), ( 'b.txt', 2 )",
+            NULL, &error );
+    ok( r, "failed to execute script\n");
+
+    r = libmsi_database_execute_script( hdb2,
+            "CREATE TABLE `File` ( `File` CHAR(72) NOT NULL, `Size` LONG PRIMARY KEY `File` )\n"
+            "INSERT INTO `File` ( `File`, `Size` ) VALUES ( 'c.txt', 30 ), ( 'b.txt', 20 ), ( 'a.txt', 10 )",
+            NULL, &error );
+    ok( r, "failed to execute script\n");
+
+    r = libmsi_database_attach( hdb, hdb2, "old", &error );
+    ok( r, "failed to attach database\n");
+
+    /* the commit reloads the string table, the attached strings are
+     * added to it again */
+    r = libmsi_database_commit( hdb, NULL );
+    ok( r, "failed to commit\n");
+
+    r = do_query( hdb, "SELECT COUNT(*) FROM `File`, `old`.`File` "
+                  "WHERE `File`.`File` = `old`.`File`.`File`", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 2, "wrong count\n");
+    g_object_unref( rec );
+
+    r = do_query( hdb, "SELECT `File` FROM `old`.`File` WHERE `Size` = 30", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    check_record_string( rec, 1, "c.txt" );
+    g_object_unref( rec );
+
+    r = libmsi_database_commit( hdb, NULL );
+    ok( r, "failed to commit\n");
+    g_object_unref( hdb );
+
+    hdb = libmsi_database_new( msifile, LIBMSI_DB_FLAGS_READONLY, NULL, NULL );
+    ok( hdb, "failed to open db\n");
+    r = do_query( hdb, "SELECT COUNT(*) FROM `File`", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 2, "wrong count\n");
+    g_object_unref( rec );
+
+    g_object_unref( hdb );
+    g_object_unref( hdb2 );
+    unlink( msifile );
+    unlink( msifile2 );
+}
+
+static void test_parallel_scan(void)
+{
+    LibmsiDatabase *hdb = 0;
+    LibmsiQuery *hquery;
+    LibmsiRecord *rec;
+    unsigned r, i, count;
+    int prev;
+
+    unlink( msifile );
+    hdb = libmsi_database_new( msifile, LIBMSI_DB_FLAGS_CREATE | LIBMSI_DB_FLAGS_PARALLEL, NULL, NULL );
+    ok( hdb, "failed to create db\n");
+
+    r = run_query( hdb, 0,
+            "CREATE TABLE `Big` ( `A` LONG NOT NULL, `B` SHORT PRIMARY KEY `A` )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to create table: %d\n", r );
+
+    /* large enough to be split between threads */
+    hquery = libmsi_query_new( hdb, "INSERT INTO `Big` ( `A`, `B` ) VALUES ( ?, ? )", NULL );
+    ok( hquery, "failed to open query\n");
+    rec = libmsi_record_new( 2 );
+    for (i = 0; i < 40000; i++)
+    {
+        libmsi_record_set_int( rec, 1, i );
+        libmsi_record_set_int( rec, 2, i % 7 );
+        r = libmsi_query_execute( hquery, rec, NULL );
+        if (!r)
+            break;
+    }
+    ok( i == 40000, "insert failed at row %u\n", i );
+    g_object_unref( rec );
+    libmsi_query_close( hquery, NULL );
+    g_object_unref( hquery );
+
+    /* the matches come back in table order */
+    hquery = libmsi_query_new( hdb, "SELECT `A` FROM `Big` WHERE `B` = 3", NULL );
+    ok( hquery, "failed to open query\n");
+    r = libmsi_query_execute( hquery, 0, NULL );
+    ok( r, "query execute failed\n");
+    count = 0;
+    prev = -1;
+    while ((rec = libmsi_query_fetch( hquery, NULL )))
+    {
+        ok( libmsi_record_get_int( rec, 1 ) > prev, "rows out of order at %u\n", count );
+        ok( libmsi_record_get_int( rec, 1 ) % 7 == 3, "wrong row %u\n", count );
+        prev = libmsi_record_get_int( rec, 1 );
+        count++;
+        g_object_unref( rec );
+    }
+    ok( count == 5714, "expected 5714 rows, got %u\n", count );
+    libmsi_query_close( hquery, NULL );
+    g_object_unref( hquery );
+
+    g_object_unref( hdb );
+    unlink( msifile );
+}
+
+static unsigned count_rows( LibmsiDatabase *hdb, LibmsiRecord *params, const char *sql )
+{
+    LibmsiQuery *hquery;
+    LibmsiRecord *rec;
+    unsigned count = 0;
+
+    hquery = libmsi_query_new( hdb, sql, NULL );
+    ok( hquery, "failed to open query %s\n", sql );
+    if (!hquery)
+        return ~0u;
+    ok( libmsi_query_execute( hquery, params, NULL ), "query execute failed\n");
+    while ((rec = libmsi_query_fetch( hquery, NULL )))
+    {
+        count++;
+        g_object_unref( rec );
+    }
+    libmsi_query_close( hquery, NULL );
+    g_object_unref( hquery );
+    return count;
+}
+
+static void test_batch_where(void)
+{
+    LibmsiDatabase *hdb = 0;
+    LibmsiQuery *hquery;
+    LibmsiRecord *rec;
+    unsigned r, i, count;
+    unsigned expect[7] = { 0 };
+    char name[16];
+    int b;
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    r = run_query( hdb, 0,
+            "CREATE TABLE `Batch` ( `A` LONG NOT NULL, `B` SHORT, `C` CHAR(16) PRIMARY KEY `A` )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to create table: %d\n", r );
+
+    /* a few blocks of rows and a partial one */
+    hquery = libmsi_query_new( hdb, "INSERT INTO `Batch` ( `A`, `B`, `C` ) VALUES ( ?, ?, ? )", NULL );
+    ok( hquery, "failed to open query\n");
+    rec = libmsi_record_new( 3 );
+    for (i = 0; i < 3000; i++)
+    {
+        b = (int)(i % 100) - 50;
+        sprintf( name, "item%u", i % 10 );
+        libmsi_record_set_int( rec, 1, i );
+        libmsi_record_set_int( rec, 2, b );
+        libmsi_record_set_string( rec, 3, i % 13 ? name : NULL );
+        r = libmsi_query_execute( hquery, rec, NULL );
+        if (!r)
+            break;
+
+        expect[0] += b >= -10 && b < 20;
+        expect[1] += b < -40 || i > 2900;
+        expect[2] += i % 13 && i % 10 == 3;
+        expect[3] += !(i % 13 && i % 10 == 3);
+        expect[4] += !(i % 13);
+        expect[5] += i % 13 && i % 10 == 1;
+        expect[6] += b > 0 && i % 13 && i % 10 == 5;
+    }
+    ok( i == 3000, "insert failed at row %u\n", i );
+    g_object_unref( rec );
+    libmsi_query_close( hquery, NULL );
+    g_object_unref( hquery );
+
+    count = count_rows( hdb, NULL, "SELECT * FROM `Batch` WHERE `B` >= -10 AND `B` < 20" );
+    ok( count == expect[0], "expected %u rows, got %u\n", expect[0], count );
+
+    count = count_rows( hdb, NULL, "SELECT * FROM `Batch` WHERE `B` < -40 OR `A` > 2900" );
+    ok( count == expect[1], "expected %u rows, got %u\n", expect[1], count );
+
+    count = count_rows( hdb, NULL, "SELECT * FROM `Batch` WHERE `C` = 'item3'" );
+    ok( count == expect[2], "expected %u rows, got %u\n", expect[2], count );
+
+    count = count_rows( hdb, NULL, "SELECT * FROM `Batch` WHERE `C` <> 'item3'" );
+    ok( count == expect[3], "expected %u rows, got %u\n", expect[3], count );
+
+    count = count_rows( hdb, NULL, "SELECT * FROM `Batch` WHERE `C` IS NULL" );
+    ok( count == expect[4], "expected %u rows, got %u\n", expect[4], count );
+
+    count = count_rows( hdb, NULL, "SELECT * FROM `Batch` WHERE `C` LIKE 'item1%'" );
+    ok( count == expect[5], "expected %u rows, got %u\n", expect[5], count );
+
+    /* a string that isn't in the database matches nothing */
+    count = count_rows( hdb, NULL, "SELECT * FROM `Batch` WHERE `C` = 'nothing'" );
+    ok( count == 0, "expected no rows, got %u\n", count );
+
+    rec = libmsi_record_new( 2 );
+    libmsi_record_set_int( rec, 1, 0 );
+    libmsi_record_set_string( rec, 2, "item5" );
+    count = count_rows( hdb, rec, "SELECT * FROM `Batch` WHERE `B` > ? AND `C` = ?" );
+    ok( count == expect[6], "expected %u rows, got %u\n", expect[6], count );
+    g_object_unref( rec );
+
+    g_object_unref( hdb );
+    unlink( msifile );
+}
+
+static void test_batch_where_duplicates(void)
+{
+    LibmsiDatabase *hdb;
+    LibmsiRecord *rec;
+    unsigned r;
+
+    hdb = create_duplicate_strings_db();
+    if (!hdb)
+        return;
+
+    /* both ids of the text are equal to it */
+    r = do_query( hdb, "SELECT COUNT(*) FROM `Dup` WHERE `S` = 'dupe1'", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 2, "wrong count %d\n", libmsi_record_get_int( rec, 1 ) );
+    g_object_unref( rec );
+
+    r = do_query( hdb, "SELECT COUNT(*) FROM `Dup` WHERE `S` = 'dupe1' OR `N` = 3", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 3, "wrong count %d\n", libmsi_record_get_int( rec, 1 ) );
+    g_object_unref( rec );
+
+    g_object_unref( hdb );
+    unlink( msifile );
+}
+
+static void test_join_duplicates(void)
+{
+    LibmsiDatabase *hdb;
+    LibmsiRecord *rec;
+    unsigned r;
+
+    hdb = create_duplicate_strings_db();
+    if (!hdb)
+        return;
+
+    /* both ids of the text join with the row holding the other one */
+    r = do_query( hdb, "SELECT COUNT(*) FROM `Dup`, `Ref` WHERE `Dup`.`S` = `Ref`.`K`", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 3, "wrong count %d\n", libmsi_record_get_int( rec, 1 ) );
+    g_object_unref( rec );
+
+    r = do_query( hdb, "SELECT COUNT(*) FROM `Ref`, `Dup` WHERE `Ref`.`K` = `Dup`.`S` AND `Ref`.`V` = 10", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 2, "wrong count %d\n", libmsi_record_get_int( rec, 1 ) );
+    g_object_unref( rec );
+
+    g_object_unref( hdb );
+    unlink( msifile );
+}
+
+static void test_fetch_column_range(void)
+{
+    LibmsiDatabase *hdb = 0;
+    LibmsiQuery *hquery;
+    LibmsiRecord *rec;
+    GPtrArray *records;
+    unsigned r, i;
+    char name[16];
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    r = run_query( hdb, 0,
+            "CREATE TABLE `Range` ( `A` SHORT NOT NULL, `B` SHORT, `C` CHAR(16) PRIMARY KEY `A` )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to create table: %d\n", r );
+
+    /* more rows than are read at a time */
+    hquery = libmsi_query_new( hdb, "INSERT INTO `Range` ( `A`, `B`, `C` ) VALUES ( ?, ?, ? )", NULL );
+    ok( hquery, "failed to open query\n");
+    rec = libmsi_record_new( 3 );
+    for (i = 0; i < 700; i++)
+    {
+        sprintf( name, "v%u", i % 3 );
+        libmsi_record_set_int( rec, 1, i );
+        libmsi_record_set_int( rec, 2, i % 5 );
+        libmsi_record_set_string( rec, 3, name );
+        r = libmsi_query_execute( hquery, rec, NULL );
+        if (!r)
+            break;
+    }
+    ok( i == 700, "insert failed at row %u\n", i );
+    g_object_unref( rec );
+    libmsi_query_close( hquery, NULL );
+    g_object_unref( hquery );
+
+    /* columns of a selection out of order, over the rows of a filter */
+    hquery = libmsi_query_new( hdb, "SELECT `C`, `A` FROM `Range` WHERE `B` = 2", NULL );
+    ok( hquery, "failed to open query\n");
+    ok( libmsi_query_execute( hquery, 0, NULL ), "query execute failed\n");
+    records = libmsi_query_fetch_batch( hquery, 1000, NULL );
+    ok( records && records->len == 140, "expected 140 records, got %u\n", records ? records->len : 0 );
+    for (i = 0; records && i < records->len; i++)
+    {
+        rec = g_ptr_array_index( records, i );
+        sprintf( name, "v%u", (i * 5 + 2) % 3 );
+        check_record_string( rec, 1, name );
+        ok( libmsi_record_get_int( rec, 2 ) == i * 5 + 2, "wrong row %u\n", i );
+    }
+    if (records)
+        g_ptr_array_unref( records );
+    libmsi_query_close( hquery, NULL );
+    g_object_unref( hquery );
+
+    /* the distinct rows aren't contiguous in the table */
+    hquery = libmsi_query_new( hdb, "SELECT DISTINCT `B`, `C` FROM `Range` WHERE `A` >= 100", NULL );
+    ok( hquery, "failed to open query\n");
+    ok( libmsi_query_execute( hquery, 0, NULL ), "query execute failed\n");
+    records = libmsi_query_fetch_batch( hquery, 1000, NULL );
+    ok( records && records->len == 15, "expected 15 records, got %u\n", records ? records->len : 0 );
+    for (i = 0; records && i < records->len; i++)
+    {
+        rec = g_ptr_array_index( records, i );
+        ok( libmsi_record_get_int( rec, 1 ) == (100 + i) % 5, "wrong row %u\n", i );
+        sprintf( name, "v%u", (100 + i) % 3 );
+        check_record_string( rec, 2, name );
+    }
+    if (records)
+        g_ptr_array_unref( records );
+    libmsi_query_close( hquery, NULL );
+    g_object_unref( hquery );
+
+    hquery = libmsi_query_new( hdb, "SELECT `B`, COUNT(*), MAX(`A`) FROM `Range` GROUP BY `B`", NULL );
+    ok( hquery, "failed to open query\n");
+    ok( libmsi_query_execute( hquery, 0, NULL ), "query execute failed\n");
+    for (i = 0; i < 5; i++)
+    {
+        rec = libmsi_query_fetch( hquery, NULL );
+        ok( rec, "expected group %u\n", i );
+        if (!rec)
+            break;
+        ok( libmsi_record_get_int( rec, 1 ) == i, "wrong group %u\n", i );
+        ok( libmsi_record_get_int( rec, 2 ) == 140, "wrong count for group %u\n", i );
+        ok( libmsi_record_get_int( rec, 3 ) == 695 + i, "wrong maximum for group %u\n", i );
+        g_object_unref( rec );
+    }
+    libmsi_query_close( hquery, NULL );
+    g_object_unref( hquery );
+
+    g_object_unref( hdb );
+    unlink( msifile );
+}
+
+static void test_record_string_const(void)
+{
+    LibmsiDatabase *hdb = 0;
+    LibmsiQuery *hquery;
+    LibmsiRecord *rec;
+    const char *str;
+    unsigned r;
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    r = run_query( hdb, 0,
+            "CREATE TABLE `Const` ( `A` SHORT NOT NULL, `B` CHAR(16) PRIMARY KEY `A` )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to create table: %d\n", r );
+    r = run_query( hdb, 0, "INSERT INTO `Const` ( `A`, `B` ) VALUES ( 1, 'one' )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to insert: %d\n", r );
+
+    hquery = libmsi_query_new( hdb, "SELECT `A`, `B` FROM `Const`", NULL );
+    ok( hquery, "failed to open query\n");
+    ok( libmsi_query_execute( hquery, 0, NULL ), "query execute failed\n");
+    rec = libmsi_query_fetch( hquery, NULL );
+    ok( rec, "expected a record\n");
+    libmsi_query_close( hquery, NULL );
+    g_object_unref( hquery );
+
+    ok( libmsi_record_get_string_const( rec, 1 ) == NULL, "expected no string for an integer\n");
+    str = libmsi_record_get_string_const( rec, 2 );
+    ok( str && !strcmp( str, "one" ), "expected one, got %s\n", str );
+    ok( libmsi_record_get_string_const( rec, 2 ) == str, "expected the same string\n");
+
+    /* the string outlives a commit and the database */
+    r = libmsi_database_commit( hdb, NULL );
+    ok( r, "failed to commit\n");
+    g_object_unref( hdb );
+    str = libmsi_record_get_string_const( rec, 2 );
+    ok( str && !strcmp( str, "one" ), "expected one, got %s\n", str );
+    check_record_string( rec, 2, "one" );
+
+    /* changing the field replaces the string */
+    libmsi_record_set_string( rec, 2, "two" );
+    str = libmsi_record_get_string_const( rec, 2 );
+    ok( str && !strcmp( str, "two" ), "expected two, got %s\n", str );
+    libmsi_record_set_int( rec, 2, 2 );
+    ok( libmsi_record_get_string_const( rec, 2 ) == NULL, "expected no string\n");
+    ok( libmsi_record_get_string_const( rec, 3 ) == NULL, "expected no string past the end\n");
+
+    g_object_unref( rec );
+    unlink( msifile );
+}
+
+static void test_lazy_stream(void)
+{
+    GInputStream *in;
+    LibmsiDatabase *hdb = 0;
+    LibmsiQuery *hquery;
+    LibmsiRecord *rec;
+    GPtrArray *records;
+    char file[16];
+    char buf[256];
+    unsigned r, i;
+    gssize size;
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    r = run_query( hdb, 0,
+            "CREATE TABLE `Lazy` ( `Name` CHAR(72) NOT NULL, `Data` OBJECT PRIMARY KEY `Name` )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to create table: %d\n", r );
+
+    hquery = libmsi_query_new( hdb, "INSERT INTO `Lazy` ( `Name`, `Data` ) VALUES ( ?, ? )", NULL );
+    ok( hquery, "failed to open query\n");
+    rec = libmsi_record_new( 2 );
+    for (i = 0; i < 3; i++)
+    {
+        sprintf( file, "lazy%u.txt", i );
+        create_file( file );
+        libmsi_record_set_string( rec, 1, file );
+        r = libmsi_record_load_stream( rec, 2, file );
+        ok( r, "failed to load stream %u\n", i );
+        unlink( file );
+        r = libmsi_query_execute( hquery, rec, NULL );
+        ok( r, "failed to insert row %u\n", i );
+    }
+    g_object_unref( rec );
+    libmsi_query_close( hquery, NULL );
+    g_object_unref( hquery );
+
+    hquery = libmsi_query_new( hdb, "SELECT `Data`, `Name` FROM `Lazy` WHERE `Name` <> 'lazy1.txt'", NULL );
+    ok( hquery, "failed to open query\n");
+    ok( libmsi_query_execute( hquery, 0, NULL ), "query execute failed\n");
+    records = libmsi_query_fetch_batch( hquery, 10, NULL );
+    ok( records && records->len == 2, "expected 2 records, got %u\n", records ? records->len : 0 );
+    libmsi_query_close( hquery, NULL );
+    g_object_unref( hquery );
+
+    /* the streams are opened once they are read */
+    r = libmsi_database_commit( hdb, NULL );
+    ok( r, "failed to commit\n");
+    g_object_unref( hdb );
+
+    for (i = 0; records && i < records->len; i++)
+    {
+        rec = g_ptr_array_index( records, records->len - 1 - i );
+        sprintf( file, "lazy%u.txt", (records->len - 1 - i) * 2 );
+        check_record_string( rec, 2, file );
+
+        memset( buf, 0, sizeof(buf) );
+        in = libmsi_record_get_stream( rec, 1 );
+        ok( in, "failed to get stream %u\n", i );
+        if (!in)
+            continue;
+        size = g_input_stream_read( in, buf, sizeof(buf), NULL, NULL );
+        ok( size == strlen( file ) + 1, "wrong size %d\n", (int)size );
+        ok( !strncmp( buf, file, strlen( file ) ), "expected %s, got %s\n", file, buf );
+        g_object_unref( in );
+
+        in = libmsi_record_get_stream( rec, 1 );
+        ok( in, "failed to get stream %u again\n", i );
+        if (in)
+            g_object_unref( in );
+    }
+    if (records)
+        g_ptr_array_unref( records );
+
+    unlink( msifile );
+}
+
+static void check_lazy_stream( LibmsiRecord *rec, const char *expected )
+{
+    GInputStream *in;
+    char buf[256];
+    gssize size;
+
+    memset( buf, 0, sizeof(buf) );
+    in = libmsi_record_get_stream( rec, 1 );
+    ok( in, "failed to get stream\n");
+    if (!in)
+        return;
+    size = g_input_stream_read( in, buf, sizeof(buf), NULL, NULL );
+    ok( size == strlen( expected ) + 1, "wrong size %d\n", (int)size );
+    ok( !strncmp( buf, expected, strlen( expected ) ), "expected %s, got %s\n", expected, buf );
+    g_object_unref( in );
+}
+
+static void test_lazy_stream_changed(void)
+{
+    LibmsiDatabase *hdb = 0;
+    LibmsiQuery *hquery;
+    LibmsiRecord *rec, *fetched;
+    unsigned r;
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    r = run_query( hdb, 0,
+            "CREATE TABLE `Lazy` ( `Name` CHAR(72) NOT NULL, `Data` OBJECT PRIMARY KEY `Name` )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to create table: %d\n", r );
+
+    create_file( "old.txt" );
+    rec = libmsi_record_new( 1 );
+    r = libmsi_record_load_stream( rec, 1, "old.txt" );
+    ok( r, "failed to load stream\n");
+    unlink( "old.txt" );
+    r = run_query( hdb, rec, "INSERT INTO `Lazy` ( `Name`, `Data` ) VALUES ( 'one', ? )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to insert: %d\n", r );
+    g_object_unref( rec );
+
+    /* a fetched record keeps the data the stream had when it was fetched */
+    r = do_query( hdb, "SELECT `Data` FROM `Lazy` WHERE `Name` = 'one'", &fetched );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+
+    create_file( "new.txt" );
+    rec = libmsi_record_new( 1 );
+    r = libmsi_record_load_stream( rec, 1, "new.txt" );
+    ok( r, "failed to load stream\n");
+    unlink( "new.txt" );
+    r = run_query( hdb, rec, "UPDATE `Lazy` SET `Data` = ? WHERE `Name` = 'one'" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to update: %d\n", r );
+    g_object_unref( rec );
+
+    check_lazy_stream( fetched, "old.txt" );
+    g_object_unref( fetched );
+
+    /* and can still be read once the stream is gone */
+    r = do_query( hdb, "SELECT `Data` FROM `Lazy` WHERE `Name` = 'one'", &fetched );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+
+    r = run_query( hdb, 0, "DELETE FROM `_Streams` WHERE `Name` = 'Lazy.one'" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to delete stream: %d\n", r );
+
+    check_lazy_stream( fetched, "new.txt" );
+    g_object_unref( fetched );
+
+    hquery = libmsi_query_new( hdb, "SELECT `Name` FROM `_Streams` WHERE `Name` = 'Lazy.one'", NULL );
+    ok( hquery, "failed to open query\n");
+    ok( libmsi_query_execute( hquery, 0, NULL ), "query execute failed\n");
+    rec = libmsi_query_fetch( hquery, NULL );
+    ok( !rec, "expected the stream to be deleted\n");
+    libmsi_query_close( hquery, NULL );
+    g_object_unref( hquery );
+
+    g_object_unref( hdb );
+    unlink( msifile );
+}
+
+static void test_stream_directory(void)
+{
+    LibmsiDatabase *hdb = 0;
+    LibmsiQuery *hquery;
+    LibmsiRecord *rec;
+    char name[16];
+    unsigned r, i;
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    create_file( "dir.txt" );
+    hquery = libmsi_query_new( hdb, "INSERT INTO `_Streams` ( `Name`, `Data` ) VALUES ( ?, ? )", NULL );
+    ok( hquery, "failed to open query\n");
+    rec = libmsi_record_new( 2 );
+    for (i = 0; i < 200; i++)
+    {
+        sprintf( name, "s%u", i );
+        libmsi_record_set_string( rec, 1, name );
+        r = libmsi_record_load_stream( rec, 2, "dir.txt" );
+        ok( r, "failed to load stream %u\n", i );
+        r = libmsi_query_execute( hquery, rec, NULL );
+        ok( r, "failed to insert stream %u\n", i );
+    }
+    g_object_unref( rec );
+    libmsi_query_close( hquery, NULL );
+    g_object_unref( hquery );
+    unlink( "dir.txt" );
+
+    ok( count_rows( hdb, NULL, "SELECT `Name` FROM `_Streams`" ) == 200, "expected 200 streams\n" );
+
+    /* changes are seen by the next queries */
+    r = run_query( hdb, 0, "DELETE FROM `_Streams` WHERE `Name` = 's10'" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to delete stream: %d\n", r );
+    ok( count_rows( hdb, NULL, "SELECT `Name` FROM `_Streams`" ) == 199, "expected 199 streams\n" );
+    ok( count_rows( hdb, NULL, "SELECT `Name` FROM `_Streams` WHERE `Name` = 's10'" ) == 0, "expected no stream\n" );
+    ok( count_rows( hdb, NULL, "SELECT `Name` FROM `_Streams` WHERE `Name` = 's11'" ) == 1, "expected one stream\n" );
+
+    /* joins look the streams up by name */
+    r = run_query( hdb, 0, "CREATE TABLE `Files` ( `File` CHAR(16) NOT NULL PRIMARY KEY `File` )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to create table: %d\n", r );
+    r = run_query( hdb, 0, "INSERT INTO `Files` ( `File` ) VALUES ( 's10' )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to insert: %d\n", r );
+    r = run_query( hdb, 0, "INSERT INTO `Files` ( `File` ) VALUES ( 's150' )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to insert: %d\n", r );
+    r = run_query( hdb, 0, "INSERT INTO `Files` ( `File` ) VALUES ( 's199' )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to insert: %d\n", r );
+
+    hquery = libmsi_query_new( hdb, "SELECT `File`, `Name` FROM `Files`, `_Streams` "
+                                    "WHERE `File` = `Name` ORDER BY `File`", NULL );
+    ok( hquery, "failed to open query\n");
+    ok( libmsi_query_execute( hquery, 0, NULL ), "query execute failed\n");
+    rec = libmsi_query_fetch( hquery, NULL );
+    ok( rec, "expected a record\n");
+    check_record_string( rec, 2, "s150" );
+    g_object_unref( rec );
+    rec = libmsi_query_fetch( hquery, NULL );
+    ok( rec, "expected a record\n");
+    check_record_string( rec, 2, "s199" );
+    g_object_unref( rec );
+    query_check_no_more( hquery );
+    libmsi_query_close( hquery, NULL );
+    g_object_unref( hquery );
+
+    /* and after the database is written back */
+    r = libmsi_database_commit( hdb, NULL );
+    ok( r, "failed to commit\n");
+    ok( count_rows( hdb, NULL, "SELECT `Name` FROM `_Streams`" ) == 199, "expected 199 streams\n" );
+    ok( count_rows( hdb, NULL, "SELECT `Name` FROM `_Streams` WHERE `Name` = 's199'" ) == 1, "expected one stream\n" );
+
+    g_object_unref( hdb );
+    unlink( msifile );
+}
+
+static void test_eager_open(void)
+{
+    LibmsiDatabase *hdb = 0;
+    LibmsiQuery *hquery;
+    LibmsiRecord *rec;
+    char name[32];
+    unsigned r, i;
+
+    unlink( msifile );
+    hdb = libmsi_database_new( msifile, LIBMSI_DB_FLAGS_CREATE, NULL, NULL );
+    ok( hdb, "failed to create db\n");
+
+    r = run_query( hdb, 0,
+            "CREATE TABLE `Names` ( `Id` LONG NOT NULL, `Name` CHAR(32) PRIMARY KEY `Id` )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to create table: %d\n", r );
+    r = run_query( hdb, 0,
+            "CREATE TABLE `Small` ( `A` SHORT NOT NULL PRIMARY KEY `A` )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to create table: %d\n", r );
+    r = run_query( hdb, 0, "INSERT INTO `Small` ( `A` ) VALUES ( 1 ), ( 2 )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to insert: %d\n", r );
+
+    /* enough strings for the pool to be converted in several chunks */
+    hquery = libmsi_query_new( hdb, "INSERT INTO `Names` ( `Id`, `Name` ) VALUES ( ?, ? )", NULL );
+    ok( hquery, "failed to open query\n");
+    rec = libmsi_record_new( 2 );
+    for (i = 0; i < 10000; i++)
+    {
+        sprintf( name, "name%u", i );
+        libmsi_record_set_int( rec, 1, i );
+        libmsi_record_set_string( rec, 2, name );
+        if (!libmsi_query_execute( hquery, rec, NULL ))
+            break;
+    }
+    ok( i == 10000, "insert failed at row %u\n", i );
+    g_object_unref( rec );
+    libmsi_query_close( hquery, NULL );
+    g_object_unref( hquery );
+
+    r = libmsi_database_commit( hdb, NULL );
+    ok( r, "failed to commit\n");
+    g_object_unref( hdb );
+
+    hdb = libmsi_database_new( msifile, LIBMSI_DB_FLAGS_READONLY | LIBMSI_DB_FLAGS_EAGER, NULL, NULL );
+    ok( hdb, "failed to open db\n");
+
+    ok( count_rows( hdb, NULL, "SELECT `Id` FROM `Names`" ) == 10000, "expected 10000 rows\n" );
+    ok( count_rows( hdb, NULL, "SELECT `A` FROM `Small`" ) == 2, "expected 2 rows\n" );
+
+    hquery = libmsi_query_new( hdb, "SELECT `Name` FROM `Names` WHERE `Id` = 9999", NULL );
+    ok( hquery, "failed to open query\n");
+    r = libmsi_query_execute( hquery, 0, NULL );
+    ok( r, "query execute failed\n");
+    rec = libmsi_query_fetch( hquery, NULL );
+    ok( rec != NULL, "expected a row\n");
+    check_record_string( rec, 1, "name9999" );
+    g_object_unref( rec );
+    query_check_no_more( hquery );
+    libmsi_query_close( hquery, NULL );
+    g_object_unref( hquery );
+
+    g_object_unref( hdb );
+    unlink( msifile );
+}
+
+static void test_large_stream(void)
+{
+    GInputStream *in;
+    LibmsiDatabase *hdb = 0;
+    LibmsiQuery *hquery;
+    LibmsiRecord *rec;
+    const unsigned size = 3 * 1024 * 1024 + 17;
+    char *data, *buf;
+    gsize total = 0;
+    gssize n;
+    unsigned r, i;
+
+    data = g_malloc( size );
+    for (i = 0; i < size; i++)
+        data[i] = 'a' + (i * 7) % 26;
+    buf = g_malloc( size );
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    r = run_query( hdb, 0,
+            "CREATE TABLE `Large` ( `Name` CHAR(72) NOT NULL, `Data` OBJECT PRIMARY KEY `Name` )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to create table: %d\n", r );
+
+    /* big enough to be read at commit rather than copied into memory */
+    unlink( "large.bin" );
+    create_file_data( "large.bin", data, size );
+
+    rec = libmsi_record_new( 2 );
+    libmsi_record_set_string( rec, 1, "large" );
+    r = libmsi_record_load_stream( rec, 2, "large.bin" );
+    ok( r, "failed to load stream\n");
+    r = run_query( hdb, rec, "INSERT INTO `Large` ( `Name`, `Data` ) VALUES ( ?, ? )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to insert: %d\n", r );
+    g_object_unref( rec );
+
+    r = libmsi_database_commit( hdb, NULL );
+    ok( r, "failed to commit\n");
+    g_object_unref( hdb );
+    unlink( "large.bin" );
+
+    hdb = libmsi_database_new( msifile, LIBMSI_DB_FLAGS_READONLY, NULL, NULL );
+    ok( hdb, "failed to open db\n");
+
+    hquery = libmsi_query_new( hdb, "SELECT `Data` FROM `Large`", NULL );
+    ok( hquery, "failed to open query\n");
+    r = libmsi_query_execute( hquery, 0, NULL );
+    ok( r, "query execute failed\n");
+    rec = libmsi_query_fetch( hquery, NULL );
+    ok( rec != NULL, "expected a row\n");
+    in = rec ? libmsi_record_get_stream( rec, 1 ) : NULL;
+    ok( in, "failed to get stream\n");
+    while (in && total < size)
+    {
+        n = g_input_stream_read( in, buf + total, MIN( 65536, size - total ), NULL, NULL );
+        if (n <= 0)
+            break;
+        total += n;
+    }
+    ok( total == size, "wrong size %u\n", (unsigned)total );
+    ok( !memcmp( buf, data, size ), "wrong data\n");
+    if (in)
+        g_object_unref( in );
+    if (rec)
+        g_object_unref( rec );
+    libmsi_query_close( hquery, NULL );
+    g_object_unref( hquery );
+
+    g_object_unref( hdb );
+    unlink( msifile );
+    g_free( buf );
+    g_free( data );
+}
+
+static void test_many_large_streams(void)
+{
+    GInputStream *in;
+    LibmsiRecord *recs[2048];
+    const unsigned size = 1024 * 1024;
+    char *data, *buf;
+    gsize total = 0;
+    gssize n;
+    unsigned i, loaded = 0;
+
+    data = g_malloc( size );
+    for (i = 0; i < size; i++)
+        data[i] = 'a' + (i * 11) % 26;
+    buf = g_malloc( size );
+
+    unlink( "large.bin" );
+    create_file_data( "large.bin", data, size );
+
+    /* more records than a process usually has descriptors; the files
+     * are only opened when they are read */
+    for (i = 0; i < G_N_ELEMENTS(recs); i++)
+    {
+        recs[i] = libmsi_record_new( 1 );
+        if (libmsi_record_load_stream( recs[i], 1, "large.bin" ))
+            loaded++;
+    }
+    ok( loaded == G_N_ELEMENTS(recs), "loaded %u streams\n", loaded );
+
+    in = libmsi_record_get_stream( recs[G_N_ELEMENTS(recs) - 1], 1 );
+    ok( in, "failed to get stream\n");
+    while (in && total < size)
+    {
+        n = g_input_stream_read( in, buf + total, size - total, NULL, NULL );
+        if (n <= 0)
+            break;
+        total += n;
+    }
+    ok( total == size, "wrong size %u\n", (unsigned)total );
+    ok( !memcmp( buf, data, size ), "wrong data\n");
+    if (in)
+        g_object_unref( in );
+
+    for (i = 0; i < G_N_ELEMENTS(recs); i++)
+        g_object_unref( recs[i] );
+    unlink( "large.bin" );
+    g_free( buf );
+    g_free( data );
+}
+
+static void test_parallel_commit(void)
+{
+    LibmsiDatabase *hdb = 0;
+    char sql[128];
+    unsigned r, i;
+
+    unlink( msifile );
+    hdb = libmsi_database_new( msifile, LIBMSI_DB_FLAGS_CREATE | LIBMSI_DB_FLAGS_PARALLEL, NULL, NULL );
+    ok( hdb, "failed to create db\n");
+
+    /* each table is encoded on a thread of its own */
+    for (i = 0; i < 8; i++)
+    {
+        sprintf( sql, "CREATE TABLE `T%u` ( `A` SHORT NOT NULL, `B` CHAR(16) PRIMARY KEY `A` )", i );
+        r = run_query( hdb, 0, sql );
+        ok( r == LIBMSI_RESULT_SUCCESS, "failed to create table %u: %d\n", i, r );
+        sprintf( sql, "INSERT INTO `T%u` ( `A`, `B` ) VALUES ( 1, 'one' ), ( 2, 'two' ), ( %u, 'n' )", i, i + 3 );
+        r = run_query( hdb, 0, sql );
+        ok( r == LIBMSI_RESULT_SUCCESS, "failed to insert into table %u: %d\n", i, r );
+    }
+
+    r = libmsi_database_commit( hdb, NULL );
+    ok( r, "failed to commit\n");
+    g_object_unref( hdb );
+
+    hdb = libmsi_database_new( msifile, LIBMSI_DB_FLAGS_READONLY, NULL, NULL );
+    ok( hdb, "failed to open db\n");
+    for (i = 0; i < 8; i++)
+    {
+        sprintf( sql, "SELECT `A` FROM `T%u`", i );
+        ok( count_rows( hdb, NULL, sql ) == 3, "expected 3 rows in table %u\n", i );
+        sprintf( sql, "SELECT `A` FROM `T%u` WHERE `B` = 'two'", i );
+        ok( count_rows( hdb, NULL, sql ) == 1, "expected 1 row in table %u\n", i );
+    }
+    g_object_unref( hdb );
+    unlink( msifile );
+}
+
+static void test_bulk_import(void)
+{
+    LibmsiDatabase *hdb;
+    LibmsiRecord *hrec;
+    GString *idt;
+    unsigned r, i;
+    gchar *str;
+
+    idt = g_string_new( "Key\tValue\tGroup\tShort\n"
+                        "s72\ti4\tS32\tI2\n"
+                        "Bulk\tKey\n" );
+    /* rows out of key order, repeated strings and NULL fields */
+    for (i = 0; i < 1000; i++)
+    {
+        unsigned n = (i * 7) % 1000;
+        g_string_append_printf( idt, "key%u\t%d\t%s\t%s\r\n", n, (int)n - 500,
+                                n % 3 ? "group" : "", n % 2 ? "" : "-7" );
+    }
+    g_string_append( idt, "last\t2147483647\tline\x11\x19two\t32767" );
+
+    hdb = libmsi_database_new( msifile, LIBMSI_DB_FLAGS_CREATE, NULL, NULL );
+    ok( hdb, "failed to create db\n");
+
+    write_file( "bulk.idt", idt->str, idt->len );
+    r = libmsi_database_import( hdb, "bulk.idt", NULL );
+    ok( r, "libmsi_database_import() failed\n");
+
+    ok( count_rows( hdb, NULL, "SELECT * FROM `Bulk`" ) == 1001, "wrong row count\n");
+    ok( count_rows( hdb, NULL, "SELECT * FROM `Bulk` WHERE `Group` = 'group'" ) == 666,
+        "wrong group count\n");
+    ok( count_rows( hdb, NULL, "SELECT * FROM `Bulk` WHERE `Short` = -7" ) == 500,
+        "wrong short count\n");
+
+    r = do_query( hdb, "SELECT `Value`, `Group`, `Short` FROM `Bulk` WHERE `Key` = 'key3'", &hrec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed %u\n", r );
+    ok( libmsi_record_get_int( hrec, 1 ) == -497, "wrong value\n");
+    check_record_string( hrec, 2, "" );
+    ok( libmsi_record_is_null( hrec, 3 ), "expected NULL\n");
+    g_object_unref( hrec );
+
+    r = do_query( hdb, "SELECT `Value`, `Group`, `Short` FROM `Bulk` WHERE `Key` = 'last'", &hrec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed %u\n", r );
+    ok( libmsi_record_get_int( hrec, 1 ) == 2147483647, "wrong value\n");
+    str = libmsi_record_get_string( hrec, 2 );
+    ok( str && !strcmp( str, "line\r\ntwo" ), "wrong string %s\n", str );
+    g_free( str );
+    ok( libmsi_record_get_int( hrec, 3 ) == 32767, "wrong short\n");
+    g_object_unref( hrec );
+
+    /* importing again replaces the rows */
+    r = libmsi_database_import( hdb, "bulk.idt", NULL );
+    ok( r, "libmsi_database_import() failed\n");
+    ok( count_rows( hdb, NULL, "SELECT * FROM `Bulk`" ) == 1001, "wrong row count\n");
+
+    /* the strings survive a commit */
+    r = libmsi_database_commit( hdb, NULL );
+    ok( r, "failed to commit\n");
+    g_object_unref( hdb );
+
+    hdb = libmsi_database_new( msifile, LIBMSI_DB_FLAGS_READONLY, NULL, NULL );
+    ok( hdb, "failed to open db\n");
+    ok( count_rows( hdb, NULL, "SELECT * FROM `Bulk` WHERE `Group` = 'group'" ) == 666,
+        "wrong group count\n");
+    g_object_unref( hdb );
+
+    g_string_free( idt, TRUE );
+    unlink( "bulk.idt" );
+    unlink( msifile );
+}
+
+static void test_bulk_import_shared(void)
+{
+    LibmsiDatabase *hdb;
+    GString *idt;
+    unsigned r, i;
+
+    /* more rows share a value than a string reference count can hold */
+    idt = g_string_new( "Key\tValue\r\ni4\tS72\r\nShared\tKey\r\n" );
+    for (i = 0; i < 65536; i++)
+        g_string_append_printf( idt, "%u\tshared\r\n", i );
+    g_string_append_printf( idt, "%u\tother\r\n", i );
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    write_file( "shared.idt", idt->str, idt->len );
+    r = libmsi_database_import( hdb, "shared.idt", NULL );
+    ok( r, "libmsi_database_import() failed\n");
+    unlink( "shared.idt" );
+
+    r = libmsi_database_commit( hdb, NULL );
+    ok( r, "failed to commit\n");
+    g_object_unref( hdb );
+
+    hdb = libmsi_database_new( msifile, LIBMSI_DB_FLAGS_READONLY, NULL, NULL );
+    ok( hdb, "failed to open db\n");
+    ok( count_rows( hdb, NULL, "SELECT * FROM `Shared`" ) == 65537, "wrong row count\n");
+    ok( count_rows( hdb, NULL, "SELECT * FROM `Shared` WHERE `Value` = 'shared'" ) == 65536,
+        "wrong shared count\n");
+    g_object_unref( hdb );
+
+    g_string_free( idt, TRUE );
+    unlink( msifile );
+}
+
+static void test_import_many(void)
+{
+    static const char one[] =
+        "A\tB\n"
+        "s72\ti2\n"
+        "One\tA\n"
+        "a\t1\n"
+        "b\t2\n";
+    static const char two[] =
+        "C\n"
+        "S255\n"
+        "Two\tC\n"
+        "x\n";
+    const char *paths[] = { "one.idt", "missing.idt", "two.idt", "codepage.idt" };
+    LibmsiDatabase *hdb;
+    GError *error = NULL;
+    unsigned r;
+
+    hdb = libmsi_database_new( msifile, LIBMSI_DB_FLAGS_CREATE, NULL, NULL );
+    ok( hdb, "failed to create db\n");
+
+    write_file( "one.idt", one, sizeof(one) - 1 );
+    write_file( "two.idt", two, sizeof(two) - 1 );
+    write_file( "codepage.idt", "\r\n\r\n850\t_ForceCodepage\r\n", 24 );
+
+    /* nothing is imported when a file cannot be read */
+    r = libmsi_database_import_many( hdb, paths, 4, &error );
+    ok( !r, "libmsi_database_import_many() succeeded\n");
+    ok( error != NULL, "expected an error\n");
+    g_clear_error( &error );
+    ok( count_rows( hdb, NULL, "SELECT * FROM `_Tables` WHERE `Name` = 'One'" ) == 0,
+        "table One was created\n");
+
+    paths[1] = paths[0];
+    r = libmsi_database_import_many( hdb, paths + 1, 3, &error );
+    ok( r, "libmsi_database_import_many() failed\n");
+    ok( error == NULL, "unexpected error\n");
+
+    ok( count_rows( hdb, NULL, "SELECT * FROM `One`" ) == 2, "wrong row count\n");
+    ok( count_rows( hdb, NULL, "SELECT * FROM `Two` WHERE `C` = 'x'" ) == 1, "wrong row count\n");
+
+    g_object_unref( hdb );
+    unlink( "one.idt" );
+    unlink( "two.idt" );
+    unlink( "codepage.idt" );
+    unlink( msifile );
+}
+
+static void test_export_all(void)
+{
+    static const char phone[] =
+        "id\tname\tnumber\r\n"
+        "I2\tS32\tS32\r\n"
+        "phone\tid\r\n"
+        "1\tAbe\t8675309\r\n"
+        "2\tBob\t5551234\r\n";
+    static const char binary[] =
+        "Name\tData\r\n"
+        "s72\tV0\r\n"
+        "Binary\tName\r\n"
+        "filename1\t";
+    LibmsiDatabase *hdb;
+    GError *error = NULL;
+    char *data, *path, *name;
+    gsize len;
+    unsigned r;
+
+    write_file( "bin_import.idt", bin_import_dat, sizeof(bin_import_dat) - 1 );
+    mkdir( "Binary", 0755 );
+    create_file_data( "Binary/filename1.ibd", "just some words", 15 );
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+    r = libmsi_database_import( hdb, "bin_import.idt", NULL );
+    ok( r, "failed to import Binary table\n");
+    r = run_query( hdb, 0, "CREATE TABLE `phone` ( `id` INT, `name` CHAR(32), "
+                           "`number` CHAR(32) PRIMARY KEY `id`)" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to create table: %u\n", r );
+    r = run_query( hdb, 0, "INSERT INTO `phone` ( `id`, `name`, `number` ) "
+                           "VALUES ( 2, 'Bob', '5551234' ), ( 1, 'Abe', '8675309' )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to insert: %u\n", r );
+    r = libmsi_database_commit( hdb, NULL );
+    ok( r, "failed to commit\n");
+    g_object_unref( hdb );
+
+    hdb = libmsi_database_new( msifile, LIBMSI_DB_FLAGS_READONLY, NULL, NULL );
+    ok( hdb, "failed to open db\n");
+    r = libmsi_database_export_all( hdb, "export_dir", &error );
+    ok( r, "libmsi_database_export_all() failed\n");
+    ok( error == NULL, "unexpected error\n");
+    g_object_unref( hdb );
+
+    r = g_file_get_contents( "export_dir/phone.idt", &data, &len, NULL );
+    ok( r, "phone.idt not written\n");
+    ok( r && len == sizeof(phone) - 1 && !memcmp( data, phone, len ),
+        "wrong phone.idt contents\n");
+    g_free( data );
+
+    r = g_file_get_contents( "export_dir/_SummaryInformation.idt", &data, &len, NULL );
+    ok( r && g_str_has_prefix( data, "PropertyId\tValue\r\n" ), "wrong summary information\n");
+    g_free( data );
+    ok( g_file_test( "export_dir/_ForceCodepage.idt", G_FILE_TEST_EXISTS ),
+        "codepage not written\n");
+
+    /* the last field of the row names the file the stream was written to */
+    r = g_file_get_contents( "export_dir/Binary.idt", &data, &len, NULL );
+    ok( r && g_str_has_prefix( data, binary ), "wrong Binary.idt contents\n");
+    name = r ? g_strndup( data + sizeof(binary) - 1, len - sizeof(binary) - 1 ) : NULL;
+    g_free( data );
+
+    path = g_build_filename( "export_dir", "Binary", name, NULL );
+    r = g_file_get_contents( path, &data, &len, NULL );
+    ok( r && len == 15 && !memcmp( data, "just some words", 15 ), "wrong stream contents\n");
+    g_free( data );
+    unlink( path );
+    g_free( path );
+    g_free( name );
+
+    rmdir( "export_dir/Binary" );
+    unlink( "export_dir/phone.idt" );
+    unlink( "export_dir/Binary.idt" );
+    unlink( "export_dir/_SummaryInformation.idt" );
+    unlink( "export_dir/_ForceCodepage.idt" );
+    rmdir( "export_dir" );
+    unlink( "Binary/filename1.ibd" );
+    rmdir( "Binary" );
+    unlink( "bin_import.idt" );
+    unlink( msifile );
+}
+
+static void test_attach_delete(void)
+{
+    GError *error = NULL;
+    LibmsiDatabase *hdb, *hdb2;
+    unsigned r;
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    hdb2 = libmsi_database_new( msifile2, LIBMSI_DB_FLAGS_CREATE, NULL, NULL );
+    ok( hdb2, "failed to create db\n");
+
+    r = libmsi_database_execute_script( hdb2,
+            "CREATE TABLE `File` ( `File` CHAR(72) NOT NULL, `Size` LONG PRIMARY KEY `File` )\n"
+            "INSERT INTO `File` ( `File`, `Size` ) VALUES ( 'a.txt', 10 ), ( 'b.txt', 20 )",
+            NULL, &error );
+    ok( r, "failed to execute script\n");
+
+    r = libmsi_database_attach( hdb, hdb2, "old", &error );
+    ok( r, "failed to attach database\n");
+
+    /* deleting from an attached table fails instead of crashing */
+    r = run_query( hdb, 0, "DELETE FROM `old`.`File`" );
+    ok( r != LIBMSI_RESULT_SUCCESS, "expected failure\n");
+    r = run_query( hdb, 0, "DELETE FROM `old`.`File` WHERE `Size` = 10" );
+    ok( r != LIBMSI_RESULT_SUCCESS, "expected failure\n");
+
+    ok( count_rows( hdb, NULL, "SELECT * FROM `old`.`File`" ) == 2, "rows were deleted\n");
+    ok( count_rows( hdb2, NULL, "SELECT * FROM `File`" ) == 2, "rows were deleted\n");
+
+    g_object_unref( hdb );
+    g_object_unref( hdb2 );
+    unlink( msifile );
+    unlink( msifile2 );
+}
+
+static void test_execute_script_schema(void)
+{
+    GError *error = NULL;
+    LibmsiDatabase *hdb;
+    LibmsiRecord *rec;
+    unsigned r;
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    /* the repeated statements must not reuse views of the dropped table,
+     * or of the table before its new column */
+    r = libmsi_database_execute_script( hdb,
+            "CREATE TABLE `T` ( `A` SHORT NOT NULL PRIMARY KEY `A` )\n"
+            "INSERT INTO `T` ( `A` ) VALUES ( 1 )\n"
+            "DROP TABLE `T`\n"
+            "CREATE TABLE `T` ( `A` SHORT NOT NULL PRIMARY KEY `A` )\n"
+            "INSERT INTO `T` ( `A` ) VALUES ( 1 )\n"
+            "DELETE FROM `T` WHERE `A` = 2\n"
+            "ALTER TABLE `T` ADD `B` CHAR(16)\n"
+            "INSERT INTO `T` ( `A`, `B` ) VALUES ( 2, 'x' )\n"
+            "DELETE FROM `T` WHERE `A` = 2\n"
+            "INSERT INTO `T` ( `A`, `B` ) VALUES ( 2, 'x' )",
+            NULL, &error );
+    ok( r, "failed to execute script\n");
+    ok( !error, "unexpected error\n");
+
+    ok( count_rows( hdb, NULL, "SELECT * FROM `T`" ) == 2, "wrong row count\n");
+
+    r = do_query( hdb, "SELECT `B` FROM `T` WHERE `A` = 2", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    check_record_string( rec, 1, "x" );
+    g_object_unref( rec );
+
+    g_object_unref( hdb );
+    unlink( msifile );
+}
+
+static gsize commit_bulk_import(const char *name, const char *idt)
+{
+    LibmsiDatabase *hdb;
+    struct stat st;
+    unsigned r;
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    r = run_query( hdb, 0, "CREATE TABLE `Dup` ( `Key` CHAR(72) NOT NULL, `Value` LONGCHAR "
+                           "PRIMARY KEY `Key` )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to create table: %u\n", r );
+
+    if (idt)
+    {
+        write_file( name, idt, strlen( idt ) );
+        r = libmsi_database_import( hdb, name, NULL );
+        ok( !r, "import of a duplicate key succeeded\n");
+        unlink( name );
+    }
+    ok( count_rows( hdb, NULL, "SELECT * FROM `Dup`" ) == 0, "wrong row count\n");
+
+    r = libmsi_database_commit( hdb, NULL );
+    ok( r, "failed to commit\n");
+    g_object_unref( hdb );
+
+    r = stat( msifile, &st );
+    ok( !r, "stat failed\n");
+    unlink( msifile );
+    return st.st_size;
+}
+
+static void test_bulk_import_duplicate(void)
+{
+    GString *idt;
+    gsize size, clean;
+    unsigned i;
+
+    /* the strings of a batch that fails do not stay in the string pool */
+    idt = g_string_new( "Key\tValue\r\ns72\tS0\r\nDup\tKey\r\n" );
+    for (i = 0; i < 8; i++)
+    {
+        g_string_append_printf( idt, "key%u\t", i );
+        g_string_append_printf( idt, "%0*u\r\n", 2000, i );
+    }
+    g_string_append( idt, "key3\tduplicate\r\n" );
+
+    clean = commit_bulk_import( "dup.idt", NULL );
+    size = commit_bulk_import( "dup.idt", idt->str );
+    ok( size == clean, "string pool grew from %u to %u bytes\n", (unsigned)clean, (unsigned)size );
+
+    g_string_free( idt, TRUE );
+}
+
+static void test_insert_multirow_strings(void)
+{
+    LibmsiDatabase *hdb = 0;
+    LibmsiQuery *hquery;
+    LibmsiRecord *rec;
+    unsigned r, i;
+    static const char *keys[] = { "zulu", "alpha", "mike" };
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    r = run_query( hdb, 0,
+            "CREATE TABLE `Strs` ( `K` CHAR(72) NOT NULL, `V` SHORT PRIMARY KEY `K` )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to create table: %d\n", r );
+
+    /* the new strings get ids in the order they are listed, and the table
+     * is kept in id order, not in alphabetical order */
+    r = run_query( hdb, 0,
+            "INSERT INTO `Strs` ( `K`, `V` ) VALUES ( 'zulu', 1 ), ( 'alpha', 2 ), ( 'mike', 3 )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to insert rows: %d\n", r );
+
+    hquery = libmsi_query_new( hdb, "SELECT `K`, `V` FROM `Strs`", NULL );
+    ok( hquery, "failed to open query\n");
+    r = libmsi_query_execute( hquery, 0, NULL );
+    ok( r, "query execute failed\n");
+    for (i = 0; i < G_N_ELEMENTS(keys); i++)
+    {
+        rec = libmsi_query_fetch( hquery, NULL );
+        ok( rec, "expected row %u\n", i );
+        if (!rec)
+            break;
+        check_record_string( rec, 1, keys[i] );
+        g_object_unref( rec );
+    }
+    libmsi_query_close( hquery, NULL );
+    g_object_unref( hquery );
+
+    /* single row inserts still find the batch rows */
+    for (i = 0; i < G_N_ELEMENTS(keys); i++)
+    {
+        char *query = g_strdup_printf( "INSERT INTO `Strs` ( `K`, `V` ) VALUES ( '%s', 9 )", keys[i] );
+        r = run_query( hdb, 0, query );
+        ok( r == LIBMSI_RESULT_FUNCTION_FAILED, "expected failure for %s, got %d\n", keys[i], r );
+        g_free( query );
+    }
+
+    r = run_query( hdb, 0, "INSERT INTO `Strs` ( `K`, `V` ) VALUES ( 'bravo', 4 )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to insert: %d\n", r );
+
+    r = do_query( hdb, "SELECT `V` FROM `Strs` WHERE `K` = 'mike'", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 3, "wrong value\n");
+    g_object_unref( rec );
+
+    r = do_query( hdb, "SELECT COUNT(*) FROM `Strs`", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    ok( libmsi_record_get_int( rec, 1 ) == 4, "wrong count\n");
+    g_object_unref( rec );
+
+    g_object_unref( hdb );
+    unlink( msifile );
+}
+
+/* one multi-row INSERT writes the same file as an INSERT per row */
+static void test_insert_multirow_pool(void)
+{
+    static const char *rows[] = {
+        "( 'mike', 'shared', 1 )",
+        "( 'alpha', 'shared', 2 )",
+        "( 'zulu', 'alone', 3 )",
+        "( 'bravo', 'mike', 4 )",
+    };
+    static const char create[] =
+        "CREATE TABLE `Pool` ( `K` CHAR(72) NOT NULL, `S` CHAR(72), `V` SHORT PRIMARY KEY `K` )";
+    LibmsiDatabase *hdb;
+    gchar *single = NULL, *multi = NULL, *query;
+    gsize single_len = 0, multi_len = 0;
+    unsigned r, i;
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+    r = run_query( hdb, 0, create );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to create table: %d\n", r );
+    for (i = 0; i < G_N_ELEMENTS(rows); i++)
+    {
+        query = g_strdup_printf( "INSERT INTO `Pool` ( `K`, `S`, `V` ) VALUES %s", rows[i] );
+        r = run_query( hdb, 0, query );
+        ok( r == LIBMSI_RESULT_SUCCESS, "failed to insert row %u: %d\n", i, r );
+        g_free( query );
+    }
+    r = libmsi_database_commit( hdb, NULL );
+    ok( r, "failed to commit\n");
+    g_object_unref( hdb );
+    ok( g_file_get_contents( msifile, &single, &single_len, NULL ), "failed to read %s\n", msifile );
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+    r = run_query( hdb, 0, create );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to create table: %d\n", r );
+    query = g_strdup_printf( "INSERT INTO `Pool` ( `K`, `S`, `V` ) VALUES %s, %s, %s, %s",
+                             rows[0], rows[1], rows[2], rows[3] );
+    r = run_query( hdb, 0, query );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to insert rows: %d\n", r );
+    g_free( query );
+    r = libmsi_database_commit( hdb, NULL );
+    ok( r, "failed to commit\n");
+    g_object_unref( hdb );
+    ok( g_file_get_contents( msifile, &multi, &multi_len, NULL ), "failed to read %s\n", msifile );
+
+    ok( single_len == multi_len && !memcmp( single, multi, single_len ),
+        "the files differ\n");
+
+    g_free( single );
+    g_free( multi );
+    unlink( msifile );
+}
+
+static void test_insert_many_rows(void)
+{
+    LibmsiDatabase *hdb;
+    LibmsiRecord *rec;
+    GString *sql;
+    unsigned r, i;
+
+    hdb = create_db();
+    ok( hdb, "failed to create db\n");
+
+    r = run_query( hdb, 0,
+            "CREATE TABLE `Many` ( `A` LONG NOT NULL, `B` CHAR(72) PRIMARY KEY `A` )" );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to create table: %d\n", r );
+
+    /* more rows than the parser stack could hold at once */
+    sql = g_string_new( "INSERT INTO `Many` ( `A`, `B` ) VALUES " );
+    for (i = 0; i < 12000; i++)
+        g_string_append_printf( sql, "%s( %u, 'row%u' )", i ? ", " : "", 12000 - i, i % 100 );
+
+    r = run_query( hdb, 0, sql->str );
+    ok( r == LIBMSI_RESULT_SUCCESS, "failed to insert rows: %d\n", r );
+    g_string_free( sql, TRUE );
+
+    ok( count_rows( hdb, NULL, "SELECT * FROM `Many`" ) == 12000, "wrong row count\n");
+
+    r = do_query( hdb, "SELECT `B` FROM `Many` WHERE `A` = 1", &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "query failed: %d\n", r );
+    check_record_string( rec, 1, "row99" );
+    g_object_unref( rec );
+
+    g_object_unref( hdb );
+    unlink( msifile );
+}
+
 int main()
 {
 #if !GLIB_CHECK_VERSION(2,35,1)
@@ -7529,4 +9623,38 @@ int main()
     test_collation();
     test_embedded_nulls();
     test_select_column_names();
+    test_aggregates();
+    test_like();
+    test_like_duplicates();
+    test_explain();
+    test_fetch_batch();
+    test_query_cursor();
+    test_execute_script();
+    test_execute_script_schema();
+    test_insert_multirow();
+    test_insert_multirow_strings();
+    test_insert_multirow_pool();
+    test_insert_many_rows();
+    test_insert_select();
+    test_attach();
+    test_attach_commit();
+    test_attach_delete();
+    test_parallel_scan();
+    test_batch_where();
+    test_batch_where_duplicates();
+    test_join_duplicates();
+    test_fetch_column_range();
+    test_record_string_const();
+    test_lazy_stream();
+    test_lazy_stream_changed();
+    test_stream_directory();
+    test_eager_open();
+    test_large_stream();
+    test_many_large_streams();
+    test_parallel_commit();
+    test_bulk_import();
+    test_bulk_import_shared();
+    test_bulk_import_duplicate();
+    test_import_many();
+    test_export_all();
 }
@@ -124,13 +124,13 @@ end:
 
 static LibmsiDatabase *db;
 
-static gboolean import_table(char *table, GError **error)
+static gboolean import_tables(char **tables, unsigned count, GError **error)
 {
     gboolean success = TRUE;
 
-    if (!libmsi_database_import(db, table, error))
+    if (!libmsi_database_import_many(db, (const char **)tables, count, error))
     {
-        fprintf(stderr, "failed to import table %s\n", table);
+        fprintf(stderr, "failed to import tables\n");
         success = FALSE;
     }
 
@@ -245,7 +245,7 @@ static void show_usage(void)
         "Options:\n"
         "  -s name [author] [template] [uuid] Set summary information.\n"
         "  -q query         Execute SQL query/queries.\n"
-        "  -i table1.idt    Import one table into the database.\n"
+        "  -i table1.idt... Import tables into the database.\n"
         "  -a stream file   Add 'stream' to storage with contents of 'file'.\n"
         "\nExisting tables or streams will be overwritten. If package.msi does not exist a new file\n"
         "will be created with an empty database.\n"
@@ -301,13 +301,11 @@ int main(int argc, char *argv[])
             argc -= n + 1, argv += n + 1;
             break;
         case 'i':
-            do {
-                if (!import_table(argv[1], &error))
-                    break;
-
-                argc--, argv++;
-            } while (argv[1] && argv[1][0] != '-');
-            argc--, argv++;
+            n = 1;
+            while (argv[n + 1] && argv[n + 1][0] != '-') n++;
+            if (!import_tables(&argv[1], n, &error))
+                goto end;
+            argc -= n + 1, argv += n + 1;
             break;
         case 'q':
             do {
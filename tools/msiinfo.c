@@ -637,22 +637,32 @@ static int cmd_export(struct Command *cmd, int argc, char **argv, GError **error
 {
     LibmsiDatabase *db = NULL;
     gboolean sql = FALSE;
+    const char *dir = NULL;
 
     if (argc > 1 && !strcmp(argv[1], "-s")) {
         sql = TRUE;
         argc--;
         argv++;
+    } else if (argc > 2 && !strcmp(argv[1], "-d")) {
+        dir = argv[2];
+        argc -= 2;
+        argv += 2;
     }
 
-    if (argc != 3) {
+    if (argc != (dir ? 2 : 3)) {
         cmd_usage(stderr, cmd);
     }
 
-    db = libmsi_database_new(argv[1], LIBMSI_DB_FLAGS_READONLY, NULL, error);
+    /* every table is read when exporting them all */
+    db = libmsi_database_new(argv[1], LIBMSI_DB_FLAGS_READONLY |
+                             (dir ? LIBMSI_DB_FLAGS_EAGER : 0), NULL, error);
     if (!db)
         return 1;
 
-    if (sql) {
+    if (dir) {
+        if (!libmsi_database_export_all(db, dir, error))
+            goto end;
+    } else if (sql) {
         if (!export_sql(db, argv[2], error))
             return 1;
     } else {
@@ -717,8 +727,9 @@ static struct Command cmds[] = {
     },
     {
         .cmd = "export",
-        .opts = "[-s] FILE TABLE\n\nOptions:\n"
-                "  -s                Format output as an SQL query",
+        .opts = "[-s] FILE TABLE | -d DIR FILE\n\nOptions:\n"
+                "  -s                Format output as an SQL query\n"
+                "  -d DIR            Export every table to DIR/TABLE.idt",
         .desc = "Export a table in text form from an .msi file",
         .func = cmd_export,
     },